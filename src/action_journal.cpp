@@ -0,0 +1,406 @@
+#include "action_journal.h"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace journal {
+
+namespace {
+
+using durable_file::GetLittleEndian;
+using durable_file::PutLittleEndian;
+
+constexpr size_t FRAME_HEADER_SIZE = 4 + 4;
+
+class PayloadWriter {
+public:
+    template <typename T>
+    void Put(T value) {
+        char bytes[sizeof(T)];
+        char* pos = bytes;
+        PutLittleEndian(pos, value);
+        data_.append(bytes, sizeof(T));
+    }
+
+    void PutDouble(double value) {
+        Put(std::bit_cast<std::uint64_t>(value));
+    }
+
+    void PutString(std::string_view value) {
+        Put(static_cast<std::uint32_t>(value.size()));
+        data_.append(value);
+    }
+
+    std::string& Data() noexcept {
+        return data_;
+    }
+
+private:
+    std::string data_;
+};
+
+// Все чтения проверяют границы: повреждённое тело не должно читать за пределами буфера
+class PayloadReader {
+public:
+    explicit PayloadReader(std::string_view data)
+        : data_(data) {}
+
+    template <typename T>
+    T Get() {
+        Require(sizeof(T));
+        const char* pos = data_.data();
+        T value = GetLittleEndian<T>(pos);
+        data_.remove_prefix(sizeof(T));
+        return value;
+    }
+
+    double GetDouble() {
+        return std::bit_cast<double>(Get<std::uint64_t>());
+    }
+
+    bool Empty() const noexcept {
+        return data_.empty();
+    }
+
+    std::string GetString() {
+        const std::uint32_t size = Get<std::uint32_t>();
+        Require(size);
+        std::string value(data_.substr(0, size));
+        data_.remove_prefix(size);
+        return value;
+    }
+
+private:
+    void Require(size_t size) const {
+        if (data_.size() < size) {
+            throw std::out_of_range("Journal record is too short");
+        }
+    }
+
+    std::string_view data_;
+};
+
+Record DecodeRecord(std::uint8_t type, PayloadReader& reader) {
+    switch (type) {
+    case 0: {
+        JoinRecord join;
+        join.token = reader.GetString();
+        join.dog_name = reader.GetString();
+        join.map_id = reader.GetString();
+        join.dog_id = reader.Get<std::uint64_t>();
+        join.x = reader.GetDouble();
+        join.y = reader.GetDouble();
+        return join;
+    }
+    case 1: {
+        MoveRecord move;
+        move.token = reader.GetString();
+        move.move = reader.GetString();
+        return move;
+    }
+    case 2:
+        return RetireRecord{ reader.GetString() };
+    case 3: {
+        TickRecord tick;
+        tick.time_delta = static_cast<std::int64_t>(reader.Get<std::uint64_t>());
+        tick.seed = reader.Get<std::uint64_t>();
+        if (!reader.Empty()) {
+            tick.generate_loot = reader.Get<std::uint8_t>() != 0;
+            tick.time_without_loot = static_cast<std::int64_t>(reader.Get<std::uint64_t>());
+        }
+        return tick;
+    }
+    }
+    throw std::invalid_argument("Unknown journal record type");
+}
+
+}  // namespace
+
+std::string EncodeEntry(const Entry& entry) {
+    PayloadWriter writer;
+    writer.Put(entry.seq);
+    // Тип записи - индекс альтернативы в Record
+    writer.Put(static_cast<std::uint8_t>(entry.record.index()));
+    std::visit([&writer](const auto& record) {
+        using T = std::decay_t<decltype(record)>;
+        if constexpr (std::is_same_v<T, JoinRecord>) {
+            writer.PutString(record.token);
+            writer.PutString(record.dog_name);
+            writer.PutString(record.map_id);
+            writer.Put(record.dog_id);
+            writer.PutDouble(record.x);
+            writer.PutDouble(record.y);
+        }
+        else if constexpr (std::is_same_v<T, MoveRecord>) {
+            writer.PutString(record.token);
+            writer.PutString(record.move);
+        }
+        else if constexpr (std::is_same_v<T, RetireRecord>) {
+            writer.PutString(record.token);
+        }
+        else {
+            writer.Put(static_cast<std::uint64_t>(record.time_delta));
+            writer.Put(record.seed);
+            if (record.generate_loot && record.time_without_loot) {
+                writer.Put(static_cast<std::uint8_t>(*record.generate_loot));
+                writer.Put(static_cast<std::uint64_t>(*record.time_without_loot));
+            }
+        }
+    }, entry.record);
+
+    const std::string& payload = writer.Data();
+    std::string frame(FRAME_HEADER_SIZE, '\0');
+    char* pos = frame.data();
+    PutLittleEndian(pos, static_cast<std::uint32_t>(payload.size()));
+    PutLittleEndian(pos, durable_file::Crc32(payload));
+    frame += payload;
+    return frame;
+}
+
+std::vector<Entry> DecodeEntries(std::string_view data) {
+    std::vector<Entry> entries;
+    while (data.size() >= FRAME_HEADER_SIZE) {
+        const char* pos = data.data();
+        const std::uint32_t size = GetLittleEndian<std::uint32_t>(pos);
+        const std::uint32_t crc = GetLittleEndian<std::uint32_t>(pos);
+        if (data.size() - FRAME_HEADER_SIZE < size) {
+            break;
+        }
+        const std::string_view payload = data.substr(FRAME_HEADER_SIZE, size);
+        if (durable_file::Crc32(payload) != crc) {
+            break;
+        }
+        try {
+            PayloadReader reader(payload);
+            Entry entry;
+            entry.seq = reader.Get<std::uint64_t>();
+            const std::uint8_t type = reader.Get<std::uint8_t>();
+            entry.record = DecodeRecord(type, reader);
+            entries.push_back(std::move(entry));
+        }
+        catch (const std::exception&) {
+            break;
+        }
+        data.remove_prefix(FRAME_HEADER_SIZE + size);
+    }
+    return entries;
+}
+
+ActionJournal::ActionJournal(std::filesystem::path base_path)
+    : base_path_(std::move(base_path)) {}
+
+ActionJournal::~ActionJournal() {
+    {
+        std::lock_guard lock(mutex_);
+        if (!buffer_.empty()) {
+            tasks_.push_back(Task{ std::nullopt, std::move(buffer_) });
+        }
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+std::vector<Entry> ActionJournal::ReadAfter(std::uint64_t seq) const {
+    std::vector<Entry> result;
+    for (const Segment& segment : ListSegments()) {
+        std::ifstream file(segment.path, std::ios::binary);
+        const std::string content{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+        for (Entry& entry : DecodeEntries(content)) {
+            if (entry.seq > seq) {
+                result.push_back(std::move(entry));
+            }
+        }
+    }
+    return result;
+}
+
+void ActionJournal::Open(std::uint64_t next_seq) {
+    last_seq_ = next_seq - 1;
+    {
+        std::lock_guard lock(mutex_);
+        tasks_.push_back(Task{ next_seq, {} });
+        if (!thread_.joinable()) {
+            thread_ = std::thread([this] { Run(); });
+        }
+    }
+    cv_.notify_all();
+}
+
+std::uint64_t ActionJournal::Append(Record record) {
+    if (!accepting_) {
+        return 0;
+    }
+    buffer_ += EncodeEntry(Entry{ ++last_seq_, std::move(record) });
+    return last_seq_;
+}
+
+std::uint64_t ActionJournal::GetLastSeq() const noexcept {
+    return last_seq_;
+}
+
+void ActionJournal::Commit() {
+    if (buffer_.empty()) {
+        return;
+    }
+    {
+        std::lock_guard lock(mutex_);
+        tasks_.push_back(Task{ std::nullopt, std::move(buffer_) });
+    }
+    buffer_.clear();
+    cv_.notify_all();
+}
+
+void ActionJournal::Rotate() {
+    Commit();
+    {
+        std::lock_guard lock(mutex_);
+        tasks_.push_back(Task{ last_seq_ + 1, {} });
+    }
+    accepting_ = true;
+    cv_.notify_all();
+}
+
+std::exception_ptr ActionJournal::TakeError() {
+    std::exception_ptr error;
+    {
+        std::lock_guard lock(mutex_);
+        error = std::exchange(error_, nullptr);
+    }
+    if (error) {
+        accepting_ = false;
+        buffer_.clear();
+    }
+    return error;
+}
+
+void ActionJournal::RemoveSegmentsUpTo(std::uint64_t seq) {
+    // Сегмент с первой записью не новее seq закончился до снимка, иначе бы он не был закрыт
+    for (const Segment& segment : ListSegments()) {
+        if (segment.first_seq <= seq) {
+            std::error_code ec;
+            std::filesystem::remove(segment.path, ec);
+        }
+    }
+}
+
+void ActionJournal::RemoveSegmentsAfter(std::uint64_t seq) {
+    for (const Segment& segment : ListSegments()) {
+        if (segment.first_seq > seq) {
+            std::error_code ec;
+            std::filesystem::remove(segment.path, ec);
+        }
+    }
+}
+
+void ActionJournal::Flush() {
+    std::unique_lock lock(mutex_);
+    cv_.wait(lock, [this] { return tasks_.empty() && !writing_; });
+    if (error_) {
+        accepting_ = false;
+        buffer_.clear();
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+std::vector<ActionJournal::Segment> ActionJournal::ListSegments() const {
+    const std::filesystem::path dir = base_path_.has_parent_path() ? base_path_.parent_path() : std::filesystem::path(".");
+    const std::string prefix = base_path_.filename().string() + ".";
+
+    std::vector<Segment> segments;
+    std::error_code ec;
+    for (const std::filesystem::directory_entry& file : std::filesystem::directory_iterator(dir, ec)) {
+        const std::string name = file.path().filename().string();
+        if (!name.starts_with(prefix) || name.size() == prefix.size()) {
+            continue;
+        }
+        const std::string_view suffix = std::string_view(name).substr(prefix.size());
+        if (!std::all_of(suffix.begin(), suffix.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            continue;
+        }
+        segments.push_back(Segment{ std::stoull(std::string(suffix)), file.path() });
+    }
+    std::sort(segments.begin(), segments.end(), [](const Segment& lhs, const Segment& rhs) {
+        return lhs.first_seq < rhs.first_seq;
+    });
+    return segments;
+}
+
+std::filesystem::path ActionJournal::SegmentPath(std::uint64_t first_seq) const {
+    std::filesystem::path path = base_path_;
+    path += "." + std::to_string(first_seq);
+    return path;
+}
+
+void ActionJournal::Run() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return !tasks_.empty() || stop_; });
+        if (tasks_.empty()) {
+            return;
+        }
+        // Всё, что накопилось, пока шла предыдущая запись, сбрасывается одним fdatasync
+        std::deque<Task> tasks = std::exchange(tasks_, {});
+        bool failed = failed_;
+        writing_ = true;
+        lock.unlock();
+
+        std::exception_ptr error;
+        bool written = false;
+        for (Task& task : tasks) {
+            try {
+                if (task.new_segment) {
+                    if (written) {
+                        written = false;
+                        segment_.Sync();
+                    }
+                    // Сегмент с этим номером мог остаться пустым или с оборванной записью после сбоя
+                    segment_ = durable_file::AppendFile(SegmentPath(*task.new_segment), true);
+                    durable_file::SyncDirectory(base_path_.parent_path());
+                    failed = false;
+                }
+                // После ошибки записи не дописываются: иначе за потерянными записями в сегменте остался бы разрыв
+                if (!task.data.empty() && !failed) {
+                    if (!segment_.IsOpen()) {
+                        throw std::logic_error("Journal is not opened");
+                    }
+                    segment_.Append(task.data);
+                    written = true;
+                }
+            }
+            catch (...) {
+                error = std::current_exception();
+                failed = true;
+                written = false;
+                segment_ = durable_file::AppendFile();
+            }
+        }
+        if (written) {
+            try {
+                segment_.Sync();
+            }
+            catch (...) {
+                error = std::current_exception();
+                failed = true;
+                segment_ = durable_file::AppendFile();
+            }
+        }
+
+        lock.lock();
+        writing_ = false;
+        failed_ = failed;
+        if (error) {
+            error_ = error;
+        }
+        cv_.notify_all();
+    }
+}
+
+}  // namespace journal
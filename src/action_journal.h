@@ -0,0 +1,151 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "durable_file.h"
+
+namespace journal {
+
+// Входные события, из которых вместе со снимком восстанавливается состояние игры
+struct JoinRecord {
+    std::string token;
+    std::string dog_name;
+    std::string map_id;
+    std::uint64_t dog_id = 0;
+    double x = 0.;
+    double y = 0.;
+};
+
+struct MoveRecord {
+    std::string token;
+    std::string move;
+};
+
+struct RetireRecord {
+    std::string token;
+};
+
+struct TickRecord {
+    std::int64_t time_delta = 0;
+    std::uint64_t seed = 0;
+    // Генерировались ли трофеи и время без трофеев у генератора перед тиком, мс.
+    // В записях, сделанных до появления этих полей, отсутствуют
+    std::optional<bool> generate_loot;
+    std::optional<std::int64_t> time_without_loot;
+};
+
+using Record = std::variant<JoinRecord, MoveRecord, RetireRecord, TickRecord>;
+
+struct Entry {
+    std::uint64_t seq = 0;
+    Record record;
+};
+
+/*
+ * Формат записи в little-endian:
+ *   длина тела u32 | CRC32 тела u32 | тело: номер u64 | тип u8 | поля
+ * Строки хранятся как длина u32 и байты, double - как битовое представление u64.
+ * Необязательные поля дописываются в конец тела и читаются, только если тело их содержит.
+ */
+std::string EncodeEntry(const Entry& entry);
+
+// Разбирает записи подряд и останавливается на первой неполной или повреждённой: это оборванный хвост после сбоя
+std::vector<Entry> DecodeEntries(std::string_view data);
+
+/*
+ * Журнал действий, дописываемый в конец. Записи копятся в памяти и в конце тика
+ * одной группой передаются фоновому потоку, который дописывает их и делает fdatasync.
+ * Журнал разбит на сегменты <base>.<номер первой записи>; новый сегмент начинается
+ * при каждом снимке, и сегменты, полностью покрытые записанным снимком, удаляются.
+ * После ошибки записи журнал отбрасывает записи, пока Rotate не откроет новый сегмент:
+ * потерянные записи должен покрыть снимок, сделанный перед Rotate, иначе в сегменте
+ * остался бы разрыв номеров.
+ * Append, Commit, Rotate и TakeError вызываются только из strand игры.
+ */
+class ActionJournal {
+public:
+    explicit ActionJournal(std::filesystem::path base_path);
+
+    ActionJournal(const ActionJournal&) = delete;
+    ActionJournal& operator=(const ActionJournal&) = delete;
+
+    // Дописывает накопленные записи и останавливает поток
+    ~ActionJournal();
+
+    // Записи с номером больше seq из всех сегментов по порядку
+    std::vector<Entry> ReadAfter(std::uint64_t seq) const;
+
+    // Начинает сегмент с записи next_seq; вызывается один раз после восстановления
+    void Open(std::uint64_t next_seq);
+
+    // Возвращает номер записи; после ошибки, полученной TakeError, и до Rotate запись отбрасывается и возвращается 0
+    std::uint64_t Append(Record record);
+
+    std::uint64_t GetLastSeq() const noexcept;
+
+    // Передаёт накопленные записи на диск
+    void Commit();
+
+    // Закрывает текущий сегмент; следующая запись попадёт в новый
+    void Rotate();
+
+    // Ошибка фоновой записи, если она ещё не была получена. Журнал перестаёт принимать записи до Rotate
+    std::exception_ptr TakeError();
+
+    // Удаляет сегменты, все записи которых не новее seq. Может вызываться из любого потока
+    void RemoveSegmentsUpTo(std::uint64_t seq);
+
+    // Удаляет сегменты, начинающиеся после записи seq; вызывается до Open, если хвост журнала нельзя применить
+    void RemoveSegmentsAfter(std::uint64_t seq);
+
+    // Ждёт, пока все переданные записи будут сброшены на диск. Бросает ещё не полученную ошибку записи
+    void Flush();
+
+private:
+    struct Task {
+        // Если задан, перед записью data открывается сегмент с этим номером
+        std::optional<std::uint64_t> new_segment;
+        std::string data;
+    };
+
+    struct Segment {
+        std::uint64_t first_seq;
+        std::filesystem::path path;
+    };
+
+    std::vector<Segment> ListSegments() const;
+
+    std::filesystem::path SegmentPath(std::uint64_t first_seq) const;
+
+    void Run();
+
+    const std::filesystem::path base_path_;
+    std::uint64_t last_seq_ = 0;
+    std::string buffer_;
+    // false после полученной ошибки и до Rotate; используется только strand игры
+    bool accepting_ = true;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Task> tasks_;
+    bool writing_ = false;
+    bool stop_ = false;
+    std::exception_ptr error_;
+    // Запись не удалась, и новый сегмент ещё не открыт: данные отбрасываются
+    bool failed_ = false;
+    // Используется только фоновым потоком
+    durable_file::AppendFile segment_;
+    std::thread thread_;
+};
+
+}  // namespace journal
@@ -0,0 +1,45 @@
+#include "admin_handler.h"
+
+#include <sstream>
+
+namespace http_handler {
+
+    std::string AdminRequestHandler::SerializeGameMetrics() const {
+        std::ostringstream players;
+        std::ostringstream sessions;
+        std::ostringstream loots;
+
+        players << "# HELP game_players Number of players on the map\n# TYPE game_players gauge\n";
+        sessions << "# HELP game_sessions Number of game sessions on the map\n# TYPE game_sessions gauge\n";
+        loots << "# HELP game_lost_objects Number of lost objects lying on the map\n# TYPE game_lost_objects gauge\n";
+
+        for (const model::Map& map : game_.GetMaps()) {
+            uint64_t dogs_count = 0;
+            size_t sessions_count = 0;
+            size_t loots_count = 0;
+
+            const std::deque<model::GameSession>& map_sessions = game_.GetMapSessions()[map.GetIndex()];
+            sessions_count = map_sessions.size();
+            for (const model::GameSession& session : map_sessions) {
+                dogs_count += session.GetNumberOfDogs();
+                loots_count += session.GetLootCount();
+            }
+
+            const std::string label = "{"s + metrics::Label("map", *map.GetId()) + "}"s;
+            players << "game_players" << label << ' ' << dogs_count << '\n';
+            sessions << "game_sessions" << label << ' ' << sessions_count << '\n';
+            loots << "game_lost_objects" << label << ' ' << loots_count << '\n';
+        }
+
+        return players.str() + sessions.str() + loots.str();
+    }
+
+    std::string AdminRequestHandler::SerializeTickProfile() const {
+        json::array ticks;
+        for (const tick_profiler::TickProfile* profile : game_.GetTickProfiler().GetRecent()) {
+            ticks.emplace_back(tick_profiler::TickProfileToJson(*profile));
+        }
+        return json::serialize(ticks);
+    }
+
+}  // namespace http_handler
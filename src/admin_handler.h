@@ -0,0 +1,70 @@
+#pragma once
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "model.h"
+#include "metrics.h"
+#include "request_handler.h"
+
+namespace http_handler {
+
+    // Обработчик служебного порта: отдаёт метрики и профиль тиков, не конкурируя с игровым трафиком
+    class AdminRequestHandler : public std::enable_shared_from_this<AdminRequestHandler> {
+    public:
+        using Strand = net::strand<net::io_context::executor_type>;
+
+        AdminRequestHandler(model::Game& game, Strand game_strand)
+            : game_(game), game_strand_(game_strand) {}
+
+        AdminRequestHandler(const AdminRequestHandler&) = delete;
+        AdminRequestHandler& operator=(const AdminRequestHandler&) = delete;
+
+        template <typename Body, typename Allocator, typename Send>
+        void operator()(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
+            const unsigned version = req.version();
+            const bool keep_alive = req.keep_alive();
+
+            if (req.method() != http::verb::get && req.method() != http::verb::head) {
+                StringResponse response = MakeStringResponse(http::status::method_not_allowed, "Invalid method"sv, 14, version, keep_alive, ContentType::TEXT_PLAIN);
+                response.set(http::field::allow, "GET, HEAD");
+                return send(std::move(response));
+            }
+
+            if (req.target() == "/metrics"sv) {
+                // Состояние игры читается только внутри strand игры
+                return net::dispatch(game_strand_, [self = shared_from_this(), send, version, keep_alive] {
+                    std::string body = metrics::Registry::Instance().Serialize();
+                    body += self->SerializeGameMetrics();
+                    send(MakeStringResponse(http::status::ok, body, body.size(), version, keep_alive, ContentType::PROMETHEUS));
+                });
+            }
+
+            if (req.target() == "/tick-profile"sv) {
+                return net::dispatch(game_strand_, [self = shared_from_this(), send, version, keep_alive] {
+                    std::string body = self->SerializeTickProfile();
+                    StringResponse response = MakeStringResponse(http::status::ok, body, body.size(), version, keep_alive, ContentType::JSON);
+                    response.set(http::field::cache_control, "no-cache");
+                    send(std::move(response));
+                });
+            }
+
+            send(MakeStringResponse(http::status::not_found, "Not found"sv, 9, version, keep_alive, ContentType::TEXT_PLAIN));
+        }
+
+    private:
+        // Игроки, сессии и трофеи в разрезе карт
+        std::string SerializeGameMetrics() const;
+
+        // Последние тики с разбивкой по стадиям, картам и сессиям
+        std::string SerializeTickProfile() const;
+
+        model::Game& game_;
+        Strand game_strand_;
+    };
+
+}  // namespace http_handler
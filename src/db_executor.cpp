@@ -0,0 +1,189 @@
+#include "db_executor.h"
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+namespace db_executor {
+
+namespace {
+
+// Общее состояние запроса: завершает его тот, кто первым успеет, - поток БД или таймер
+template <typename Result>
+struct Request {
+    using Handler = std::function<void(Error, Result)>;
+
+    Request(net::any_io_executor executor, Handler handler)
+        : completion_executor(executor), timer(executor), handler(std::move(handler)) {}
+
+    void Complete(std::shared_ptr<Request> self, Error error, Result result) {
+        if (done.exchange(true)) {
+            return;
+        }
+        net::post(completion_executor, [self = std::move(self), error, result = std::move(result)]() mutable {
+            self->timer.cancel();
+            self->handler(error, std::move(result));
+        });
+    }
+
+    net::any_io_executor completion_executor;
+    net::steady_timer timer;
+    Handler handler;
+    std::atomic<bool> done = false;
+};
+
+}  // namespace
+
+Executor::Executor(std::shared_ptr<model::Database> db, Config config)
+    : db_(std::move(db)), config_(config) {
+    const size_t threads = std::max<size_t>(config_.threads, 1);
+    workers_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { Run(); });
+    }
+}
+
+Executor::~Executor() {
+    Stop();
+}
+
+void Executor::Stop() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void Executor::GetRecords(int limit, int offset, net::any_io_executor completion_executor, RecordsHandler handler) {
+    Submit<boost::json::array>([limit, offset](model::Database& db) {
+        return db.GetRecords(limit, offset);
+    }, completion_executor, std::move(handler));
+}
+
+void Executor::GetRecordsPage(int limit, std::optional<model::RecordKey> after, net::any_io_executor completion_executor, PageHandler handler) {
+    Submit<model::RecordsPage>([limit, after = std::move(after)](model::Database& db) {
+        return db.GetRecordsPage(limit, after);
+    }, completion_executor, std::move(handler));
+}
+
+void Executor::GetWindowRecords(model::RecordsWindow window, int limit, int offset, net::any_io_executor completion_executor, RecordsHandler handler) {
+    Submit<boost::json::array>([window, limit, offset](model::Database& db) {
+        return db.GetWindowRecords(window, limit, offset);
+    }, completion_executor, std::move(handler));
+}
+
+template <typename Result>
+void Executor::Submit(std::function<Result(model::Database&)> query, net::any_io_executor completion_executor,
+    std::function<void(Error, Result)> handler) {
+    auto request = std::make_shared<Request<Result>>(completion_executor, std::move(handler));
+    // Таймер взводится до постановки в очередь, чтобы поток БД не мог завершить запрос раньше
+    request->timer.expires_after(config_.timeout);
+    request->timer.async_wait([this, request](const boost::system::error_code& ec) {
+        if (!ec && !request->done) {
+            timed_out_.Add();
+            request->Complete(request, Error::TIMEOUT, {});
+        }
+    });
+
+    Task task;
+    task.deadline = std::chrono::steady_clock::now() + config_.timeout;
+    task.run = [request, query = std::move(query)](model::Database& db) {
+        request->Complete(request, Error::NONE, query(db));
+    };
+    task.fail = [request](Error error) {
+        request->Complete(request, error, {});
+    };
+    if (!Enqueue(std::move(task))) {
+        request->Complete(request, Error::QUEUE_FULL, {});
+    }
+}
+
+bool Executor::SaveRecord(std::string name, int score, uint64_t played_time) {
+    Task task;
+    // Рекорд нужно сохранить, даже если очередь разбирается медленно
+    task.deadline = std::chrono::steady_clock::time_point::max();
+    task.run = [name = std::move(name), score, played_time](model::Database& db) {
+        db.SaveRecord(name, score, played_time);
+    };
+    task.fail = [](Error) {};
+    return Enqueue(std::move(task));
+}
+
+bool Executor::Enqueue(Task task) {
+    {
+        std::lock_guard lock(mutex_);
+        if (stop_ || queue_.size() >= config_.max_queue) {
+            rejected_.Add();
+            return false;
+        }
+        queue_.push_back(std::move(task));
+    }
+    queue_depth_.Add();
+    cv_.notify_one();
+    return true;
+}
+
+void Executor::Run() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            // При остановке очередь дорабатывается, чтобы не потерять принятые записи
+            if (queue_.empty()) {
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        queue_depth_.Sub();
+
+        if (std::chrono::steady_clock::now() > task.deadline) {
+            // Ответ уже не нужен: таймер завершил запрос
+            task.fail(Error::TIMEOUT);
+            continue;
+        }
+        metrics::ScopedTimer timer(duration_);
+        try {
+            task.run(*db_);
+        }
+        catch (...) {
+            failed_.Add();
+            task.fail(Error::FAILED);
+        }
+    }
+}
+
+AsyncDatabase::AsyncDatabase(std::shared_ptr<model::Database> db, std::shared_ptr<Executor> executor)
+    : db_(std::move(db)), executor_(std::move(executor)) {}
+
+void AsyncDatabase::SaveRecord(std::string name, int score, uint64_t played_time) {
+    executor_->SaveRecord(std::move(name), score, played_time);
+}
+
+void AsyncDatabase::InsertRecord(const model::RecordKey& record) {
+    db_->InsertRecord(record);
+}
+
+boost::json::array AsyncDatabase::GetRecords(int limit, int offset) {
+    return db_->GetRecords(limit, offset);
+}
+
+model::RecordsPage AsyncDatabase::GetRecordsPage(int limit, const std::optional<model::RecordKey>& after) {
+    return db_->GetRecordsPage(limit, after);
+}
+
+boost::json::array AsyncDatabase::GetWindowRecords(model::RecordsWindow window, int limit, int offset) {
+    return db_->GetWindowRecords(window, limit, offset);
+}
+
+}  // namespace db_executor
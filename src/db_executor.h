@@ -0,0 +1,130 @@
+#pragma once
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/json.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+#include "model.h"
+
+namespace db_executor {
+
+namespace net = boost::asio;
+
+enum class Error {
+    NONE,
+    // Очередь заполнена, запрос не принят
+    QUEUE_FULL,
+    // Ответ не получен за отведённое время
+    TIMEOUT,
+    // Запрос к БД завершился исключением
+    FAILED
+};
+
+struct Config {
+    size_t threads = 1;
+    size_t max_queue = 1024;
+    std::chrono::milliseconds timeout{ 5000 };
+};
+
+/*
+ * Пул потоков для запросов к БД. Потоки ввода-вывода только ставят запрос в очередь,
+ * а результат получают обработчиком, отправленным в указанный executor Asio.
+ * Если очередь заполнена, запрос сразу завершается с QUEUE_FULL. Если ответ не получен
+ * за timeout, обработчик вызывается с TIMEOUT, а поздний результат отбрасывается.
+ */
+class Executor {
+public:
+    using RecordsHandler = std::function<void(Error error, boost::json::array records)>;
+    using PageHandler = std::function<void(Error error, model::RecordsPage page)>;
+
+    Executor(std::shared_ptr<model::Database> db, Config config);
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    ~Executor();
+
+    // Выполняет уже принятые задачи и останавливает потоки. Вызывается до разрушения io_context,
+    // в которые отправляются результаты; новые задачи после остановки не принимаются
+    void Stop();
+
+    void GetRecords(int limit, int offset, net::any_io_executor completion_executor, RecordsHandler handler);
+
+    void GetRecordsPage(int limit, std::optional<model::RecordKey> after, net::any_io_executor completion_executor, PageHandler handler);
+
+    void GetWindowRecords(model::RecordsWindow window, int limit, int offset, net::any_io_executor completion_executor, RecordsHandler handler);
+
+    // Запись выполняется в фоне без ожидания результата; false - очередь заполнена и запись не принята
+    bool SaveRecord(std::string name, int score, uint64_t played_time);
+
+private:
+    struct Task {
+        std::chrono::steady_clock::time_point deadline;
+        std::function<void(model::Database&)> run;
+        // Вызывается вместо run, если задача не выполнена
+        std::function<void(Error)> fail;
+    };
+
+    // Выполняет query в потоке БД и передаёт результат handler в completion_executor
+    template <typename Result>
+    void Submit(std::function<Result(model::Database&)> query, net::any_io_executor completion_executor,
+        std::function<void(Error, Result)> handler);
+
+    bool Enqueue(Task task);
+
+    void Run();
+
+    const std::shared_ptr<model::Database> db_;
+    const Config config_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Task> queue_;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+
+    metrics::Gauge queue_depth_ = metrics::Registry::Instance().AddGauge(
+        "db_executor_queue_depth", "Number of database requests waiting for a database thread");
+    metrics::Histogram duration_ = metrics::Registry::Instance().AddHistogram(
+        "db_executor_request_duration_microseconds", "Time database requests spend in a database thread");
+    metrics::Counter rejected_ = metrics::Registry::Instance().AddCounter(
+        "db_executor_errors_total", "Number of failed database requests", metrics::Label("reason", "queue_full"));
+    metrics::Counter timed_out_ = metrics::Registry::Instance().AddCounter(
+        "db_executor_errors_total", "Number of failed database requests", metrics::Label("reason", "timeout"));
+    metrics::Counter failed_ = metrics::Registry::Instance().AddCounter(
+        "db_executor_errors_total", "Number of failed database requests", metrics::Label("reason", "exception"));
+};
+
+// Database для Game: запись рекордов уходит в Executor и не блокирует тик
+class AsyncDatabase : public model::Database {
+public:
+    AsyncDatabase(std::shared_ptr<model::Database> db, std::shared_ptr<Executor> executor);
+
+    void SaveRecord(std::string name, int score, uint64_t played_time) override;
+
+    void InsertRecord(const model::RecordKey& record) override;
+
+    // Синхронный запрос для вызовов вне потоков ввода-вывода; HTTP-обработчики используют Executor::GetRecords
+    boost::json::array GetRecords(int limit, int offset) override;
+
+    model::RecordsPage GetRecordsPage(int limit, const std::optional<model::RecordKey>& after) override;
+
+    boost::json::array GetWindowRecords(model::RecordsWindow window, int limit, int offset) override;
+
+private:
+    std::shared_ptr<model::Database> db_;
+    std::shared_ptr<Executor> executor_;
+};
+
+}  // namespace db_executor
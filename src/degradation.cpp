@@ -0,0 +1,110 @@
+#include "degradation.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace degradation {
+using namespace std::literals;
+
+std::optional<Action> ActionFromString(std::string_view name) {
+    if (name == "stretchTickPeriod"sv) {
+        return Action::STRETCH_TICK_PERIOD;
+    }
+    if (name == "skipLootGeneration"sv) {
+        return Action::SKIP_LOOT_GENERATION;
+    }
+    if (name == "throttleState"sv) {
+        return Action::THROTTLE_STATE;
+    }
+    if (name == "rejectJoins"sv) {
+        return Action::REJECT_JOINS;
+    }
+    return std::nullopt;
+}
+
+std::string_view ActionToString(Action action) {
+    switch (action) {
+    case Action::STRETCH_TICK_PERIOD:
+        return "stretchTickPeriod"sv;
+    case Action::SKIP_LOOT_GENERATION:
+        return "skipLootGeneration"sv;
+    case Action::THROTTLE_STATE:
+        return "throttleState"sv;
+    case Action::REJECT_JOINS:
+        return "rejectJoins"sv;
+    }
+    return "unknown"sv;
+}
+
+Controller::Controller(Config config) {
+    SetConfig(std::move(config));
+}
+
+void Controller::SetConfig(Config config) {
+    if (config.stretch_factor < 1.0) {
+        throw std::invalid_argument("Degradation stretch factor must be at least 1");
+    }
+    config_ = std::move(config);
+    SetLevel(std::min(level_, config_.ladder.size()));
+    overrun_streak_ = 0;
+    healthy_streak_ = 0;
+}
+
+const Config& Controller::GetConfig() const noexcept {
+    return config_;
+}
+
+bool Controller::OnTickFinished(std::chrono::microseconds tick_duration, std::chrono::microseconds tick_period) {
+    // Сравнение идёт с базовым периодом, иначе растянутый период сразу выглядел бы здоровым
+    const double load = tick_period.count() > 0
+        ? static_cast<double>(tick_duration.count()) / static_cast<double>(tick_period.count())
+        : 0.;
+
+    if (load > config_.overrun_ratio) {
+        ++overrun_streak_;
+        healthy_streak_ = 0;
+    }
+    else if (load < config_.recover_ratio) {
+        ++healthy_streak_;
+        overrun_streak_ = 0;
+    }
+    else {
+        overrun_streak_ = 0;
+        healthy_streak_ = 0;
+    }
+
+    if (overrun_streak_ >= config_.escalate_after_ticks && level_ < config_.ladder.size()) {
+        SetLevel(level_ + 1);
+        overrun_streak_ = 0;
+        return true;
+    }
+    if (healthy_streak_ >= config_.recover_after_ticks && level_ > 0) {
+        SetLevel(level_ - 1);
+        healthy_streak_ = 0;
+        return true;
+    }
+    return false;
+}
+
+size_t Controller::GetLevel() const noexcept {
+    return level_;
+}
+
+bool Controller::IsActive(Action action) const noexcept {
+    const auto end = config_.ladder.begin() + static_cast<std::ptrdiff_t>(level_);
+    return std::find(config_.ladder.begin(), end, action) != end;
+}
+
+std::chrono::milliseconds Controller::GetTickPeriod(std::chrono::milliseconds base_period) const {
+    if (!IsActive(Action::STRETCH_TICK_PERIOD)) {
+        return base_period;
+    }
+    return std::chrono::milliseconds{ static_cast<int64_t>(static_cast<double>(base_period.count()) * config_.stretch_factor) };
+}
+
+void Controller::SetLevel(size_t level) {
+    level_gauge_.Add(static_cast<std::int64_t>(level) - static_cast<std::int64_t>(level_));
+    level_ = level;
+}
+
+}  // namespace degradation
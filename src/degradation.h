@@ -0,0 +1,68 @@
+#pragma once
+#include <chrono>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "metrics.h"
+
+namespace degradation {
+
+// Ступени деградации; на уровне N включены первые N ступеней лестницы
+enum class Action {
+    STRETCH_TICK_PERIOD, SKIP_LOOT_GENERATION, THROTTLE_STATE, REJECT_JOINS
+};
+
+std::optional<Action> ActionFromString(std::string_view name);
+
+std::string_view ActionToString(Action action);
+
+struct Config {
+    // Тик перегружен, если длится дольше этой доли периода
+    double overrun_ratio = 0.9;
+    // Тик считается здоровым, если укладывается в эту долю периода
+    double recover_ratio = 0.5;
+    unsigned escalate_after_ticks = 5;
+    unsigned recover_after_ticks = 50;
+    double stretch_factor = 2.0;
+    std::chrono::milliseconds state_throttle{ 500 };
+    std::vector<Action> ladder{ Action::STRETCH_TICK_PERIOD, Action::SKIP_LOOT_GENERATION, Action::THROTTLE_STATE, Action::REJECT_JOINS };
+};
+
+/*
+ * Следит за длительностью тиков и при устойчивом превышении периода поднимает уровень деградации,
+ * а после серии здоровых тиков опускает его обратно.
+ * Вызывается только из strand игры.
+ */
+class Controller {
+public:
+    Controller() = default;
+
+    explicit Controller(Config config);
+
+    void SetConfig(Config config);
+
+    const Config& GetConfig() const noexcept;
+
+    // Возвращает true, если уровень изменился
+    bool OnTickFinished(std::chrono::microseconds tick_duration, std::chrono::microseconds tick_period);
+
+    size_t GetLevel() const noexcept;
+
+    bool IsActive(Action action) const noexcept;
+
+    std::chrono::milliseconds GetTickPeriod(std::chrono::milliseconds base_period) const;
+
+private:
+    void SetLevel(size_t level);
+
+    Config config_;
+    size_t level_ = 0;
+    unsigned overrun_streak_ = 0;
+    unsigned healthy_streak_ = 0;
+
+    metrics::Gauge level_gauge_ = metrics::Registry::Instance().AddGauge(
+        "game_degradation_level", "Current tick overload degradation level");
+};
+
+}  // namespace degradation
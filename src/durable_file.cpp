@@ -0,0 +1,140 @@
+#include "durable_file.h"
+
+#include <boost/crc.hpp>
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace durable_file {
+
+namespace {
+
+void ThrowSystemError(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+void WriteAll(int fd, std::string_view data, const std::filesystem::path& path) {
+    while (!data.empty()) {
+        const ssize_t written = ::write(fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowSystemError("Failed to write " + path.string());
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+}
+
+}  // namespace
+
+std::uint32_t Crc32(std::string_view data) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data.data(), data.size());
+    return crc.checksum();
+}
+
+void WriteAndSync(const std::filesystem::path& path, std::string_view data) {
+    AppendFile file(path, true);
+    file.Append(data);
+    file.Sync();
+}
+
+void SyncDirectory(const std::filesystem::path& dir) {
+    const int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return;
+    }
+    ::fsync(fd);
+    ::close(fd);
+}
+
+AppendFile::AppendFile(const std::filesystem::path& path, bool truncate)
+    : path_(path) {
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0644);
+    if (fd_ < 0) {
+        ThrowSystemError("Failed to open " + path.string());
+    }
+}
+
+AppendFile::AppendFile(AppendFile&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1))
+    , path_(std::move(other.path_)) {}
+
+AppendFile& AppendFile::operator=(AppendFile&& other) noexcept {
+    if (this != &other) {
+        Close();
+        fd_ = std::exchange(other.fd_, -1);
+        path_ = std::move(other.path_);
+    }
+    return *this;
+}
+
+AppendFile::~AppendFile() {
+    Close();
+}
+
+bool AppendFile::IsOpen() const noexcept {
+    return fd_ >= 0;
+}
+
+void AppendFile::Append(std::string_view data) {
+    WriteAll(fd_, data, path_);
+}
+
+void AppendFile::Sync() {
+    if (::fdatasync(fd_) != 0) {
+        ThrowSystemError("Failed to sync " + path_.string());
+    }
+}
+
+void AppendFile::Close() noexcept {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        ThrowSystemError("Failed to open " + path.string());
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        ThrowSystemError("Failed to stat " + path.string());
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    // Пустой файл отобразить нельзя
+    if (size_ > 0) {
+        data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data_ == MAP_FAILED) {
+            data_ = nullptr;
+            ::close(fd);
+            ThrowSystemError("Failed to map " + path.string());
+        }
+        // Файл читается целиком: пусть ядро подгружает страницы заранее
+        ::madvise(data_, size_, MADV_WILLNEED);
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_) {
+        ::munmap(data_, size_);
+    }
+}
+
+std::string_view MappedFile::GetData() const noexcept {
+    return { static_cast<const char*>(data_), size_ };
+}
+
+}  // namespace durable_file
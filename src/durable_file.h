@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+namespace durable_file {
+
+// Запись целых в little-endian со сдвигом указателя
+template <typename T>
+void PutLittleEndian(char*& out, T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        *out++ = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+template <typename T>
+T GetLittleEndian(const char*& in) {
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<T>(static_cast<unsigned char>(*in++)) << (8 * i);
+    }
+    return value;
+}
+
+std::uint32_t Crc32(std::string_view data);
+
+// Записывает data в файл целиком (перезаписывая его) и сбрасывает на диск
+void WriteAndSync(const std::filesystem::path& path, std::string_view data);
+
+// Без fsync каталога создание или переименование файла может не пережить сбой питания
+void SyncDirectory(const std::filesystem::path& dir);
+
+// Файл, открытый на дозапись
+class AppendFile {
+public:
+    AppendFile() = default;
+
+    // truncate - начать файл заново, а не дописывать в конец
+    AppendFile(const std::filesystem::path& path, bool truncate);
+
+    AppendFile(AppendFile&& other) noexcept;
+    AppendFile& operator=(AppendFile&& other) noexcept;
+
+    AppendFile(const AppendFile&) = delete;
+    AppendFile& operator=(const AppendFile&) = delete;
+
+    ~AppendFile();
+
+    bool IsOpen() const noexcept;
+
+    void Append(std::string_view data);
+
+    // fdatasync: метаданные, кроме размера, не сбрасываются
+    void Sync();
+
+private:
+    void Close() noexcept;
+
+    int fd_ = -1;
+    std::filesystem::path path_;
+};
+
+// Файл, отображённый в память только для чтения
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    std::string_view GetData() const noexcept;
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+}  // namespace durable_file
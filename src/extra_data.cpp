@@ -16,6 +16,6 @@ size_t ExtraData::GetLootCount(size_t index) const {
 	return loots_.at(index).size();
 }
 
-json::array ExtraData::GetInfoByIndex(size_t index) const {
+const json::array& ExtraData::GetInfoByIndex(size_t index) const {
 	return loots_.at(index);
 }
@@ -21,7 +21,7 @@ public:
 
 	size_t GetLootCount(size_t index) const;
 
-	json::array GetInfoByIndex(size_t index) const;
+	const json::array& GetInfoByIndex(size_t index) const;
 
 private:
 	std::vector<json::array> loots_;
@@ -0,0 +1,204 @@
+#include "file_database.h"
+
+#include <boost/uuid/random_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+#include <fstream>
+#include <iterator>
+#include <tuple>
+
+namespace file_db {
+
+namespace {
+
+using durable_file::GetLittleEndian;
+using durable_file::PutLittleEndian;
+
+constexpr size_t FRAME_HEADER_SIZE = 4 + 4;
+constexpr size_t FIXED_PAYLOAD_SIZE = 4 + 8 + 4;
+
+}  // namespace
+
+std::string NewRecordId() {
+    // Генератор читает энтропию при создании, поэтому он один на поток
+    thread_local boost::uuids::random_generator uuid_generator;
+    return boost::uuids::to_string(uuid_generator());
+}
+
+std::string EncodeRecord(const model::RecordKey& key) {
+    std::string frame(FRAME_HEADER_SIZE + FIXED_PAYLOAD_SIZE, '\0');
+    char* pos = frame.data() + FRAME_HEADER_SIZE;
+    PutLittleEndian(pos, static_cast<std::uint32_t>(key.score));
+    PutLittleEndian(pos, static_cast<std::uint64_t>(key.play_time_ms));
+    PutLittleEndian(pos, static_cast<std::uint16_t>(key.id.size()));
+    PutLittleEndian(pos, static_cast<std::uint16_t>(key.name.size()));
+    frame += key.id;
+    frame += key.name;
+    char retired_at[8];
+    pos = retired_at;
+    PutLittleEndian(pos, static_cast<std::uint64_t>(key.retired_at));
+    frame.append(retired_at, sizeof(retired_at));
+
+    const std::string_view payload = std::string_view(frame).substr(FRAME_HEADER_SIZE);
+    pos = frame.data();
+    PutLittleEndian(pos, static_cast<std::uint32_t>(payload.size()));
+    PutLittleEndian(pos, durable_file::Crc32(payload));
+    return frame;
+}
+
+size_t DecodeRecords(std::string_view data, const std::function<void(model::RecordKey)>& on_record) {
+    size_t valid = 0;
+    while (data.size() - valid >= FRAME_HEADER_SIZE) {
+        const char* pos = data.data() + valid;
+        const std::uint32_t size = GetLittleEndian<std::uint32_t>(pos);
+        const std::uint32_t crc = GetLittleEndian<std::uint32_t>(pos);
+        if (size < FIXED_PAYLOAD_SIZE || data.size() - valid - FRAME_HEADER_SIZE < size) {
+            break;
+        }
+        const std::string_view payload = data.substr(valid + FRAME_HEADER_SIZE, size);
+        if (durable_file::Crc32(payload) != crc) {
+            break;
+        }
+        model::RecordKey key;
+        key.score = static_cast<int>(GetLittleEndian<std::uint32_t>(pos));
+        key.play_time_ms = GetLittleEndian<std::uint64_t>(pos);
+        const std::uint16_t id_size = GetLittleEndian<std::uint16_t>(pos);
+        const std::uint16_t name_size = GetLittleEndian<std::uint16_t>(pos);
+        const size_t base_size = FIXED_PAYLOAD_SIZE + id_size + name_size;
+        if (size != base_size && size != base_size + sizeof(std::uint64_t)) {
+            break;
+        }
+        key.id.assign(pos, id_size);
+        key.name.assign(pos + id_size, name_size);
+        if (size != base_size) {
+            pos += id_size + name_size;
+            key.retired_at = static_cast<int64_t>(GetLittleEndian<std::uint64_t>(pos));
+        }
+        on_record(std::move(key));
+        valid += FRAME_HEADER_SIZE + size;
+    }
+    return valid;
+}
+
+void LoadRecordFile(const std::filesystem::path& path, const std::function<void(model::RecordKey)>& on_record) {
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) {
+        return;
+    }
+    std::ifstream file(path, std::ios::binary);
+    const std::string content{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    const size_t valid = DecodeRecords(content, on_record);
+    if (valid < content.size()) {
+        std::filesystem::resize_file(path, valid);
+    }
+}
+
+bool FileDatabase::KeyLess::operator()(const model::RecordKey& lhs, const model::RecordKey& rhs) const noexcept {
+    return std::tie(rhs.score, lhs.play_time_ms, lhs.name, lhs.id) < std::tie(lhs.score, rhs.play_time_ms, rhs.name, rhs.id);
+}
+
+FileDatabase::FileDatabase(std::filesystem::path path) {
+    LoadRecordFile(path, [this](model::RecordKey key) {
+        if (ids_.insert(key.id).second) {
+            AddToWindows(key);
+            index_.insert(std::move(key));
+        }
+    });
+    log_ = durable_file::AppendFile(path, false);
+    if (path.has_parent_path()) {
+        durable_file::SyncDirectory(path.parent_path());
+    }
+}
+
+void FileDatabase::SaveRecord(std::string name, int score, uint64_t played_time) {
+    InsertRecord(model::RecordKey{ score, played_time, std::move(name), NewRecordId(), model::GetRecordTime() });
+}
+
+void FileDatabase::InsertRecord(const model::RecordKey& record) {
+    std::lock_guard lock(log_mutex_);
+    {
+        std::shared_lock index_lock(index_mutex_);
+        if (ids_.contains(record.id)) {
+            return;
+        }
+    }
+    model::RecordKey stored = record;
+    if (stored.retired_at == 0) {
+        stored.retired_at = model::GetRecordTime();
+    }
+    log_.Append(EncodeRecord(stored));
+    log_.Sync();
+    // Запись видна в таблице только после того, как она на диске
+    std::unique_lock index_lock(index_mutex_);
+    ids_.insert(stored.id);
+    AddToWindows(stored);
+    index_.insert(std::move(stored));
+}
+
+void FileDatabase::AddToWindows(const model::RecordKey& record) {
+    if (record.retired_at == 0) {
+        return;
+    }
+    for (model::RecordsWindow window : { model::RecordsWindow::DAY, model::RecordsWindow::WEEK }) {
+        Index& top = windows_[{ window, model::GetWindowStart(window, record.retired_at) }];
+        top.insert(record);
+        if (top.size() > static_cast<size_t>(model::WINDOW_TOP_SIZE)) {
+            top.erase(std::prev(top.end()));
+        }
+    }
+}
+
+boost::json::array FileDatabase::GetWindowRecords(model::RecordsWindow window, int limit, int offset) {
+    if (window == model::RecordsWindow::ALL) {
+        return GetRecords(limit, offset);
+    }
+    boost::json::array result;
+    std::shared_lock lock(index_mutex_);
+    const auto top = windows_.find({ window, model::GetWindowStart(window, model::GetRecordTime()) });
+    if (top == windows_.end() || offset < 0 || static_cast<size_t>(offset) >= top->second.size()) {
+        return result;
+    }
+    for (auto it = std::next(top->second.begin(), offset); it != top->second.end() && result.size() < static_cast<size_t>(limit); ++it) {
+        result.emplace_back(RecordToJson(*it));
+    }
+    return result;
+}
+
+boost::json::array FileDatabase::GetRecords(int limit, int offset) {
+    boost::json::array result;
+    std::shared_lock lock(index_mutex_);
+    if (offset < 0 || static_cast<size_t>(offset) >= index_.size()) {
+        return result;
+    }
+    auto it = std::next(index_.begin(), offset);
+    for (; it != index_.end() && result.size() < static_cast<size_t>(limit); ++it) {
+        result.emplace_back(RecordToJson(*it));
+    }
+    return result;
+}
+
+model::RecordsPage FileDatabase::GetRecordsPage(int limit, const std::optional<model::RecordKey>& after) {
+    model::RecordsPage page;
+    std::shared_lock lock(index_mutex_);
+    auto it = after ? index_.upper_bound(*after) : index_.begin();
+    for (; it != index_.end() && page.records.size() < static_cast<size_t>(limit); ++it) {
+        page.records.emplace_back(RecordToJson(*it));
+        page.last = *it;
+    }
+    return page;
+}
+
+size_t FileDatabase::GetCount() const {
+    std::shared_lock lock(index_mutex_);
+    return index_.size();
+}
+
+boost::json::object FileDatabase::RecordToJson(const model::RecordKey& key) {
+    boost::json::object record;
+    record.emplace("name", key.name);
+    record.emplace("score", key.score);
+    record.emplace("playTime", static_cast<double>(key.play_time_ms) / 1000.0);
+    return record;
+}
+
+}  // namespace file_db
@@ -0,0 +1,81 @@
+#pragma once
+#include <boost/json.hpp>
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+#include "durable_file.h"
+#include "model.h"
+
+namespace file_db {
+
+// Случайный UUID для новой записи; по нему повторная вставка той же записи игнорируется
+std::string NewRecordId();
+
+// Кадр записи в файле: размер тела, CRC32 тела, затем очки, время игры, длины и сами id и имя, время ухода.
+// Кадры без времени ухода в конце тоже читаются
+std::string EncodeRecord(const model::RecordKey& record);
+
+// Вызывает on_record для каждой целой записи и возвращает длину корректного начала data
+size_t DecodeRecords(std::string_view data, const std::function<void(model::RecordKey)>& on_record);
+
+// Читает все записи файла и отрезает оборванный сбоем хвост, чтобы новые записи не легли после мусора
+void LoadRecordFile(const std::filesystem::path& path, const std::function<void(model::RecordKey)>& on_record);
+
+/*
+ * Таблица рекордов без PostgreSQL: каждая запись дописывается в журнал на диске
+ * и сбрасывается fdatasync, а запросы обслуживает отсортированный индекс в памяти.
+ * При открытии журнал читается целиком; оборванная сбоем последняя запись отрезается.
+ */
+class FileDatabase : public model::Database {
+public:
+    explicit FileDatabase(std::filesystem::path path);
+
+    FileDatabase(const FileDatabase&) = delete;
+    FileDatabase& operator=(const FileDatabase&) = delete;
+
+    void SaveRecord(std::string name, int score, uint64_t played_time) override;
+
+    void InsertRecord(const model::RecordKey& record) override;
+
+    boost::json::array GetRecords(int limit, int offset) override;
+
+    model::RecordsPage GetRecordsPage(int limit, const std::optional<model::RecordKey>& after) override;
+
+    boost::json::array GetWindowRecords(model::RecordsWindow window, int limit, int offset) override;
+
+    size_t GetCount() const;
+
+private:
+    // Порядок таблицы рекордов: очки по убыванию, затем время игры, имя и id по возрастанию
+    struct KeyLess {
+        bool operator()(const model::RecordKey& lhs, const model::RecordKey& rhs) const noexcept;
+    };
+
+    using Index = std::set<model::RecordKey, KeyLess>;
+
+    static boost::json::object RecordToJson(const model::RecordKey& key);
+
+    // Добавляет запись в верх её суток и недели. Вызывается под index_mutex_
+    void AddToWindows(const model::RecordKey& record);
+
+    // Сериализует дозапись в файл; индекс защищён отдельно, чтобы чтение не ждало fdatasync
+    std::mutex log_mutex_;
+    durable_file::AppendFile log_;
+
+    mutable std::shared_mutex index_mutex_;
+    Index index_;
+    std::unordered_set<std::string> ids_;
+    // Верх таблицы по периодам: ключ - окно и начало периода
+    std::map<std::pair<model::RecordsWindow, int64_t>, Index> windows_;
+};
+
+}  // namespace file_db
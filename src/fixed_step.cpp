@@ -0,0 +1,31 @@
+#include "fixed_step.h"
+
+#include <algorithm>
+
+namespace fixed_step {
+
+Accumulator::Accumulator(unsigned max_catch_up_steps) noexcept
+    : max_catch_up_steps_(max_catch_up_steps) {}
+
+Steps Accumulator::Advance(Clock::duration elapsed, Clock::duration period) noexcept {
+    Steps steps;
+    accumulated_ += elapsed;
+    if (period <= Clock::duration::zero()) {
+        return steps;
+    }
+    const std::int64_t due = accumulated_ / period;
+    steps.run = static_cast<unsigned>(std::min<std::int64_t>(due, std::int64_t{ max_catch_up_steps_ } + 1));
+    steps.dropped = due - steps.run;
+    accumulated_ -= due * period;
+    return steps;
+}
+
+Accumulator::Clock::time_point Accumulator::GetNextDeadline(Clock::time_point now, Clock::duration period) const noexcept {
+    return now - accumulated_ + period;
+}
+
+Accumulator::Clock::duration Accumulator::GetAccumulated() const noexcept {
+    return accumulated_;
+}
+
+}  // namespace fixed_step
@@ -0,0 +1,40 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+namespace fixed_step {
+
+struct Steps {
+    // Сколько шагов выполнить, включая догоняющие
+    unsigned run = 0;
+    // Сколько шагов отброшено сверх предела догоняющих
+    std::int64_t dropped = 0;
+};
+
+/*
+ * Расчёт шагов фиксированной длины для тикера: реальное время копится, пока его не хватит на шаг,
+ * опоздавший тик догоняется не более чем max_catch_up_steps дополнительными шагами, остальные
+ * отбрасываются. Дедлайн следующего тика привязан к сетке шагов, поэтому задержки планировщика
+ * не накапливаются.
+ */
+class Accumulator {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Accumulator(unsigned max_catch_up_steps = 0) noexcept;
+
+    // Учитывает время, прошедшее с прошлого тика, и возвращает шаги длины period
+    Steps Advance(Clock::duration elapsed, Clock::duration period) noexcept;
+
+    // Дедлайн следующего тика для тика, пришедшего в now
+    Clock::time_point GetNextDeadline(Clock::time_point now, Clock::duration period) const noexcept;
+
+    // Реальное время, ещё не отданное симуляции шагами
+    Clock::duration GetAccumulated() const noexcept;
+
+private:
+    unsigned max_catch_up_steps_;
+    Clock::duration accumulated_{};
+};
+
+}  // namespace fixed_step
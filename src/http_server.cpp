@@ -2,6 +2,33 @@
 
 namespace http_server {
 
+    namespace {
+
+        struct ConnectionMetrics {
+            metrics::Gauge active = metrics::Registry::Instance().AddGauge(
+                "http_active_connections", "Number of open HTTP connections");
+            metrics::Counter accepted = metrics::Registry::Instance().AddCounter(
+                "http_connections_total", "Number of accepted HTTP connections");
+            metrics::Counter bytes_in = metrics::Registry::Instance().AddCounter(
+                "http_received_bytes_total", "Bytes of HTTP requests read");
+            metrics::Counter bytes_out = metrics::Registry::Instance().AddCounter(
+                "http_sent_bytes_total", "Bytes of HTTP responses written");
+            metrics::Counter rejected = metrics::Registry::Instance().AddCounter(
+                "http_rejected_connections_total", "Number of connections closed by connection limits");
+            metrics::Counter timed_out = metrics::Registry::Instance().AddCounter(
+                "http_timed_out_connections_total", "Number of connections closed by idle or header timeout");
+        };
+
+        // Размер первого чтения в ожидании нового запроса
+        constexpr size_t IDLE_READ_SIZE = 4096;
+
+        const ConnectionMetrics& GetConnectionMetrics() {
+            static const ConnectionMetrics connection_metrics;
+            return connection_metrics;
+        }
+
+    }  // namespace
+
     void ReportError(beast::error_code ec, std::string_view what) {
         boost::json::value error_data{ {"code"s, ec.value()}, {"text"s, ec.message()}, {"where"s, what} };
         BOOST_LOG_TRIVIAL(error) << boost::log::add_value(logger::additional_data, error_data)
@@ -9,6 +36,10 @@ namespace http_server {
             << "error"sv;
     }
 
+    void ReportRejectedConnection() {
+        GetConnectionMetrics().rejected.Add();
+    }
+
     void SessionBase::Run() {
         // Вызываем метод Read, используя executor объекта stream_.
         // Таким образом вся работа со stream_ будет выполняться, используя его executor
@@ -16,15 +47,54 @@ namespace http_server {
             beast::bind_front_handler(&SessionBase::Read, GetSharedThis()));
     }
 
-    SessionBase::SessionBase(tcp::socket&& socket)
-        : stream_(std::move(socket)) {
+    SessionBase::SessionBase(tcp::socket&& socket, const SessionTimeouts& timeouts, std::shared_ptr<ConnectionLimiter> limiter, net::ip::address address)
+        : stream_(std::move(socket))
+        , timeouts_(timeouts)
+        , limiter_(std::move(limiter))
+        , address_(std::move(address)) {
+        GetConnectionMetrics().accepted.Add();
+        GetConnectionMetrics().active.Add();
+    }
+
+    SessionBase::~SessionBase() {
+        GetConnectionMetrics().active.Sub();
+        if (limiter_) {
+            limiter_->Release(address_);
+        }
     }
 
     void SessionBase::Read() {
-        using namespace std::literals;
         // Очищаем запрос от прежнего значения (метод Read может быть вызван несколько раз)
         request_ = {};
-        stream_.expires_after(30s);
+        if (buffer_.size() > 0) {
+            // Начало следующего запроса уже прочитано вместе с предыдущим
+            return ReadRequest();
+        }
+        stream_.expires_after(timeouts_.idle);
+        stream_.async_read_some(buffer_.prepare(IDLE_READ_SIZE),
+            beast::bind_front_handler(&SessionBase::OnIdleRead, GetSharedThis()));
+    }
+
+    void SessionBase::OnIdleRead(beast::error_code ec, std::size_t bytes_read) {
+        if (ec == net::error::eof) {
+            // Нормальная ситуация - клиент закрыл соединение
+            return Close();
+        }
+        if (ec == beast::error::timeout) {
+            // Простаивающее соединение закрываем без записи в журнал ошибок
+            GetConnectionMetrics().timed_out.Add();
+            return;
+        }
+        if (ec) {
+            return ReportError(ec, "read"sv);
+        }
+        // Учитываются в OnRead: async_read включает в разобранный размер уже прочитанные байты
+        buffer_.commit(bytes_read);
+        ReadRequest();
+    }
+
+    void SessionBase::ReadRequest() {
+        stream_.expires_after(timeouts_.header);
         // Считываем request_ из stream_, используя buffer_ для хранения считанных данных
         http::async_read(stream_, buffer_, request_,
             // По окончании операции будет вызван метод OnRead
@@ -37,10 +107,15 @@ namespace http_server {
             // Нормальная ситуация - клиент закрыл соединение
             return Close();
         }
+        if (ec == beast::error::timeout) {
+            GetConnectionMetrics().timed_out.Add();
+            return ReportError(ec, "read request"sv);
+        }
         if (ec) {
             return ReportError(ec, "read"sv);
         }
-        HandleRequest(std::move(request_), stream_.socket().remote_endpoint().address().to_string());
+        GetConnectionMetrics().bytes_in.Add(static_cast<std::int64_t>(bytes_read));
+        HandleRequest(std::move(request_), address_.to_string());
     }
 
     void SessionBase::Close() {
@@ -55,6 +130,7 @@ namespace http_server {
         if (ec) {
             return ReportError(ec, "write"sv);
         }
+        GetConnectionMetrics().bytes_out.Add(static_cast<std::int64_t>(bytes_written));
 
         if (close) {
             // Семантика ответа требует закрыть соединение
@@ -7,9 +7,13 @@
 #include <boost/beast/http.hpp>
 #include <boost/asio/dispatch.hpp>
 #include <boost/json.hpp>
+#include "load_shedding.h"
 #include "logger.h"
+#include "metrics.h"
 
+#include <chrono>
 #include <iostream>
+#include <stdexcept>
 
 namespace http_server {
 
@@ -22,6 +26,57 @@ namespace http_server {
 
     void ReportError(beast::error_code ec, std::string_view what);
 
+    void ReportRejectedConnection();
+
+#ifdef SO_REUSEPORT
+    // Позволяет нескольким acceptor'ам слушать один порт, входящие соединения распределяет ядро.
+    // Опция для set_option по требованиям SettableSocketOption, без внутренних типов Asio
+    class ReusePort {
+    public:
+        explicit ReusePort(bool enabled) noexcept
+            : value_(enabled ? 1 : 0) {}
+
+        template <typename Protocol>
+        int level(const Protocol&) const noexcept {
+            return SOL_SOCKET;
+        }
+
+        template <typename Protocol>
+        int name(const Protocol&) const noexcept {
+            return SO_REUSEPORT;
+        }
+
+        template <typename Protocol>
+        const void* data(const Protocol&) const noexcept {
+            return &value_;
+        }
+
+        template <typename Protocol>
+        std::size_t size(const Protocol&) const noexcept {
+            return sizeof(value_);
+        }
+
+    private:
+        int value_;
+    };
+#endif
+
+    struct SessionTimeouts {
+        // Сколько соединение может простаивать в ожидании следующего запроса
+        std::chrono::milliseconds idle{ 30s };
+        // За сколько после первого байта запрос должен быть прочитан целиком
+        std::chrono::milliseconds header{ 10s };
+    };
+
+    using load_shedding::ConnectionLimiter;
+
+    struct ListenerOptions {
+        // Позволяет запустить на одном порту по Listener'у в каждом io_context
+        bool reuse_port = false;
+        SessionTimeouts timeouts;
+        std::shared_ptr<ConnectionLimiter> limiter;
+    };
+
     class SessionBase {
     public:
         // Запрещаем копирование и присваивание объектов SessionBase и его наследников
@@ -34,7 +89,7 @@ namespace http_server {
 
         using HttpRequest = http::request<http::string_body>;
 
-        explicit SessionBase(tcp::socket&& socket);
+        SessionBase(tcp::socket&& socket, const SessionTimeouts& timeouts, std::shared_ptr<ConnectionLimiter> limiter, net::ip::address address);
 
         template <typename Body, typename Fields>
         void Write(http::response<Body, Fields>&& response) {
@@ -48,11 +103,16 @@ namespace http_server {
                 });
         }
 
-        ~SessionBase() = default;
+        ~SessionBase();
     private:
 
         void Read();
 
+        // Первые байты следующего запроса ждём с таймаутом простоя
+        void OnIdleRead(beast::error_code ec, std::size_t bytes_read);
+
+        void ReadRequest();
+
         void OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read);
 
         void Close();
@@ -68,14 +128,17 @@ namespace http_server {
         beast::tcp_stream stream_;
         beast::flat_buffer buffer_;
         HttpRequest request_;
+        const SessionTimeouts timeouts_;
+        std::shared_ptr<ConnectionLimiter> limiter_;
+        const net::ip::address address_;
     };
 
     template <typename RequestHandler>
     class Session : public SessionBase, public std::enable_shared_from_this<Session<RequestHandler>> {
     public:
         template <typename Handler>
-        Session(tcp::socket&& socket, Handler&& request_handler)
-            : SessionBase(std::move(socket))
+        Session(tcp::socket&& socket, Handler&& request_handler, const SessionTimeouts& timeouts, std::shared_ptr<ConnectionLimiter> limiter, net::ip::address address)
+            : SessionBase(std::move(socket), timeouts, std::move(limiter), std::move(address))
             , request_handler_(std::forward<Handler>(request_handler)) {
         }
 
@@ -103,11 +166,12 @@ namespace http_server {
     class Listener : public std::enable_shared_from_this<Listener<RequestHandler>> {
     public:
         template <typename Handler>
-        Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Handler&& request_handler)
+        Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Handler&& request_handler, ListenerOptions options = {})
             : ioc_(ioc)
             // Обработчики асинхронных операций acceptor_ будут вызываться в своём strand
             , acceptor_(net::make_strand(ioc))
-            , request_handler_(std::forward<Handler>(request_handler)) {
+            , request_handler_(std::forward<Handler>(request_handler))
+            , options_(std::move(options)) {
             // Открываем acceptor, используя протокол (IPv4 или IPv6), указанный в endpoint
             acceptor_.open(endpoint.protocol());
 
@@ -116,6 +180,13 @@ namespace http_server {
             // Однако это может помешать повторно открыть сокет в полузакрытом состоянии.
             // Флаг reuse_address разрешает открыть сокет, когда он "наполовину закрыт"
             acceptor_.set_option(net::socket_base::reuse_address(true));
+            if (options_.reuse_port) {
+#ifdef SO_REUSEPORT
+                acceptor_.set_option(ReusePort(true));
+#else
+                throw std::runtime_error("SO_REUSEPORT is not supported on this platform");
+#endif
+            }
             // Привязываем acceptor к адресу и порту endpoint
             acceptor_.bind(endpoint);
             // Переводим acceptor в состояние, в котором он способен принимать новые соединения
@@ -153,29 +224,43 @@ namespace http_server {
                 return ReportError(ec, "accept"sv);
             }
 
+            sys::error_code endpoint_ec;
+            const tcp::endpoint remote = socket.remote_endpoint(endpoint_ec);
+            if (endpoint_ec) {
+                // Клиент успел закрыть соединение
+                return DoAccept();
+            }
+            if (options_.limiter && !options_.limiter->TryAcquire(remote.address())) {
+                // Сверх лимита соединение сразу закрываем, не читая запрос
+                ReportRejectedConnection();
+                socket.close(endpoint_ec);
+                return DoAccept();
+            }
+
             // Асинхронно обрабатываем сессию
-            AsyncRunSession(std::move(socket));
+            AsyncRunSession(std::move(socket), remote.address());
 
             // Принимаем новое соединение
             DoAccept();
         }
 
-        void AsyncRunSession(tcp::socket&& socket) {
-            std::make_shared<Session<RequestHandler>>(std::move(socket), request_handler_)->Run();
+        void AsyncRunSession(tcp::socket&& socket, net::ip::address address) {
+            std::make_shared<Session<RequestHandler>>(std::move(socket), request_handler_, options_.timeouts, options_.limiter, std::move(address))->Run();
         }
 
         net::io_context& ioc_;
         tcp::acceptor acceptor_;
         RequestHandler request_handler_;
+        const ListenerOptions options_;
     };
 
     template<typename RequestHandler>
-    void ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler) {
+    void ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler, ListenerOptions options = {}) {
         // При помощи decay_t исключим ссылки из типа RequestHandler,
         // чтобы Listener хранил RequestHandler по значению
         using MyListener = Listener<std::decay_t<RequestHandler>>;
 
-        std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler))->Run();
+        std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler), std::move(options))->Run();
     }
 
 }  // namespace http_server
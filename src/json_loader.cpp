@@ -1,5 +1,8 @@
 #include "json_loader.h"
 
+#include <limits>
+#include <string_view>
+
 //#include <boost/json/src.hpp>
 
 namespace json_loader {
@@ -61,8 +64,17 @@ model::Game LoadGame(const std::filesystem::path& json_path) {
     }
     game.SetDogRetirementTime(dog_retirement_time);
 
+    if (value.as_object().count("degradation")) {
+        game.GetDegradation().SetConfig(LoadDegradationConfig(value.as_object().at("degradation")));
+    }
+
+    model::SessionConfig default_sessions;
+    if (value.as_object().count("sessions")) {
+        default_sessions = LoadSessionConfig(value.as_object().at("sessions"), default_sessions);
+    }
+
     for (json::value& map_info : value.as_object().at("maps").as_array()) {
-        AddMap(game, extra_data, map_info, default_dog_speed, default_bag_capacity);
+        AddMap(game, extra_data, map_info, default_dog_speed, default_bag_capacity, default_sessions);
     }
     game.SetExtraData(std::make_shared<ExtraData>(extra_data));
 
@@ -70,7 +82,8 @@ model::Game LoadGame(const std::filesystem::path& json_path) {
 }
 
 
-void AddMap(model::Game& game, ExtraData& extra_data, json::value& map_info, double default_dog_speed, int default_bag_capacity) {
+void AddMap(model::Game& game, ExtraData& extra_data, json::value& map_info, double default_dog_speed, int default_bag_capacity,
+    const model::SessionConfig& default_sessions) {
     util::Tagged<std::string, model::Map> id(map_info.as_object().at("id").as_string().c_str());
     std::string name(map_info.as_object().at("name").as_string());
 
@@ -86,6 +99,13 @@ void AddMap(model::Game& game, ExtraData& extra_data, json::value& map_info, dou
 
     model::Map map(id, name, dog_speed, bag_capacity);
 
+    if (map_info.as_object().count("sessions")) {
+        map.SetSessionConfig(LoadSessionConfig(map_info.as_object().at("sessions"), default_sessions));
+    }
+    else {
+        map.SetSessionConfig(default_sessions);
+    }
+
     if (map_info.as_object().at("roads").as_array().empty()) {
         throw std::invalid_argument("Empty roads array at map");
     }
@@ -105,6 +125,93 @@ void AddMap(model::Game& game, ExtraData& extra_data, json::value& map_info, dou
     game.AddMap(map);
 }
 
+degradation::Config LoadDegradationConfig(const json::value& degradation_info) {
+    const json::object& info = degradation_info.as_object();
+    degradation::Config config;
+
+    auto load_ticks = [&info](std::string_view key, unsigned& ticks) {
+        if (info.count(key)) {
+            const int64_t value = info.at(key).as_int64();
+            if (value <= 0 || value > std::numeric_limits<unsigned>::max()) {
+                throw std::invalid_argument("Degradation " + std::string(key) + " must be a positive number of ticks in JSON");
+            }
+            ticks = static_cast<unsigned>(value);
+        }
+    };
+
+    if (info.count("overrunRatio")) {
+        config.overrun_ratio = info.at("overrunRatio").as_double();
+    }
+    if (info.count("recoverRatio")) {
+        config.recover_ratio = info.at("recoverRatio").as_double();
+    }
+    if (config.overrun_ratio <= 0 || config.recover_ratio <= 0) {
+        throw std::invalid_argument("Degradation ratios must be positive in JSON");
+    }
+    // Иначе один и тот же тик считался бы и перегруженным, и здоровым
+    if (config.recover_ratio >= config.overrun_ratio) {
+        throw std::invalid_argument("Degradation recoverRatio must be less than overrunRatio in JSON");
+    }
+    load_ticks("escalateAfterTicks", config.escalate_after_ticks);
+    load_ticks("recoverAfterTicks", config.recover_after_ticks);
+    if (info.count("stretchFactor")) {
+        config.stretch_factor = info.at("stretchFactor").as_double();
+        if (config.stretch_factor < 1) {
+            throw std::invalid_argument("Degradation stretchFactor must be at least 1 in JSON");
+        }
+    }
+    if (info.count("stateThrottleMs")) {
+        config.state_throttle = std::chrono::milliseconds{ info.at("stateThrottleMs").as_int64() };
+        if (config.state_throttle.count() < 0) {
+            throw std::invalid_argument("Negative degradation stateThrottleMs in JSON");
+        }
+    }
+    if (info.count("ladder")) {
+        config.ladder.clear();
+        for (const json::value& step : info.at("ladder").as_array()) {
+            std::optional<degradation::Action> action = degradation::ActionFromString(step.as_string());
+            if (!action) {
+                throw std::invalid_argument("Unknown degradation step in JSON");
+            }
+            config.ladder.push_back(*action);
+        }
+    }
+    return config;
+}
+
+model::SessionConfig LoadSessionConfig(const json::value& sessions_info, model::SessionConfig defaults) {
+    const json::object& info = sessions_info.as_object();
+    model::SessionConfig config = defaults;
+
+    if (info.count("capacity")) {
+        const int64_t capacity = info.at("capacity").as_int64();
+        if (capacity <= 0) {
+            throw std::invalid_argument("Session capacity must be positive in JSON");
+        }
+        config.capacity = static_cast<size_t>(capacity);
+    }
+    if (info.count("packing")) {
+        const json::string& packing = info.at("packing").as_string();
+        if (packing == "fillFirst") {
+            config.packing = model::SessionPacking::FILL_FIRST;
+        }
+        else if (packing == "balance") {
+            config.packing = model::SessionPacking::BALANCE;
+        }
+        else {
+            throw std::invalid_argument("Unknown session packing in JSON");
+        }
+    }
+    if (info.count("compactBelow")) {
+        const int64_t compact_below = info.at("compactBelow").as_int64();
+        if (compact_below < 0) {
+            throw std::invalid_argument("Negative session compaction threshold in JSON");
+        }
+        config.compact_below = static_cast<size_t>(compact_below);
+    }
+    return config;
+}
+
 void AddRoad(model::Map& map, const json::value& road_map) {
     if (road_map.as_object().find("x1") != road_map.as_object().end()) {
         model::Point start{ road_map.as_object().at("x0").as_int64(), road_map.as_object().at("y0").as_int64() };
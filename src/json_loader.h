@@ -18,8 +18,12 @@ using namespace std::literals;
 model::Game LoadGame(const std::filesystem::path& json_path);
 
 
-void AddMap(model::Game& game, ExtraData& extra_data, json::value& map_info, double default_dog_speed, int default_bag_capacity);
+void AddMap(model::Game& game, ExtraData& extra_data, json::value& map_info, double default_dog_speed, int default_bag_capacity,
+    const model::SessionConfig& default_sessions);
 void AddRoad(model::Map& map, const json::value& road_map);
 void AddBuild(model::Map& map, const json::value& build_map);
 void AddOffice(model::Map& map, const json::value& office_map);
+degradation::Config LoadDegradationConfig(const json::value& degradation_info);
+// Поля объекта "sessions" заменяют соответствующие поля defaults
+model::SessionConfig LoadSessionConfig(const json::value& sessions_info, model::SessionConfig defaults);
 }  // namespace json_loader
@@ -0,0 +1,84 @@
+#include "load_shedding.h"
+
+#include <algorithm>
+
+namespace load_shedding {
+
+using namespace std::literals;
+
+ConnectionLimiter::ConnectionLimiter(size_t max_connections, size_t max_connections_per_ip)
+    : max_connections_(max_connections), max_connections_per_ip_(max_connections_per_ip) {}
+
+bool ConnectionLimiter::TryAcquire(const boost::asio::ip::address& address) {
+    std::lock_guard lock(mutex_);
+    if (max_connections_ > 0 && connections_ >= max_connections_) {
+        return false;
+    }
+    size_t& per_ip = connections_per_ip_[address];
+    if (max_connections_per_ip_ > 0 && per_ip >= max_connections_per_ip_) {
+        return false;
+    }
+    ++per_ip;
+    ++connections_;
+    return true;
+}
+
+void ConnectionLimiter::Release(const boost::asio::ip::address& address) {
+    std::lock_guard lock(mutex_);
+    auto it = connections_per_ip_.find(address);
+    if (it == connections_per_ip_.end()) {
+        return;
+    }
+    if (--it->second == 0) {
+        connections_per_ip_.erase(it);
+    }
+    --connections_;
+}
+
+bool ShouldShed(RequestPriority priority, std::chrono::microseconds queue_delay, std::chrono::milliseconds shed_queue_delay) {
+    if (shed_queue_delay.count() == 0) {
+        return false;
+    }
+    int factor = 1;
+    switch (priority) {
+    case RequestPriority::ACTION:
+        factor = 4;
+        break;
+    case RequestPriority::STATE:
+        factor = 2;
+        break;
+    case RequestPriority::LOBBY:
+        break;
+    }
+    return queue_delay > shed_queue_delay * factor;
+}
+
+std::chrono::steady_clock::time_point QueueDelayMonitor::OnEnqueued() {
+    std::lock_guard lock(mutex_);
+    // Время берётся под блокировкой, чтобы очередь оставалась упорядоченной
+    const auto now = std::chrono::steady_clock::now();
+    pending_.push_back(now);
+    return now;
+}
+
+void QueueDelayMonitor::OnStarted(std::chrono::microseconds delay) {
+    std::lock_guard lock(mutex_);
+    if (!pending_.empty()) {
+        pending_.pop_front();
+    }
+    // Экспоненциальное сглаживание с весом 1/8, как у оценки RTT в TCP
+    smoothed_ += (delay - smoothed_) / 8;
+    updated_at_ = std::chrono::steady_clock::now();
+}
+
+std::chrono::microseconds QueueDelayMonitor::Get() const {
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard lock(mutex_);
+    if (pending_.empty()) {
+        return now - updated_at_ > 1s ? std::chrono::microseconds{} : smoothed_;
+    }
+    const auto head_age = std::chrono::duration_cast<std::chrono::microseconds>(now - pending_.front());
+    return std::max(smoothed_, head_age);
+}
+
+}  // namespace load_shedding
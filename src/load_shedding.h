@@ -0,0 +1,61 @@
+#pragma once
+#include <boost/asio/ip/address.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <mutex>
+
+namespace load_shedding {
+
+// Ограничивает число открытых соединений, всего и с одного адреса. Общий для всех Listener'ов порта
+class ConnectionLimiter {
+public:
+    // 0 означает отсутствие ограничения
+    ConnectionLimiter(size_t max_connections, size_t max_connections_per_ip);
+
+    // Возвращает false, если новое соединение превысит один из лимитов
+    bool TryAcquire(const boost::asio::ip::address& address);
+
+    void Release(const boost::asio::ip::address& address);
+
+private:
+    std::mutex mutex_;
+    const size_t max_connections_;
+    const size_t max_connections_per_ip_;
+    size_t connections_ = 0;
+    std::map<boost::asio::ip::address, size_t> connections_per_ip_;
+};
+
+// При перегрузке запросы сбрасываются начиная с низшего приоритета
+enum class RequestPriority {
+    LOBBY, STATE, ACTION
+};
+
+// Запрос сбрасывается, если задержка очереди превышает порог, умноженный на множитель его приоритета.
+// Нулевой порог отключает сброс
+bool ShouldShed(RequestPriority priority, std::chrono::microseconds queue_delay, std::chrono::milliseconds shed_queue_delay);
+
+// Задержка между постановкой запроса в strand игры и началом его обработки.
+// OnEnqueued вызывается из потоков ввода-вывода, OnStarted - из strand
+class QueueDelayMonitor {
+public:
+    // Возвращает время постановки запроса в очередь
+    std::chrono::steady_clock::time_point OnEnqueued();
+
+    void OnStarted(std::chrono::microseconds delay);
+
+    // Пока в очереди есть запросы, не меньше возраста самого старого из них: если strand встал, оценка растёт.
+    // Без ожидающих запросов сглаженная оценка старше секунды не учитывается, чтобы сервер вышел из режима сброса
+    std::chrono::microseconds Get() const;
+
+private:
+    mutable std::mutex mutex_;
+    // Strand выполняет запросы в порядке постановки, поэтому первый элемент - самый старый ожидающий запрос
+    std::deque<std::chrono::steady_clock::time_point> pending_;
+    std::chrono::microseconds smoothed_{ 0 };
+    std::chrono::steady_clock::time_point updated_at_;
+};
+
+}  // namespace load_shedding
@@ -35,6 +35,15 @@ public:
      */
     unsigned Generate(TimeInterval time_delta, unsigned loot_count, unsigned looter_count);
 
+    // Время, прошедшее без появления трофеев; сохраняется вместе с состоянием игры
+    TimeInterval GetTimeWithoutLoot() const noexcept {
+        return time_without_loot_;
+    }
+
+    void SetTimeWithoutLoot(TimeInterval time_without_loot) noexcept {
+        time_without_loot_ = time_without_loot;
+    }
+
 private:
     static double DefaultGenerator() noexcept {
         return 1.0;
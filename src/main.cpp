@@ -4,10 +4,15 @@
 #include <boost/asio/signal_set.hpp>
 #include <boost/program_options.hpp>
 #include <iostream>
+#include <memory>
 #include <thread>
 #include <vector>
 #include <mutex>
 
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
 #include "ticker.h"
 #include "logger.h"
 #include "json_loader.h"
@@ -15,6 +20,10 @@
 #include "http_server.h"
 #include "model_serialization.h"
 #include "postgresql.h"
+#include "admin_handler.h"
+#include "db_executor.h"
+#include "file_database.h"
+#include "record_spool.h"
 
 using namespace std::literals;
 namespace net = boost::asio;
@@ -26,6 +35,41 @@ using Strand = net::strand<net::io_context::executor_type>;
 constexpr const char DB_URL[] = "GAME_DB_URL";
 
 namespace {
+void LogSlowTick(const tick_profiler::TickProfile& profile, std::chrono::microseconds budget) {
+    json::object slow_tick_data = tick_profiler::TickProfileToJson(profile, false);
+    slow_tick_data.emplace("budgetUs"s, budget.count());
+    BOOST_LOG_TRIVIAL(warning) << boost::log::add_value(logger::additional_data, json::value(std::move(slow_tick_data)))
+        << boost::log::add_value(logger::timestamp, boost::posix_time::microsec_clock::local_time())
+        << "slow tick"sv;
+}
+
+void LogDegradation(const degradation::Controller& degradation, std::chrono::milliseconds tick_period) {
+    json::array actions;
+    for (size_t i = 0; i < degradation.GetLevel(); ++i) {
+        actions.emplace_back(degradation::ActionToString(degradation.GetConfig().ladder.at(i)));
+    }
+    json::value degradation_data{ {"level"s, degradation.GetLevel()}, {"actions"s, actions}, {"tickPeriod"s, tick_period.count()} };
+    BOOST_LOG_TRIVIAL(warning) << boost::log::add_value(logger::additional_data, degradation_data)
+        << boost::log::add_value(logger::timestamp, boost::posix_time::microsec_clock::local_time())
+        << "degradation level changed"sv;
+}
+
+void LogStateError(std::string_view source, std::exception_ptr error) {
+    std::string what = "unknown error"s;
+    try {
+        std::rethrow_exception(error);
+    }
+    catch (const std::exception& ex) {
+        what = ex.what();
+    }
+    catch (...) {
+    }
+    json::value error_data{ {"source"s, source}, {"exception"s, what} };
+    BOOST_LOG_TRIVIAL(error) << boost::log::add_value(logger::additional_data, error_data)
+        << boost::log::add_value(logger::timestamp, boost::posix_time::microsec_clock::local_time())
+        << "state write error"sv;
+}
+
 // Запускает функцию fn на n потоках, включая текущий
 template <typename Fn>
 void RunWorkers(unsigned n, const Fn& fn) {
@@ -39,6 +83,36 @@ void RunWorkers(unsigned n, const Fn& fn) {
     fn();
 }
 
+// Запускает fn(i) для каждого i из [0, n) в отдельном потоке, fn(0) - в текущем
+template <typename Fn>
+void RunIndexedWorkers(unsigned n, const Fn& fn) {
+    n = std::max(1u, n);
+    std::vector<std::jthread> workers;
+    workers.reserve(n - 1);
+    for (unsigned i = 1; i < n; ++i) {
+        workers.emplace_back(fn, i);
+    }
+    fn(0u);
+}
+
+// Привязывает текущий поток к ядру, чтобы данные io_context не мигрировали между кешами
+void PinCurrentThread(unsigned core) {
+#ifdef __linux__
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(core % cores, &cpu_set);
+    if (int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set); error != 0) {
+        json::value pin_data{ {"core"s, core}, {"code"s, error} };
+        BOOST_LOG_TRIVIAL(warning) << boost::log::add_value(logger::additional_data, pin_data)
+            << boost::log::add_value(logger::timestamp, boost::posix_time::microsec_clock::local_time())
+            << "failed to pin thread"sv;
+    }
+#else
+    (void)core;
+#endif
+}
+
 }  // namespace
 
 struct Args {
@@ -47,7 +121,29 @@ struct Args {
     std::string state_file_path;
     unsigned int tick_period = 0;
     unsigned int state_period = 0;
+    bool state_journal = false;
+    unsigned int restore_threads = 1;
+    unsigned int state_compression = 0;
     bool random_spawn = false;
+    unsigned short admin_port = 0;
+    unsigned int slow_tick_budget = 100;
+    bool fixed_step = false;
+    unsigned int max_catch_up_steps = 4;
+    unsigned int io_contexts = 0;
+    bool pin_threads = false;
+    unsigned int max_connections = 0;
+    unsigned int max_connections_per_ip = 0;
+    unsigned int idle_timeout = 30000;
+    unsigned int header_timeout = 10000;
+    unsigned int shed_queue_delay = 0;
+    unsigned int db_threads = 2;
+    unsigned int db_queue_size = 1024;
+    unsigned int db_timeout = 5000;
+    unsigned int db_pool_min = 1;
+    unsigned int db_pool_max = 0;
+    std::string records_file;
+    std::string records_spool;
+    std::string records_partitioning = "none";
 };
 
 [[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
@@ -61,7 +157,29 @@ struct Args {
         ("www-root,w", po::value(&args.static_root)->value_name("dir"s), "set static files root")
         ("randomize-spawn-points", po::value<bool>(&args.random_spawn), "spawn dogs at random position")
         ("state-file", po::value(&args.state_file_path)->value_name("file"s), "set state file path")
-        ("save-state-period", po::value<unsigned int>(&args.state_period)->value_name("milliseconds"s), "set save state period");
+        ("save-state-period", po::value<unsigned int>(&args.state_period)->value_name("milliseconds"s), "set save state period")
+        ("state-journal", po::value<bool>(&args.state_journal), "log player actions to a journal next to the state file and replay it on start")
+        ("restore-threads", po::value<unsigned int>(&args.restore_threads)->value_name("count"s), "restore maps from the state file in parallel")
+        ("state-compression", po::value<unsigned int>(&args.state_compression)->value_name("level"s), "compress state snapshots with zlib at level 1-9, 0 - disabled")
+        ("admin-port", po::value<unsigned short>(&args.admin_port)->value_name("port"s), "serve /metrics on a separate admin port")
+        ("slow-tick-budget", po::value<unsigned int>(&args.slow_tick_budget)->value_name("percent"s), "log ticks longer than this share of tick period")
+        ("fixed-step", po::value<bool>(&args.fixed_step), "advance simulation by fixed tick-period steps")
+        ("max-catch-up-steps", po::value<unsigned int>(&args.max_catch_up_steps)->value_name("steps"s), "extra fixed steps allowed for a late tick")
+        ("io-contexts", po::value<unsigned int>(&args.io_contexts)->value_name("count"s), "run a separate io_context and SO_REUSEPORT acceptor per thread")
+        ("pin-threads", po::value<bool>(&args.pin_threads), "pin io_context threads to cores")
+        ("max-connections", po::value<unsigned int>(&args.max_connections)->value_name("count"s), "limit open connections, 0 - unlimited")
+        ("max-connections-per-ip", po::value<unsigned int>(&args.max_connections_per_ip)->value_name("count"s), "limit open connections from one address, 0 - unlimited")
+        ("idle-timeout", po::value<unsigned int>(&args.idle_timeout)->value_name("milliseconds"s), "close connections idle between requests")
+        ("header-timeout", po::value<unsigned int>(&args.header_timeout)->value_name("milliseconds"s), "time to read a request after its first byte")
+        ("shed-queue-delay", po::value<unsigned int>(&args.shed_queue_delay)->value_name("milliseconds"s), "answer 503 when game strand queue delay exceeds this, 0 - disabled")
+        ("db-threads", po::value<unsigned int>(&args.db_threads)->value_name("count"s), "threads and connections serving database requests")
+        ("db-queue-size", po::value<unsigned int>(&args.db_queue_size)->value_name("count"s), "database requests allowed to wait for a thread")
+        ("db-timeout", po::value<unsigned int>(&args.db_timeout)->value_name("milliseconds"s), "answer 503 when records are not read in this time")
+        ("db-pool-min", po::value<unsigned int>(&args.db_pool_min)->value_name("count"s), "database connections opened at start")
+        ("db-pool-max", po::value<unsigned int>(&args.db_pool_max)->value_name("count"s), "limit open database connections, 0 - one per database thread")
+        ("records-file", po::value(&args.records_file)->value_name("file"s), "keep records in a local file instead of PostgreSQL")
+        ("records-spool", po::value(&args.records_spool)->value_name("file"s), "write retirements to a local spool first and deliver them to the database in background")
+        ("records-partitioning", po::value(&args.records_partitioning)->value_name("none|day|month"s), "create retired_players partitioned by retirement time");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -81,7 +199,29 @@ struct Args {
                                  --www-root <dir-to-content> 
                                  --randomize-spawn-points[bool, optional]
                                  --state-file <dir-to-file>
-                                 --save-state-period[int])");
+                                 --save-state-period[int]
+                                 --state-journal[bool, optional]
+                                 --restore-threads[int, optional]
+                                 --state-compression[int, optional]
+                                 --admin-port[int, optional]
+                                 --slow-tick-budget[int, optional]
+                                 --fixed-step[bool, optional]
+                                 --max-catch-up-steps[int, optional]
+                                 --io-contexts[int, optional]
+                                 --pin-threads[bool, optional]
+                                 --max-connections[int, optional]
+                                 --max-connections-per-ip[int, optional]
+                                 --idle-timeout[int, optional]
+                                 --header-timeout[int, optional]
+                                 --shed-queue-delay[int, optional]
+                                 --db-threads[int, optional]
+                                 --db-queue-size[int, optional]
+                                 --db-timeout[int, optional]
+                                 --db-pool-min[int, optional]
+                                 --db-pool-max[int, optional]
+                                 --records-file <file>[optional]
+                                 --records-spool <file>[optional]
+                                 --records-partitioning <none|day|month>[optional])");
     }
     return std::nullopt;
 }
@@ -111,23 +251,70 @@ int main(int argc, const char* argv[]) {
         model::Game game = json_loader::LoadGame(command_line_args.config_file_path);
         
         // 2. Инициализируем io_context
+        // По умолчанию все потоки обслуживают один io_context. С --io-contexts у каждого потока
+        // свой io_context и свой acceptor, а игровое состояние по-прежнему доступно только из strand в первом из них
         const unsigned num_threads = std::thread::hardware_concurrency();
-        net::io_context ioc(num_threads);
-        
-        const char* db_url = std::getenv(DB_URL);
-        if (!db_url) {
-            throw std::runtime_error("DB URL is not specified");
+        const bool per_thread_contexts = command_line_args.io_contexts > 0;
+        std::vector<std::unique_ptr<net::io_context>> contexts;
+        if (per_thread_contexts) {
+            for (unsigned i = 0; i < command_line_args.io_contexts; ++i) {
+                contexts.push_back(std::make_unique<net::io_context>(1));
+            }
+        }
+        else {
+            contexts.push_back(std::make_unique<net::io_context>(num_threads));
         }
+        net::io_context& ioc = *contexts.front();
+        
+        // Запросы к БД выполняются в отдельных потоках; пул соединений размеряется независимо от них
+        db_executor::Config db_config;
+        db_config.threads = std::max(1u, command_line_args.db_threads);
+        db_config.max_queue = command_line_args.db_queue_size;
+        db_config.timeout = std::chrono::milliseconds(command_line_args.db_timeout);
 
-        std::shared_ptr<postgre::DatabaseImpl> db_ptr(std::make_shared<postgre::DatabaseImpl>(num_threads, db_url));
+        std::shared_ptr<model::Database> db_ptr;
+        if (!command_line_args.records_file.empty()) {
+            // Без PostgreSQL: для тестовых стендов, замеров и небольших установок
+            db_ptr = std::make_shared<file_db::FileDatabase>(command_line_args.records_file);
+        }
+        else {
+            const char* db_url = std::getenv(DB_URL);
+            if (!db_url) {
+                throw std::runtime_error("DB URL is not specified");
+            }
+            postgre::ConnectionPool::Config pool_config;
+            pool_config.max_size = command_line_args.db_pool_max > 0 ? command_line_args.db_pool_max : db_config.threads;
+            pool_config.min_size = std::min<size_t>(command_line_args.db_pool_min, pool_config.max_size);
+            pool_config.acquire_timeout = db_config.timeout;
+            postgre::Partitioning partitioning = postgre::Partitioning::NONE;
+            if (command_line_args.records_partitioning == "day"sv) {
+                partitioning = postgre::Partitioning::DAY;
+            }
+            else if (command_line_args.records_partitioning == "month"sv) {
+                partitioning = postgre::Partitioning::MONTH;
+            }
+            else if (command_line_args.records_partitioning != "none"sv) {
+                throw std::runtime_error("Unknown records partitioning: " + command_line_args.records_partitioning);
+            }
+            db_ptr = std::make_shared<postgre::DatabaseImpl>(pool_config, db_url, partitioning);
+        }
+        auto database_executor = std::make_shared<db_executor::Executor>(db_ptr, db_config);
 
-        game.SetDb(db_ptr);
+        if (!command_line_args.records_spool.empty()) {
+            // Рекорды не теряются, пока БД недоступна, а тик не ждёт ни БД, ни очередь запросов к ней
+            game.SetDb(std::make_shared<record_spool::SpoolingDatabase>(command_line_args.records_spool, db_ptr));
+        }
+        else {
+            game.SetDb(std::make_shared<db_executor::AsyncDatabase>(db_ptr, database_executor));
+        }
 
         // 3. Добавляем асинхронный обработчик сигналов SIGINT и SIGTERM
         net::signal_set signals(ioc, SIGINT, SIGTERM);
-        signals.async_wait([&ioc](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
+        signals.async_wait([&contexts](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
             if (!ec) {
-                ioc.stop();
+                for (const std::unique_ptr<net::io_context>& context : contexts) {
+                    context->stop();
+                }
             }
             });
 
@@ -135,11 +322,28 @@ int main(int argc, const char* argv[]) {
         
         Strand strand = net::make_strand(ioc);
         
+        std::shared_ptr<Ticker> ticker;
         if (command_line_args.tick_period > 0) {
             game.SetInternalTicker();
-            auto ticker = std::make_shared<Ticker>(strand, std::chrono::milliseconds(command_line_args.tick_period), [&game](std::chrono::milliseconds delta) {
-                game.GameTick(delta.count()); }
-            );
+            const std::chrono::milliseconds base_period{ command_line_args.tick_period };
+            const std::chrono::microseconds slow_tick_budget = base_period * command_line_args.slow_tick_budget / 100;
+            ticker = std::make_shared<Ticker>(strand, base_period, [&game, &ticker, base_period, slow_tick_budget](std::chrono::milliseconds delta) {
+                game.GameTick(delta.count());
+                const tick_profiler::TickProfile& profile = game.GetTickProfiler().GetLast();
+                // Замер прерванного исключением тика неполон, медленным такой тик не считается
+                if (profile.completed && profile.total > slow_tick_budget) {
+                    LogSlowTick(profile, slow_tick_budget);
+                }
+                // При устойчивой перегрузке включаем следующую ступень деградации, при восстановлении - отключаем
+                if (degradation::Controller& degradation = game.GetDegradation(); degradation.OnTickFinished(profile.total, base_period)) {
+                    const std::chrono::milliseconds tick_period = degradation.GetTickPeriod(base_period);
+                    ticker->SetPeriod(tick_period);
+                    LogDegradation(degradation, tick_period);
+                }
+            });
+            if (command_line_args.fixed_step) {
+                ticker->SetFixedStep(command_line_args.max_catch_up_steps);
+            }
             ticker->Start();
         }
         
@@ -148,25 +352,45 @@ int main(int argc, const char* argv[]) {
         }
 
 
-        serialization::SerializingListener listener(std::chrono::milliseconds(command_line_args.state_period), game, command_line_args.state_file_path);
+        serialization::SerializingListener listener(std::chrono::milliseconds(command_line_args.state_period), game, command_line_args.state_file_path,
+            command_line_args.state_journal && !command_line_args.state_file_path.empty(), static_cast<int>(std::min(command_line_args.state_compression, 9u)));
+        listener.SetErrorHandler(LogStateError);
 
         if (!command_line_args.state_file_path.empty()) {
             game.SetApplicationListener(&listener);
-            listener.RestoreGame(game);
+            listener.RestoreGame(game, command_line_args.restore_threads);
         }
 
         // 4. Создаём обработчик HTTP-запросов и связываем его с моделью игры
         auto handler = std::make_shared<http_handler::RequestHandler>(
-            game, command_line_args.static_root, strand);
+            game, command_line_args.static_root, strand, std::chrono::milliseconds(command_line_args.shed_queue_delay), database_executor);
 
         http_handler::LoggingRequestHandler logging_handler{ handler };
 
         // 5. Запустить обработчик HTTP-запросов, делегируя их обработчику запросов
         const auto address = net::ip::make_address("0.0.0.0");
         constexpr net::ip::port_type port = 8080;
-        http_server::ServeHttp(ioc, { address, port }, [&logging_handler](auto&& req, auto&& send, boost::posix_time::ptime time, std::string ip) {
-            logging_handler(std::forward<decltype(req)>(req), std::forward<decltype(send)>(send), time, ip);
-        });
+        http_server::ListenerOptions listener_options;
+        listener_options.reuse_port = per_thread_contexts;
+        listener_options.timeouts.idle = std::chrono::milliseconds(command_line_args.idle_timeout);
+        listener_options.timeouts.header = std::chrono::milliseconds(command_line_args.header_timeout);
+        if (command_line_args.max_connections > 0 || command_line_args.max_connections_per_ip > 0) {
+            // Один ограничитель на все acceptor'ы порта
+            listener_options.limiter = std::make_shared<http_server::ConnectionLimiter>(command_line_args.max_connections, command_line_args.max_connections_per_ip);
+        }
+        for (const std::unique_ptr<net::io_context>& context : contexts) {
+            http_server::ServeHttp(*context, { address, port }, [&logging_handler](auto&& req, auto&& send, boost::posix_time::ptime time, std::string ip) {
+                logging_handler(std::forward<decltype(req)>(req), std::forward<decltype(send)>(send), time, ip);
+            }, listener_options);
+        }
+
+        // Метрики отдаются на отдельном порту, чтобы сбор не конкурировал с игровым трафиком
+        if (command_line_args.admin_port > 0) {
+            auto admin_handler = std::make_shared<http_handler::AdminRequestHandler>(game, strand);
+            http_server::ServeHttp(ioc, { address, command_line_args.admin_port }, [admin_handler](auto&& req, auto&& send, boost::posix_time::ptime, std::string) {
+                (*admin_handler)(std::forward<decltype(req)>(req), std::forward<decltype(send)>(send));
+            });
+        }
         
         // Эта надпись сообщает //тестам// о том, что сервер запущен и готов обрабатывать запросы
         json::value server_start{ {"port"s, port}, {"address"s, address.to_string()}};
@@ -175,13 +399,25 @@ int main(int argc, const char* argv[]) {
             << "server started"sv;
 
         // 6. Запускаем обработку асинхронных операций
-        RunWorkers(std::max(1u, num_threads), [&ioc] {
-            ioc.run();
-        });
+        if (per_thread_contexts) {
+            RunIndexedWorkers(static_cast<unsigned>(contexts.size()), [&contexts, pin = command_line_args.pin_threads](unsigned index) {
+                if (pin) {
+                    PinCurrentThread(index);
+                }
+                contexts[index]->run();
+            });
+        }
+        else {
+            RunWorkers(std::max(1u, num_threads), [&ioc] {
+                ioc.run();
+            });
+        }
 
         if (!command_line_args.state_file_path.empty()) {
             listener.SaveStateGame();
         }
+        // Дописываем принятые рекорды, пока io_context ещё существуют
+        database_executor->Stop();
 
     } catch (const std::exception& ex) {
         json::value error_data{ {"code"s, "EXIT_FAILURE"s}, {"exception", ex.what()}};
@@ -0,0 +1,204 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace metrics {
+using namespace std::literals;
+
+namespace {
+
+constexpr size_t HISTOGRAM_SLOTS = LATENCY_BUCKETS_US.size() + 2;
+
+}  // namespace
+
+class Registry::ShardHolder {
+public:
+    ShardHolder()
+        : shard_(std::make_unique<Shard>()) {
+        Registry::Instance().AttachShard(shard_.get());
+    }
+
+    ~ShardHolder() {
+        Registry::Instance().DetachShard(shard_.get());
+    }
+
+    Shard& Get() noexcept {
+        return *shard_;
+    }
+
+private:
+    std::unique_ptr<Shard> shard_;
+};
+
+void Counter::Add(std::int64_t value) const noexcept {
+    Registry::LocalShard().slots[slot_].fetch_add(value, std::memory_order_relaxed);
+}
+
+void Gauge::Add(std::int64_t value) const noexcept {
+    Registry::LocalShard().slots[slot_].fetch_add(value, std::memory_order_relaxed);
+}
+
+void Gauge::Sub(std::int64_t value) const noexcept {
+    Registry::LocalShard().slots[slot_].fetch_sub(value, std::memory_order_relaxed);
+}
+
+void Histogram::Observe(std::chrono::microseconds duration) const noexcept {
+    Registry::Shard& shard = Registry::LocalShard();
+    const std::int64_t us = duration.count();
+    const size_t bucket = std::lower_bound(LATENCY_BUCKETS_US.begin(), LATENCY_BUCKETS_US.end(), us) - LATENCY_BUCKETS_US.begin();
+    shard.slots[slot_ + bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.slots[slot_ + LATENCY_BUCKETS_US.size() + 1].fetch_add(us, std::memory_order_relaxed);
+}
+
+Registry& Registry::Instance() {
+    static Registry registry;
+    return registry;
+}
+
+Registry::Shard& Registry::LocalShard() {
+    thread_local ShardHolder holder;
+    return holder.Get();
+}
+
+Counter Registry::AddCounter(std::string name, std::string help, std::string labels) {
+    return Counter{ Allocate(std::move(name), std::move(help), std::move(labels), Type::COUNTER, 1) };
+}
+
+Gauge Registry::AddGauge(std::string name, std::string help, std::string labels) {
+    return Gauge{ Allocate(std::move(name), std::move(help), std::move(labels), Type::GAUGE, 1) };
+}
+
+Histogram Registry::AddHistogram(std::string name, std::string help, std::string labels) {
+    return Histogram{ Allocate(std::move(name), std::move(help), std::move(labels), Type::HISTOGRAM, HISTOGRAM_SLOTS) };
+}
+
+size_t Registry::Allocate(std::string name, std::string help, std::string labels, Type type, size_t slots_count) {
+    std::lock_guard lock{ mutex_ };
+    // Повторная регистрация той же метрики возвращает те же ячейки
+    for (const Descriptor& desc : descriptors_) {
+        if (desc.name == name && desc.labels == labels) {
+            if (desc.type != type) {
+                throw std::invalid_argument("Metric "s + name + " registered with another type"s);
+            }
+            return desc.slot;
+        }
+    }
+    if (next_slot_ + slots_count > MAX_SLOTS) {
+        throw std::length_error("Too many metrics registered");
+    }
+    const size_t slot = next_slot_;
+    next_slot_ += slots_count;
+    descriptors_.push_back({ std::move(name), std::move(help), std::move(labels), type, slot });
+    return slot;
+}
+
+void Registry::AttachShard(Shard* shard) {
+    std::lock_guard lock{ mutex_ };
+    shards_.push_back(shard);
+}
+
+void Registry::DetachShard(Shard* shard) {
+    std::lock_guard lock{ mutex_ };
+    for (size_t i = 0; i < MAX_SLOTS; ++i) {
+        retired_->slots[i].fetch_add(shard->slots[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    shards_.erase(std::remove(shards_.begin(), shards_.end(), shard), shards_.end());
+}
+
+std::int64_t Registry::Collect(size_t slot) const {
+    std::lock_guard lock{ mutex_ };
+    return Sum(slot);
+}
+
+std::int64_t Registry::Sum(size_t slot) const {
+    std::int64_t result = retired_->slots[slot].load(std::memory_order_relaxed);
+    for (const Shard* shard : shards_) {
+        result += shard->slots[slot].load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+std::string Registry::Serialize() const {
+    std::lock_guard lock{ mutex_ };
+
+    const auto with_labels = [](const std::string& labels, const std::string& extra) {
+        if (labels.empty() && extra.empty()) {
+            return std::string{};
+        }
+        if (labels.empty() || extra.empty()) {
+            return "{"s + labels + extra + "}"s;
+        }
+        return "{"s + labels + ","s + extra + "}"s;
+    };
+
+    std::ostringstream out;
+    std::unordered_set<std::string> described;
+
+    // Метрики одного семейства выводятся вместе, в порядке первой регистрации
+    for (size_t i = 0; i < descriptors_.size(); ++i) {
+        const std::string& name = descriptors_[i].name;
+        if (described.contains(name)) {
+            continue;
+        }
+        described.insert(name);
+
+        out << "# HELP " << name << ' ' << descriptors_[i].help << '\n';
+        switch (descriptors_[i].type) {
+        case Type::COUNTER:
+            out << "# TYPE " << name << " counter\n";
+            break;
+        case Type::GAUGE:
+            out << "# TYPE " << name << " gauge\n";
+            break;
+        case Type::HISTOGRAM:
+            out << "# TYPE " << name << " histogram\n";
+            break;
+        }
+
+        for (size_t j = i; j < descriptors_.size(); ++j) {
+            const Descriptor& desc = descriptors_[j];
+            if (desc.name != name) {
+                continue;
+            }
+            if (desc.type != Type::HISTOGRAM) {
+                out << name << with_labels(desc.labels, {}) << ' ' << Sum(desc.slot) << '\n';
+                continue;
+            }
+            std::int64_t cumulative = 0;
+            for (size_t b = 0; b < LATENCY_BUCKETS_US.size(); ++b) {
+                cumulative += Sum(desc.slot + b);
+                out << name << "_bucket" << with_labels(desc.labels, Label("le", std::to_string(LATENCY_BUCKETS_US[b])))
+                    << ' ' << cumulative << '\n';
+            }
+            cumulative += Sum(desc.slot + LATENCY_BUCKETS_US.size());
+            out << name << "_bucket" << with_labels(desc.labels, Label("le", "+Inf")) << ' ' << cumulative << '\n';
+            out << name << "_sum" << with_labels(desc.labels, {}) << ' ' << Sum(desc.slot + LATENCY_BUCKETS_US.size() + 1) << '\n';
+            out << name << "_count" << with_labels(desc.labels, {}) << ' ' << cumulative << '\n';
+        }
+    }
+    return out.str();
+}
+
+std::string Label(std::string_view key, std::string_view value) {
+    std::string result(key);
+    result += "=\"";
+    for (char ch : value) {
+        if (ch == '\\' || ch == '"') {
+            result += '\\';
+            result += ch;
+        }
+        else if (ch == '\n') {
+            result += "\\n";
+        }
+        else {
+            result += ch;
+        }
+    }
+    result += '"';
+    return result;
+}
+
+}  // namespace metrics
@@ -0,0 +1,155 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace metrics {
+
+/*
+ * Метрики в формате Prometheus.
+ * Каждый поток пишет в свой собственный набор ячеек (шард), поэтому горячий путь
+ * сводится к одному relaxed fetch_add без общих блокировок.
+ * Значения шардов суммируются только при сборе метрик (Registry::Serialize).
+ */
+
+// Границы корзин гистограмм задержек, в микросекундах
+inline constexpr std::array<std::int64_t, 16> LATENCY_BUCKETS_US{
+    50, 100, 250, 500, 1'000, 2'500, 5'000, 10'000, 25'000, 50'000,
+    100'000, 250'000, 500'000, 1'000'000, 2'500'000, 5'000'000 };
+
+class Registry;
+
+class Counter {
+public:
+    Counter() = default;
+
+    void Add(std::int64_t value = 1) const noexcept;
+
+private:
+    friend class Registry;
+    explicit Counter(size_t slot) noexcept : slot_(slot) {}
+
+    size_t slot_ = 0;
+};
+
+// Значение, которое может расти и уменьшаться (число соединений, длина очереди и т.п.)
+class Gauge {
+public:
+    Gauge() = default;
+
+    void Add(std::int64_t value = 1) const noexcept;
+
+    void Sub(std::int64_t value = 1) const noexcept;
+
+private:
+    friend class Registry;
+    explicit Gauge(size_t slot) noexcept : slot_(slot) {}
+
+    size_t slot_ = 0;
+};
+
+class Histogram {
+public:
+    Histogram() = default;
+
+    void Observe(std::chrono::microseconds duration) const noexcept;
+
+private:
+    friend class Registry;
+    explicit Histogram(size_t slot) noexcept : slot_(slot) {}
+
+    // slot_ .. slot_ + LATENCY_BUCKETS_US.size() - корзины (последняя +Inf), далее сумма
+    size_t slot_ = 0;
+};
+
+// Замеряет время жизни объекта и записывает его в гистограмму
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const Histogram& histogram) noexcept
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer() {
+        histogram_.Observe(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_));
+    }
+
+private:
+    const Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+class Registry {
+public:
+    static constexpr size_t MAX_SLOTS = 4096;
+
+    struct Shard {
+        std::array<std::atomic<std::int64_t>, MAX_SLOTS> slots{};
+    };
+
+    static Registry& Instance();
+
+    Registry(const Registry&) = delete;
+    Registry& operator=(const Registry&) = delete;
+
+    // labels задаются уже отформатированными: route="join",map="map1"
+    Counter AddCounter(std::string name, std::string help, std::string labels = {});
+
+    Gauge AddGauge(std::string name, std::string help, std::string labels = {});
+
+    Histogram AddHistogram(std::string name, std::string help, std::string labels = {});
+
+    // Текстовый формат экспозиции Prometheus (text/plain; version=0.0.4)
+    std::string Serialize() const;
+
+    // Сумма значения ячейки по всем потокам, в том числе уже завершившимся
+    std::int64_t Collect(size_t slot) const;
+
+    static Shard& LocalShard();
+
+private:
+    Registry() = default;
+
+    enum class Type {
+        COUNTER, GAUGE, HISTOGRAM
+    };
+
+    struct Descriptor {
+        std::string name;
+        std::string help;
+        std::string labels;
+        Type type;
+        size_t slot;
+    };
+
+    class ShardHolder;
+
+    size_t Allocate(std::string name, std::string help, std::string labels, Type type, size_t slots_count);
+
+    void AttachShard(Shard* shard);
+
+    void DetachShard(Shard* shard);
+
+    // Вызывается под mutex_
+    std::int64_t Sum(size_t slot) const;
+
+    mutable std::mutex mutex_;
+    std::vector<Descriptor> descriptors_;
+    std::vector<Shard*> shards_;
+    // Значения потоков, которые уже завершились, чтобы счётчики не убывали
+    std::unique_ptr<Shard> retired_ = std::make_unique<Shard>();
+    // Ячейка 0 зарезервирована за неинициализированными (default) метриками
+    size_t next_slot_ = 1;
+};
+
+// Форматирует значение метки с экранированием по правилам Prometheus
+std::string Label(std::string_view key, std::string_view value);
+
+}  // namespace metrics
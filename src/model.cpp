@@ -1,17 +1,155 @@
 #include "model.h"
 
+#include <array>
+#include <bit>
+#include <chrono>
 #include <stdexcept>
 
 namespace model {
 using namespace std::literals;
 
+namespace {
+
+// Значение шестнадцатеричной цифры; для прочих символов - 0x10
+constexpr std::array<std::uint8_t, 256> HEX_DIGITS = [] {
+    std::array<std::uint8_t, 256> digits{};
+    digits.fill(0x10);
+    for (int i = 0; i < 10; ++i) {
+        digits['0' + i] = static_cast<std::uint8_t>(i);
+    }
+    for (int i = 0; i < 6; ++i) {
+        digits['a' + i] = static_cast<std::uint8_t>(10 + i);
+    }
+    return digits;
+}();
+
+constexpr char HEX_CHARS[] = "0123456789abcdef";
+
+// Разбирает 16 цифр; в invalid накапливается бит 0x10 любой нецифры
+std::uint64_t DecodeHex64(const char* text, std::uint8_t& invalid) noexcept {
+    std::uint64_t value = 0;
+    for (size_t i = 0; i < 16; ++i) {
+        const std::uint8_t digit = HEX_DIGITS[static_cast<unsigned char>(text[i])];
+        invalid |= digit;
+        value = (value << 4) | (digit & 0xF);
+    }
+    return value;
+}
+
+void EncodeHex64(std::uint64_t value, char* out) noexcept {
+    for (size_t i = 0; i < 16; ++i) {
+        out[i] = HEX_CHARS[(value >> (60 - 4 * i)) & 0xF];
+    }
+}
+
+}  // namespace
+
+std::optional<Token> Token::FromString(std::string_view text) noexcept {
+    if (text.size() != TEXT_SIZE) {
+        return std::nullopt;
+    }
+    std::uint8_t invalid = 0;
+    const std::uint64_t high = DecodeHex64(text.data(), invalid);
+    const std::uint64_t low = DecodeHex64(text.data() + 16, invalid);
+    if (invalid & 0x10) {
+        return std::nullopt;
+    }
+    return Token{ high, low };
+}
+
+std::string Token::ToString() const {
+    std::string text(TEXT_SIZE, '0');
+    EncodeHex64(high_, text.data());
+    EncodeHex64(low_, text.data() + 16);
+    return text;
+}
+
 Token PlayerTokens::GenerateToken() {
-    std::stringstream ss;
-    ss << std::setw(16) << std::setfill('0') << std::hex << generator1_();
-    ss << std::setw(16) << std::setfill('0') << std::hex << generator2_();
-    std::string token = ss.str();
-    assert(token.length() == 32);
-    return Token(token);
+    const std::uint64_t high = generator1_();
+    return Token{ high, generator2_() };
+}
+
+Player* TokenIndex::Find(const Token& token) const noexcept {
+    if (slots_.empty()) {
+        return nullptr;
+    }
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = GetHome(token); slots_[i].player; i = (i + 1) & mask) {
+        if (slots_[i].token == token) {
+            return slots_[i].player;
+        }
+    }
+    return nullptr;
+}
+
+void TokenIndex::Insert(const Token& token, Player* player) {
+    if ((size_ + 1) * 2 > slots_.size()) {
+        Rehash(std::max<size_t>(16, slots_.size() * 2));
+    }
+    const size_t mask = slots_.size() - 1;
+    size_t i = GetHome(token);
+    for (; slots_[i].player; i = (i + 1) & mask) {
+        if (slots_[i].token == token) {
+            slots_[i].player = player;
+            return;
+        }
+    }
+    slots_[i] = Slot{ token, player };
+    ++size_;
+}
+
+void TokenIndex::Erase(const Token& token) noexcept {
+    if (slots_.empty()) {
+        return;
+    }
+    const size_t mask = slots_.size() - 1;
+    size_t hole = GetHome(token);
+    while (slots_[hole].player && slots_[hole].token != token) {
+        hole = (hole + 1) & mask;
+    }
+    if (!slots_[hole].player) {
+        return;
+    }
+    // Сдвигаем назад следующие элементы цепочки, чтобы поиск не останавливался на дыре
+    for (size_t i = (hole + 1) & mask; slots_[i].player; i = (i + 1) & mask) {
+        const size_t home = GetHome(slots_[i].token);
+        // Элемент можно перенести в дыру, если его домашний слот не лежит между дырой и им самим
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            slots_[hole] = slots_[i];
+            hole = i;
+        }
+    }
+    slots_[hole] = Slot{};
+    --size_;
+}
+
+void TokenIndex::Reserve(size_t count) {
+    size_t capacity = 16;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    if (capacity > slots_.size()) {
+        Rehash(capacity);
+    }
+}
+
+size_t TokenIndex::GetSize() const noexcept {
+    return size_;
+}
+
+size_t TokenIndex::GetHome(const Token& token) const noexcept {
+    const std::uint64_t mixed = (token.GetHigh() ^ (token.GetLow() * 0x9E3779B97F4A7C15ull)) * 0xBF58476D1CE4E5B9ull;
+    return static_cast<size_t>(mixed >> 32) & (slots_.size() - 1);
+}
+
+void TokenIndex::Rehash(size_t capacity) {
+    std::vector<Slot> old_slots = std::exchange(slots_, std::vector<Slot>(capacity));
+    size_ = 0;
+    for (const Slot& slot : old_slots) {
+        if (slot.player) {
+            Insert(slot.token, slot.player);
+        }
+    }
 }
 
 bool PosIsAvailable(const std::set<std::shared_ptr<Road>>& roads, Position pos) {
@@ -29,9 +167,13 @@ Position GetStartPos(const GameSession* session) {
 }
 
 Position GetRandomPos(const GameSession* session) {
-    const model::Map::Roads& roads = session->GetMapRoads();
     std::random_device rd;
-    std::mt19937 gen(rd());
+    std::mt19937_64 gen(rd());
+    return GetRandomPos(session, gen);
+}
+
+Position GetRandomPos(const GameSession* session, std::mt19937_64& gen) {
+    const model::Map::Roads& roads = session->GetMapRoads();
     std::uniform_int_distribution<int> dist_roads_size(0, roads.size() - 1);
     int road_index = dist_roads_size(gen);
     Road road = roads[road_index];
@@ -74,6 +216,14 @@ const Map::Id& Map::GetId() const noexcept {
     return id_;
 }
 
+size_t Map::GetIndex() const noexcept {
+    return index_;
+}
+
+void Map::SetIndex(size_t index) noexcept {
+    index_ = index;
+}
+
 const std::string& Map::GetName() const noexcept {
     return name_;
 }
@@ -134,6 +284,14 @@ int Map::GetCapacity() const noexcept {
     return bag_capacity_;
 }
 
+void Map::SetSessionConfig(SessionConfig config) noexcept {
+    session_config_ = config;
+}
+
+const SessionConfig& Map::GetSessionConfig() const noexcept {
+    return session_config_;
+}
+
 std::optional<std::set<std::shared_ptr<Road>>> Map::GetRoadsOnPoint(const Point& point) const {
     if (auto it = coord_to_road.find(point); it != coord_to_road.end()) {
         return it->second;
@@ -143,13 +301,22 @@ std::optional<std::set<std::shared_ptr<Road>>> Map::GetRoadsOnPoint(const Point&
 
 void Game::AddMap(Map map) {
     const size_t index = maps_.size();
+    map.SetIndex(index);
     if (auto [it, inserted] = map_id_to_index_.emplace(map.GetId(), index); !inserted) {
         throw std::invalid_argument("Map with id "s + *map.GetId() + " already exists"s);
     } else {
         try {
+            map_slots_.emplace_back(map.GetSessionConfig().capacity);
+            map_sessions_.emplace_back();
             maps_.emplace_back(std::move(map));
         } catch (...) {
             map_id_to_index_.erase(it);
+            if (map_slots_.size() > index) {
+                map_slots_.pop_back();
+            }
+            if (map_sessions_.size() > index) {
+                map_sessions_.pop_back();
+            }
             throw;
         }
     }
@@ -167,98 +334,261 @@ const Map* Game::FindMap(const Map::Id& id) const noexcept {
 }
 
 std::pair<Token, Player&> Game::AddPlayer(std::string dog_name, GameSession* session) {
-    return players_.Add(std::move(dog_name), session, random_spawn_);
+    std::pair<Token, Player&> result = players_.Add(std::move(dog_name), session, random_spawn_);
+    if (listener_) {
+        listener_->OnJoin(result.first, result.second);
+    }
+    return result;
+}
+
+bool Game::MovePlayer(const Token& token, Player& player, std::string_view move) {
+    if (move.empty()) {
+        player.SetStopDir();
+    }
+    else if (move == "L"sv) {
+        player.SetLeftDir();
+    }
+    else if (move == "R"sv) {
+        player.SetRightDir();
+    }
+    else if (move == "U"sv) {
+        player.SetUpDir();
+    }
+    else if (move == "D"sv) {
+        player.SetDownDir();
+    }
+    else {
+        return false;
+    }
+    if (listener_) {
+        listener_->OnMove(token, move);
+    }
+    return true;
+}
+
+void Game::RetirePlayer(const Token& token) {
+    if (Player* player = players_.FindPlayerByToken(token); player) {
+        player->ReleaseLoot();
+        player->GetSessionPtr()->RemoveDog(player->GetId());
+        players_.RemovePlayer(*player);
+    }
 }
 
 Player* Game::FindPlayerByToken(Token token) const {
     return players_.FindPlayerByToken(token);
 }
 
-std::deque<Player>& Game::GetPlayers() {
+Players::PlayerList& Game::GetPlayers() {
     return players_.GetPlayers();
 }
 
+size_t Game::GetMapIndex(const Map::Id& id) const {
+    if (auto it = map_id_to_index_.find(id); it != map_id_to_index_.end()) {
+        return it->second;
+    }
+    throw std::invalid_argument("Unknown map id");
+}
+
 GameSession& Game::GetSession(const Map::Id& id) {
-    if (auto it = map_id_to_sessions_.find(id); it != map_id_to_sessions_.end()) {
-        if (it->second.empty()) {
-            return map_id_to_sessions_[id].emplace_back(FindMap(id));
-        }
-        auto session_it = std::find_if(it->second.begin(), it->second.end(),
-            [](const GameSession& session) {
-                return session.GetNumberOfDogs() < MAX_COUNT_PLAYERS_ON_SESSION;
-            });
+    return GetSession(GetMapIndex(id));
+}
+
+GameSession& Game::GetSession(size_t map_index) {
+    if (std::optional<size_t> index = map_slots_[map_index].FindFree(maps_[map_index].GetSessionConfig().packing)) {
+        return map_sessions_[map_index][*index];
+    }
+    return AddSession(map_index);
+}
 
-        if (session_it != it->second.end()) {
-            return *session_it;
+GameSession& Game::AddSession(const Map::Id& id) {
+    return AddSession(GetMapIndex(id));
+}
+
+GameSession& Game::AddSession(size_t map_index) {
+    std::deque<GameSession>& sessions = map_sessions_[map_index];
+    SessionSlots& slots = map_slots_[map_index];
+    slots.Add(sessions.size());
+    return sessions.emplace_back(&maps_[map_index], &slots, sessions.size());
+}
+
+void Game::CompactSessions() {
+    for (size_t map_index = 0; map_index < maps_.size(); ++map_index) {
+        const size_t compact_below = maps_[map_index].GetSessionConfig().compact_below;
+        std::deque<GameSession>& sessions = map_sessions_[map_index];
+        SessionSlots& slots = map_slots_[map_index];
+        for (size_t count = 1; count < compact_below && count < slots.GetCapacity(); ++count) {
+            // Копия: переселение меняет корзины
+            const std::vector<size_t> candidates = slots.GetSessions(count);
+            for (size_t index : candidates) {
+                // Сессия могла принять игроков из другой, уже обработанной
+                if (sessions[index].GetNumberOfDogs() != count) {
+                    continue;
+                }
+                if (std::optional<size_t> target = slots.FindTarget(count, index)) {
+                    MoveSessionPlayers(sessions[index], sessions[*target]);
+                }
+            }
         }
     }
-    return map_id_to_sessions_[id].emplace_back(FindMap(id));
+}
+
+void Game::MoveSessionPlayers(GameSession& from, GameSession& to) {
+    std::vector<Player*> players;
+    players.reserve(from.GetNumberOfDogs());
+    for (size_t i = 0; i < from.GetNumberOfDogs(); ++i) {
+        players.push_back(from.GetDogPlayer(i));
+    }
+    for (Player* player : players) {
+        player->MoveToSession(to);
+    }
+    from.MoveLootTo(to);
 }
 
 void Game::GameTick(int64_t time_delta) {
+    Tick(time_delta, MakeTickInputs(seed_source_()));
+}
+
+TickInputs Game::MakeTickInputs(uint64_t seed) const {
+    return TickInputs{ seed, !degradation_.IsActive(degradation::Action::SKIP_LOOT_GENERATION), GetTimeWithoutLoot() };
+}
+
+void Game::ReplayTick(int64_t time_delta, const TickInputs& inputs) {
+    replaying_ = true;
+    Tick(time_delta, inputs);
+    replaying_ = false;
+}
+
+const TickInputs& Game::GetTickInputs() const noexcept {
+    return tick_inputs_;
+}
+
+std::chrono::milliseconds Game::GetTimeWithoutLoot() const noexcept {
+    return loot_generator_ ? loot_generator_->GetTimeWithoutLoot() : std::chrono::milliseconds{ 0 };
+}
+
+void Game::SetTimeWithoutLoot(std::chrono::milliseconds time_without_loot) {
+    if (loot_generator_) {
+        loot_generator_->SetTimeWithoutLoot(time_without_loot);
+    }
+}
+
+void Game::Tick(int64_t time_delta, const TickInputs& inputs) {
+    using tick_profiler::Phase;
+    using tick_profiler::PhaseTimer;
+
+    metrics::ScopedTimer tick_timer(tick_duration_);
+    tick_profiler::TickScope tick_scope(tick_profiler_, time_delta);
+    // Вся случайность тика берётся из генератора с записанным зерном, чтобы тик можно было воспроизвести из журнала
+    tick_inputs_ = inputs;
+    random_generator_.seed(inputs.seed);
+    SetTimeWithoutLoot(inputs.time_without_loot);
+
+    {
+        PhaseTimer timer(tick_profiler_, Phase::INACTIVE_PLAYERS);
+        CheckInactivePlayers(time_delta);
+    }
+
+    {
+        PhaseTimer timer(tick_profiler_, Phase::COMPACT_SESSIONS);
+        CompactSessions();
+    }
 
-    CheckInactivePlayers(time_delta);
+    for (std::deque<GameSession>& session_container : map_sessions_) {
+        for (size_t session_index = 0; session_index < session_container.size(); ++session_index) {
+            GameSession& session = session_container[session_index];
+            tick_profiler_.BeginSession(*session.GetMapPtr()->GetId(), session_index, session.GetNumberOfDogs());
 
-    for (auto& [map_id, session_container] : map_id_to_sessions_) {
-        for (GameSession& session : session_container) {
             //collisions
             collision_detector::ItemGatherer item_gatherer;
             
-            for (std::shared_ptr<Dog> dog_ptr : session.GetDogs()) {
-                Player* player_ptr = players_.FindByDogIdAndMapId(dog_ptr->GetId(), session.GetMapId());
-
-                collision_detector::Gatherer gatherer;
-                gatherer.start_pos = { player_ptr->GetPetPosition().x, player_ptr->GetPetPosition().y };
-                player_ptr->MakeMove(time_delta);
-                gatherer.end_pos = { player_ptr->GetPetPosition().x, player_ptr->GetPetPosition().y };
-                gatherer.width = PLAYER_WIDTH;
-
-                item_gatherer.AddGatherer(gatherer);
+            {
+                PhaseTimer timer(tick_profiler_, Phase::MOVEMENT);
+                for (size_t dog_index = 0; dog_index < session.GetNumberOfDogs(); ++dog_index) {
+                    Player* player_ptr = session.GetDogPlayer(dog_index);
+
+                    collision_detector::Gatherer gatherer;
+                    gatherer.start_pos = { player_ptr->GetPetPosition().x, player_ptr->GetPetPosition().y };
+                    player_ptr->MakeMove(time_delta);
+                    gatherer.end_pos = { player_ptr->GetPetPosition().x, player_ptr->GetPetPosition().y };
+                    gatherer.width = PLAYER_WIDTH;
+
+                    item_gatherer.AddGatherer(gatherer);
+                }
             }
 
-            for (std::shared_ptr<Loot> item : session.GetLootVector()) {
-                item_gatherer.AddItem(collision_detector::Item({item->GetPosition().x, item->GetPosition().y}, LOOT_WIDTH));
-            }      
+            std::vector<collision_detector::GatheringEvent> events;
+            {
+                PhaseTimer timer(tick_profiler_, Phase::GATHER_EVENTS);
+                for (LootHandle handle : session.GetLootHandles()) {
+                    const Position pos = session.GetLoot(handle).GetPosition();
+                    item_gatherer.AddItem(collision_detector::Item({ pos.x, pos.y }, LOOT_WIDTH));
+                }      
+
+                for (const Office& office : session.GetMapPtr()->GetOffices()) {
+                    item_gatherer.AddItem(collision_detector::Item( { static_cast<double>(office.GetPosition().x), static_cast<double>(office.GetPosition().y) }, BASE_WIDTH ));
+                }
 
-            for (const Office& office : session.GetMapPtr()->GetOffices()) {
-                item_gatherer.AddItem(collision_detector::Item( { static_cast<double>(office.GetPosition().x), static_cast<double>(office.GetPosition().y) }, BASE_WIDTH ));
+                events = collision_detector::FindGatherEvents(item_gatherer);
             }
 
-            for (const collision_detector::GatheringEvent& event : collision_detector::FindGatherEvents(item_gatherer)) {
-                Player* player_ptr = players_.FindByDogIdAndMapId(session.GetDogId(event.gatherer_id), session.GetMapId());
-                // dog found loot
-                if (event.item_id < session.GetLootCount()) {
-                    if (session.GetLootPtr(event.item_id)->IsCollected()) {
-                        continue;
+            {
+                PhaseTimer timer(tick_profiler_, Phase::LOOT_EXCHANGE);
+                for (const collision_detector::GatheringEvent& event : events) {
+                    Player* player_ptr = session.GetDogPlayer(event.gatherer_id);
+                    // dog found loot
+                    if (event.item_id < session.GetLootCount()) {
+                        if (session.GetLoot(event.item_id).IsCollected()) {
+                            continue;
+                        }
+                        // bag_capacity let take a loot
+                        if (session.GetMapPtr()->GetCapacity() > player_ptr->GetLootCount()) {
+                            player_ptr->TakeLoot(session.GetLootHandle(event.item_id));
+                        }
                     }
-                    // bag_capacity let take a loot
-                    if (session.GetMapPtr()->GetCapacity() > player_ptr->GetLootCount()) {
-                        player_ptr->TakeLoot(session.GetLootPtr(event.item_id));
+                    // dog found office
+                    else {
+                        player_ptr->ReturnLoot(GetLootTypes(session.GetMapIndex()));
                     }
-                }
-                // dog found office
-                else {
-                    player_ptr->ReturnLoot(GetMapInfoJson(session.GetMapId()));
-                }
 
+                }
             }
 
-            session.EraseTookedLoot();
+            {
+                PhaseTimer timer(tick_profiler_, Phase::ERASE_LOOT);
+                session.EraseTookedLoot();
+            }
 
-            // Adding loot
-            unsigned loots = loot_generator_->Generate(std::chrono::milliseconds(time_delta), session.GetLootCount(), session.GetNumberOfDogs());
-            while (loots) {
-                session.AddLoot(GetRandomLootType(session.GetMapId()));
-                --loots;
+            if (inputs.generate_loot) {
+                PhaseTimer timer(tick_profiler_, Phase::LOOT_GENERATION);
+                // Adding loot
+                unsigned loots = loot_generator_->Generate(std::chrono::milliseconds(time_delta), session.GetLootCount(), session.GetNumberOfDogs());
+                while (loots) {
+                    session.AddLoot(GetRandomLootType(session.GetMapIndex()), random_generator_);
+                    --loots;
+                }
             }
+            tick_profiler_.EndSession();
         }
     }
 
     if (listener_) {
+        PhaseTimer timer(tick_profiler_, Phase::LISTENER);
         listener_->OnTick(time_delta);
     }
 }
 
+const tick_profiler::TickProfiler& Game::GetTickProfiler() const noexcept {
+    return tick_profiler_;
+}
+
+degradation::Controller& Game::GetDegradation() noexcept {
+    return degradation_;
+}
+
+const degradation::Controller& Game::GetDegradation() const noexcept {
+    return degradation_;
+}
+
 void Game::SetInternalTicker() {
     internal_ticker_ = true;
 }
@@ -283,22 +613,31 @@ void Game::SetLootGenerator(std::shared_ptr<loot_gen::LootGenerator> loot_genera
     loot_generator_ = loot_generator;
 }
 
-int Game::GetRandomLootType(Map::Id map_id) const {
-    size_t loot_count = extra_data_->GetLootCount(map_id_to_index_.at(map_id));
-    std::random_device rd;
-    std::mt19937 gen(rd());
+int Game::GetRandomLootType(const Map::Id& map_id) {
+    return GetRandomLootType(GetMapIndex(map_id));
+}
+
+int Game::GetRandomLootType(size_t map_index) {
+    size_t loot_count = extra_data_->GetLootCount(map_index);
     
     std::uniform_int_distribution<> dis(0, static_cast<int>(loot_count) - 1);
 
-    return dis(gen);
+    return dis(random_generator_);
 }
 
-json::array Game::GetMapInfoJson(Map::Id id) const {
-    return extra_data_->GetInfoByIndex(map_id_to_index_.at(id));
+json::array Game::GetMapInfoJson(const Map::Id& id) const {
+    return extra_data_->GetInfoByIndex(GetMapIndex(id));
 }
 
-Player* Game::FindByDogIdAndMapId(uint64_t dog_id, Map::Id map_id) {
-    return players_.FindByDogIdAndMapId(dog_id, map_id);
+const json::array& Game::GetLootTypes(size_t map_index) const {
+    return extra_data_->GetInfoByIndex(map_index);
+}
+
+Player* Game::FindByDogIdAndMapId(uint64_t dog_id, const Map::Id& map_id) {
+    if (auto it = map_id_to_index_.find(map_id); it != map_id_to_index_.end()) {
+        return players_.FindByDogIdAndMapIndex(dog_id, it->second);
+    }
+    return nullptr;
 }
 
 void Game::SetApplicationListener(ApplicationListener* listener) {
@@ -309,23 +648,39 @@ const Players& Game::GetPlayersClass() const {
     return players_;
 }
 
-const Game::MapIdToSession& Game::GetMapIdToSession() const {
-    return map_id_to_sessions_;
+const Game::MapSessions& Game::GetMapSessions() const {
+    return map_sessions_;
 }
 
 void Game::AddExistPlayer(const Player& player, Token token) {
     players_.AddExistPlayer(player, token);
 }
 
+void Game::ReservePlayers(size_t count) {
+    players_.Reserve(count);
+}
+
 void Game::SetDogRetirementTime(const double retirement_time) noexcept {
     dog_retirement_time_ = retirement_time;
 }
 
 void Game::CheckInactivePlayers(int64_t time_delta) {
-    for (Player& player : players_.GetPlayers()) {
+    Players::PlayerList& players = players_.GetPlayers();
+    for (auto it = players.begin(); it != players.end();) {
+        // Итератор сдвигается заранее: ушедший игрок удаляется из списка
+        Player& player = *it++;
+        // При воспроизведении журнала игроки уходят только по записям об уходе, а рекорды уже сохранены
+        if (replaying_) {
+            player.UpdatePlayTime(time_delta);
+            continue;
+        }
         if (std::optional<uint64_t> inactivity_time = player.GetInactivityTime(); inactivity_time.value_or(0) + time_delta >= 15000) {
+            if (listener_) {
+                listener_->OnRetire(player.GetToken());
+            }
             player.UpdatePlayTime(time_delta);
             db_->SaveRecord(player.GetPetName(), player.GetScore(), player.GetPlayTime());
+            player.ReleaseLoot();
             GameSession* session = player.GetSessionPtr();
             session->RemoveDog(player.GetId());
             players_.RemovePlayer(player);
@@ -344,6 +699,34 @@ json::array Game::GetRecords(int limit, int offset) {
     return db_->GetRecords(limit, offset);
 }
 
+RecordsPage Game::GetRecordsPage(int limit, const std::optional<RecordKey>& after) {
+    return db_->GetRecordsPage(limit, after);
+}
+
+json::array Game::GetWindowRecords(RecordsWindow window, int limit, int offset) {
+    return db_->GetWindowRecords(window, limit, offset);
+}
+
+int64_t GetRecordTime() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int64_t GetWindowStart(RecordsWindow window, int64_t time_ms) {
+    constexpr int64_t DAY_MS = 24 * 60 * 60 * 1000;
+    // Деление с округлением вниз, чтобы время до 1970 года не попадало в следующие сутки
+    const int64_t day = time_ms / DAY_MS - (time_ms % DAY_MS < 0 ? 1 : 0);
+    switch (window) {
+    case RecordsWindow::DAY:
+        return day * DAY_MS;
+    case RecordsWindow::WEEK:
+        // 1 января 1970 года - четверг, до понедельника три дня назад
+        return (day - ((day % 7 + 7 + 3) % 7)) * DAY_MS;
+    case RecordsWindow::ALL:
+        break;
+    }
+    return 0;
+}
+
 Road::Road(HorizontalTag, Point start, Coord end_x) noexcept
     : start_{ start }
     , end_{ end_x, start.y } {
@@ -429,6 +812,10 @@ Dog::Dog(std::string dog_name, Position position)
 Dog::Dog(std::string dog_name, Position position, Velocity velocity, Direct direct, std::uint64_t id)
     : dog_name_(dog_name), position_(position), velocity_(velocity), direct_(direct), id_(id) {}
 
+void Dog::ReserveId(std::uint64_t id) noexcept {
+    id_counter = std::max(id_counter, id + 1);
+}
+
 std::string Dog::GetName() const {
     return dog_name_;
 }
@@ -464,18 +851,30 @@ std::uint64_t Dog::GetId() const {
 GameSession::GameSession(const Map* map)
     :map_(map) {}
 
-const Dog* GameSession::AddDog(std::shared_ptr<Dog> dog_ptr) {
-    return dogs_.emplace_back(dog_ptr).get();
+GameSession::GameSession(const Map* map, SessionSlots* slots, size_t index)
+    :map_(map), slots_(slots), slot_index_(index) {}
+
+const Dog* GameSession::AddDog(std::shared_ptr<Dog> dog_ptr, Player* player) {
+    const Dog* dog = dogs_.emplace_back(dog_ptr).get();
+    dog_players_.push_back(player);
+    if (slots_) {
+        slots_->Update(slot_index_, dogs_.size() - 1, dogs_.size());
+    }
+    return dog;
 }
 
 uint64_t GameSession::GetNumberOfDogs() const {
     return dogs_.size();
 }
 
-Map::Id GameSession::GetMapId() const {
+const Map::Id& GameSession::GetMapId() const {
     return map_->GetId();
 }
 
+size_t GameSession::GetMapIndex() const {
+    return map_->GetIndex();
+}
+
 const Map* GameSession::GetMapPtr() const {
     return map_;
 }
@@ -496,22 +895,39 @@ size_t GameSession::GetLootCount() const {
     return loots_.size();
 }
 
-std::shared_ptr<Loot> GameSession::GetLootPtr(size_t idx) {
+const Loot& GameSession::GetLoot(size_t idx) const {
+    return GetLoot(loots_.at(idx));
+}
+
+const Loot& GameSession::GetLoot(LootHandle handle) const {
+    const Loot* loot = loot_pool_.Find(handle);
+    if (!loot) {
+        throw std::out_of_range("Loot was removed from the session");
+    }
+    return *loot;
+}
+
+Loot& GameSession::GetLoot(LootHandle handle) {
+    Loot* loot = loot_pool_.Find(handle);
+    if (!loot) {
+        throw std::out_of_range("Loot was removed from the session");
+    }
+    return *loot;
+}
+
+LootHandle GameSession::GetLootHandle(size_t idx) const {
     return loots_.at(idx);
 }
 
 void GameSession::EraseTookedLoot() {
-    for (std::vector<std::shared_ptr<Loot>>::iterator it = loots_.begin(); it != loots_.end();) {
-        if (it->get()->IsCollected()) {
-            it = loots_.erase(it);
-        }
-        else {
-            ++it;
-        }
-    }
+    // Один проход со сдвигом оставшихся: порядок предметов сохраняется, от него зависят индексы
+    // событий сбора при воспроизведении журнала
+    std::erase_if(loots_, [this](LootHandle handle) {
+        return GetLoot(handle).IsCollected();
+    });
 }
 
-const std::vector<std::shared_ptr<Loot>>& GameSession::GetLootVector() const {
+const std::vector<LootHandle>& GameSession::GetLootHandles() const {
     return loots_;
 }
 
@@ -520,21 +936,67 @@ uint64_t GameSession::GetDogId(size_t idx) const {
     return dogs_.at(idx)->GetId();
 }
 
+void GameSession::SetDogPlayer(uint64_t dog_id, Player* player) {
+    // Связь обычно задаётся сразу после добавления собаки, поэтому поиск идёт с конца
+    for (size_t i = dogs_.size(); i > 0; --i) {
+        if (dogs_[i - 1]->GetId() == dog_id) {
+            dog_players_[i - 1] = player;
+            return;
+        }
+    }
+}
+
+Player* GameSession::GetDogPlayer(size_t idx) const {
+    assert(dog_players_.size() > idx);
+    return dog_players_[idx];
+}
+
 void GameSession::RemoveDog(uint64_t dog_id) {
     auto it = std::find_if(dogs_.begin(), dogs_.end(), [dog_id](const std::shared_ptr<Dog>& dog) {
         return dog->GetId() == dog_id;
         });
 
+    dog_players_.erase(dog_players_.begin() + std::distance(dogs_.begin(), it));
     dogs_.erase(it);
+    if (slots_) {
+        slots_->Update(slot_index_, dogs_.size() + 1, dogs_.size());
+    }
+}
+
+void GameSession::MoveLootTo(GameSession& other) {
+    other.ReserveLoot(loots_.size());
+    for (LootHandle handle : loots_) {
+        other.AddExistLoot(GetLoot(handle));
+    }
+    loots_ = {};
+    loot_pool_ = LootPool{};
 }
 
 void GameSession::AddLoot(int loot_type) {
     Position pos = GetRandomPos(this);
-    loots_.emplace_back(std::make_shared<Loot>(loot_type, pos));
+    AddExistLoot(Loot{ loot_type, pos });
+}
+
+void GameSession::AddLoot(int loot_type, std::mt19937_64& gen) {
+    Position pos = GetRandomPos(this, gen);
+    AddExistLoot(Loot{ loot_type, pos });
+}
+
+LootHandle GameSession::AddExistLoot(Loot loot) {
+    return loots_.emplace_back(loot_pool_.Add(std::move(loot)));
+}
+
+LootHandle GameSession::StoreLoot(Loot loot) {
+    return loot_pool_.Add(std::move(loot));
 }
 
-void GameSession::AddExistLoot(std::shared_ptr<Loot> loot_ptr) {
-    loots_.emplace_back(loot_ptr);
+void GameSession::RemoveLoot(LootHandle handle) {
+    loot_pool_.Remove(handle);
+}
+
+void GameSession::ReserveLoot(size_t count) {
+    loots_.reserve(loots_.size() + count);
+    loot_pool_.Reserve(count);
 }
 
 Player::Player(std::string dog_name, GameSession* session, bool random_spawn)
@@ -545,7 +1007,7 @@ Player::Player(std::string dog_name, GameSession* session, bool random_spawn)
     else {
         dog_ = std::make_shared<Dog>(std::move(dog_name), GetStartPos(session_));
     }
-    session->AddDog(dog_);
+    session->AddDog(dog_, this);
 }
 
 std::string Player::GetPetName() const {
@@ -643,11 +1105,12 @@ size_t Player::GetLootCount() const noexcept {
     return loots_.size();
 }
 
-void Player::TakeLoot(std::shared_ptr<Loot> loot_ptr) {
-    loots_.emplace_back(loot_ptr)->SetCollected();
+void Player::TakeLoot(LootHandle handle) {
+    session_->GetLoot(handle).SetCollected();
+    loots_.push_back(handle);
 }
 
-const std::vector<std::shared_ptr<Loot>>& Player::GetLootVector() const {
+const std::vector<LootHandle>& Player::GetLootHandles() const {
     return loots_;
 }
 
@@ -656,10 +1119,45 @@ int Player::GetScore() const noexcept {
 }
 
 void Player::ReturnLoot(const json::array& map_info) {
-    for (int i = loots_.size() - 1; i >= 0; --i) {
-        score_ += map_info.at(loots_.at(i)->GetLootType()).as_object().at("value").as_int64();
-        loots_.pop_back();
+    for (LootHandle handle : loots_) {
+        score_ += map_info.at(session_->GetLoot(handle).GetLootType()).as_object().at("value").as_int64();
+        session_->RemoveLoot(handle);
     }
+    loots_.clear();
+}
+
+void Player::ReleaseLoot() {
+    for (LootHandle handle : loots_) {
+        session_->RemoveLoot(handle);
+    }
+    loots_.clear();
+}
+
+void Player::MoveToSession(GameSession& session) {
+    for (LootHandle& handle : loots_) {
+        Loot loot = session_->GetLoot(handle);
+        session_->RemoveLoot(handle);
+        handle = session.StoreLoot(std::move(loot));
+    }
+    session_->RemoveDog(dog_->GetId());
+    session.AddDog(dog_, this);
+    session_ = &session;
+}
+
+const Token& Player::GetToken() const noexcept {
+    return token_;
+}
+
+void Player::SetToken(const Token& token) noexcept {
+    token_ = token;
+}
+
+Player::ListPosition Player::GetListPosition() const noexcept {
+    return list_position_;
+}
+
+void Player::SetListPosition(ListPosition position) noexcept {
+    list_position_ = position;
 }
 
 void Player::SetSession(GameSession* session) {
@@ -744,41 +1242,35 @@ Position Player::GetAvailablePos(const std::set<std::shared_ptr<Road>>& roads) {
     return near_new_pos;
 }
 
-size_t PairHasher::operator()(const std::pair<Map::Id, uint64_t>& hash) const {
-    size_t result = 0;
-    int counter = 0;
-    for (char ch : *hash.first) {
-        result += static_cast<int>(ch) + hash.second;
-        result *= static_cast<size_t>(std::pow(17, counter));
-        ++counter;
-    }
-    return result;
+size_t PairHasher::operator()(const std::pair<size_t, uint64_t>& hash) const {
+    return std::hash<uint64_t>{}(hash.second * 0x9E3779B97F4A7C15ull + hash.first);
 }
 
 std::pair<Token, Player&> Players::Add(std::string dog_name, GameSession* session, bool random_spawn) {
     Player& player = players_.emplace_back(std::move(dog_name), session, random_spawn);
-    Token token = PlayerTokens().GenerateToken();
-    token_to_player_[token] = &player;
-    map_id_dog_id_to_index_[{session->GetMapId(), player.GetId()}] = players_.size() - 1;
+    Token token = tokens_.GenerateToken();
+    player.SetToken(token);
+    player.SetListPosition(std::prev(players_.end()));
+    token_to_player_.Insert(token, &player);
+    map_index_dog_id_to_player_[{session->GetMapIndex(), player.GetId()}] = &player;
     return { token, player };
 }
 
-Player* Players::FindByDogIdAndMapId(uint64_t dog_id, Map::Id map_id) {
-    if (auto it = map_id_dog_id_to_index_.find({ map_id, dog_id }); it != map_id_dog_id_to_index_.end()) {
-        return &players_[it->second];
+Player* Players::FindByDogIdAndMapIndex(uint64_t dog_id, size_t map_index) {
+    if (auto it = map_index_dog_id_to_player_.find({ map_index, dog_id }); it != map_index_dog_id_to_player_.end()) {
+        return it->second;
     }
     else {
         return nullptr;
     }
 }
 
-std::deque<Player>& Players::GetPlayers() {
+Players::PlayerList& Players::GetPlayers() {
     return players_;
 }
 
 Player* Players::FindPlayerByToken(Token token) const {
-    auto it = token_to_player_.find(token);
-    return it != token_to_player_.end() ? it->second : nullptr;
+    return token_to_player_.Find(token);
 }
 
 const Players::TokenToPlayer& Players::GetTokenToPlayer() const {
@@ -786,36 +1278,24 @@ const Players::TokenToPlayer& Players::GetTokenToPlayer() const {
 }
 
 void Players::AddExistPlayer(const Player& player, Token token) {
-    token_to_player_[token] = &players_.emplace_back(player);
-    map_id_dog_id_to_index_[{player.GetSessionPtr()->GetMapId(), player.GetId()}] = players_.size() - 1;
+    Player& stored = players_.emplace_back(player);
+    stored.SetToken(token);
+    stored.SetListPosition(std::prev(players_.end()));
+    token_to_player_.Insert(token, &stored);
+    map_index_dog_id_to_player_[{stored.GetSessionPtr()->GetMapIndex(), stored.GetId()}] = &stored;
+    // Собака уже в сессии, но указывала на копию игрока или ни на кого
+    stored.GetSessionPtr()->SetDogPlayer(stored.GetId(), &stored);
 }
 
-void Players::RemovePlayer(const Player& player) {
-    auto it = std::find_if(players_.begin(), players_.end(), [&player](const Player& p) {
-        return p.GetId() == player.GetId();
-        });
+void Players::Reserve(size_t count) {
+    token_to_player_.Reserve(count);
+    map_index_dog_id_to_player_.reserve(count);
+}
 
-    if (it != players_.end()) {
-        for (auto token_it = token_to_player_.begin(); token_it != token_to_player_.end(); ) {
-            if (token_it->second == &(*it)) {
-                token_it = token_to_player_.erase(token_it);
-            }
-            else {
-                ++token_it;
-            }
-        }
-        auto map_dog_it = map_id_dog_id_to_index_.find({ player.GetSessionPtr()->GetMapId(), player.GetId() });
-        if (map_dog_it != map_id_dog_id_to_index_.end()) {
-            map_id_dog_id_to_index_.erase(map_dog_it);
-        }
-        uint64_t removed_index = std::distance(players_.begin(), it);
-        players_.erase(it);
-        for (auto& [key, index] : map_id_dog_id_to_index_) {
-            if (index > removed_index) {
-                --index;
-            }
-        }
-    }
+void Players::RemovePlayer(const Player& player) {
+    token_to_player_.Erase(player.GetToken());
+    map_index_dog_id_to_player_.erase({ player.GetSessionPtr()->GetMapIndex(), player.GetId() });
+    players_.erase(player.GetListPosition());
 }
 
 Position Loot::GetPosition() const noexcept {
@@ -838,4 +1318,164 @@ void Loot::SetCollected() {
     is_collected_ = true;
 }
 
+SessionSlots::SessionSlots(size_t capacity)
+    : capacity_(capacity)
+    , buckets_(capacity) {
+    if (capacity == 0) {
+        throw std::invalid_argument("Session capacity must be positive");
+    }
+}
+
+void SessionSlots::Add(size_t session) {
+    buckets_[0].Insert(session);
+}
+
+void SessionSlots::Update(size_t session, size_t old_count, size_t new_count) {
+    // Заполненная сессия (в том числе восстановленная при меньшей вместимости) в корзины не попадает
+    if (old_count < capacity_) {
+        buckets_[old_count].Erase(session);
+    }
+    if (new_count < capacity_) {
+        buckets_[new_count].Insert(session);
+    }
+}
+
+std::optional<size_t> SessionSlots::FindFree(SessionPacking packing) const {
+    for (size_t i = 0; i < capacity_; ++i) {
+        const size_t count = packing == SessionPacking::FILL_FIRST ? capacity_ - 1 - i : i;
+        if (!buckets_[count].IsEmpty()) {
+            return buckets_[count].FindFrom(0);
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<size_t> SessionSlots::FindTarget(size_t count, size_t exclude) const {
+    if (count == 0 || count > capacity_) {
+        return std::nullopt;
+    }
+    for (size_t target_count = capacity_ - count; target_count >= count; --target_count) {
+        const IndexBitmap& bucket = buckets_[target_count];
+        std::optional<size_t> session = bucket.FindFrom(0);
+        if (session == exclude) {
+            session = bucket.FindFrom(exclude + 1);
+        }
+        if (session) {
+            return session;
+        }
+    }
+    return std::nullopt;
+}
+
+std::vector<size_t> SessionSlots::GetSessions(size_t count) const {
+    const IndexBitmap& bucket = buckets_.at(count);
+    std::vector<size_t> sessions;
+    for (std::optional<size_t> session = bucket.FindFrom(0); session; session = bucket.FindFrom(*session + 1)) {
+        sessions.push_back(*session);
+    }
+    return sessions;
+}
+
+size_t SessionSlots::GetCapacity() const noexcept {
+    return capacity_;
+}
+
+void SessionSlots::IndexBitmap::Insert(size_t index) {
+    const size_t word = index / 64;
+    if (word >= words_.size()) {
+        words_.resize(word + 1);
+        summary_.resize(word / 64 + 1);
+    }
+    const std::uint64_t bit = std::uint64_t{ 1 } << (index % 64);
+    if (!(words_[word] & bit)) {
+        words_[word] |= bit;
+        summary_[word / 64] |= std::uint64_t{ 1 } << (word % 64);
+        ++size_;
+    }
+}
+
+void SessionSlots::IndexBitmap::Erase(size_t index) noexcept {
+    const size_t word = index / 64;
+    const std::uint64_t bit = std::uint64_t{ 1 } << (index % 64);
+    if (word >= words_.size() || !(words_[word] & bit)) {
+        return;
+    }
+    words_[word] &= ~bit;
+    if (words_[word] == 0) {
+        summary_[word / 64] &= ~(std::uint64_t{ 1 } << (word % 64));
+    }
+    --size_;
+}
+
+bool SessionSlots::IndexBitmap::IsEmpty() const noexcept {
+    return size_ == 0;
+}
+
+std::optional<size_t> SessionSlots::IndexBitmap::FindFrom(size_t from) const noexcept {
+    size_t word = from / 64;
+    if (word >= words_.size()) {
+        return std::nullopt;
+    }
+    if (const std::uint64_t bits = words_[word] & (~std::uint64_t{ 0 } << (from % 64)); bits) {
+        return word * 64 + std::countr_zero(bits);
+    }
+    // Следующее непустое слово ищется по сводке
+    ++word;
+    for (size_t group = word / 64; group < summary_.size(); ++group) {
+        std::uint64_t groups = summary_[group];
+        if (group == word / 64) {
+            groups &= ~std::uint64_t{ 0 } << (word % 64);
+        }
+        if (groups) {
+            const size_t found = group * 64 + std::countr_zero(groups);
+            return found * 64 + std::countr_zero(words_[found]);
+        }
+    }
+    return std::nullopt;
+}
+
+LootHandle LootPool::Add(Loot loot) {
+    if (free_slots_.empty()) {
+        slots_.push_back(Slot{ std::move(loot) });
+        return LootHandle{ static_cast<std::uint32_t>(slots_.size() - 1), 0 };
+    }
+    const std::uint32_t index = free_slots_.back();
+    free_slots_.pop_back();
+    Slot& slot = slots_[index];
+    slot.loot.emplace(std::move(loot));
+    return LootHandle{ index, slot.generation };
+}
+
+Loot* LootPool::Find(LootHandle handle) noexcept {
+    if (handle.index >= slots_.size()) {
+        return nullptr;
+    }
+    Slot& slot = slots_[handle.index];
+    return slot.generation == handle.generation && slot.loot ? &*slot.loot : nullptr;
+}
+
+const Loot* LootPool::Find(LootHandle handle) const noexcept {
+    return const_cast<LootPool*>(this)->Find(handle);
+}
+
+void LootPool::Remove(LootHandle handle) {
+    if (!Find(handle)) {
+        return;
+    }
+    Slot& slot = slots_[handle.index];
+    slot.loot.reset();
+    ++slot.generation;
+    free_slots_.push_back(handle.index);
+}
+
+void LootPool::Reserve(size_t count) {
+    if (count > free_slots_.size()) {
+        slots_.reserve(slots_.size() + count - free_slots_.size());
+    }
+}
+
+size_t LootPool::GetSize() const noexcept {
+    return slots_.size() - free_slots_.size();
+}
+
 }  // namespace model
@@ -1,50 +1,82 @@
 #pragma once
 #include <cmath>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <memory>
 #include <sstream>
 #include <random>
 #include <deque>
+#include <list>
 #include <cassert>
 #include <iomanip>
 #include <set>
 #include <optional>
+#include <atomic>
+#include <chrono>
 
 #include "collision_detector.h"
 #include "tagged.h"
 #include "extra_data.h"
 #include "loot_generator.h"
+#include "metrics.h"
+#include "tick_profiler.h"
+#include "degradation.h"
 
 using namespace std::literals;
 
 
 namespace model {
 
-namespace detail {
-    struct TokenTag {};
-}  // namespace detail
+// Токен игрока: 128 случайных бит. Клиенту передаётся как 32 шестнадцатеричные цифры в нижнем регистре
+class Token {
+public:
+    static constexpr size_t TEXT_SIZE = 32;
+
+    Token() = default;
+
+    Token(std::uint64_t high, std::uint64_t low) noexcept
+        : high_(high), low_(low) {}
+
+    // nullopt, если text - не ровно 32 шестнадцатеричные цифры в нижнем регистре.
+    // Разбор без ветвлений по содержимому: время не зависит от того, где в строке ошибка
+    static std::optional<Token> FromString(std::string_view text) noexcept;
+
+    std::string ToString() const;
+
+    std::uint64_t GetHigh() const noexcept {
+        return high_;
+    }
+
+    std::uint64_t GetLow() const noexcept {
+        return low_;
+    }
 
-using Token = util::Tagged<std::string, detail::TokenTag>;
+    bool operator==(const Token& other) const = default;
 
+private:
+    std::uint64_t high_ = 0;
+    std::uint64_t low_ = 0;
+};
+
+// Один генератор на всю игру: создаётся и засевается однажды, а не на каждое подключение
 class PlayerTokens {
 public:
     Token GenerateToken();
 private:
-    std::random_device random_device_;
-    std::mt19937_64 generator1_{ [this] {
-        std::uniform_int_distribution<std::mt19937_64::result_type> dist;
-        return dist(random_device_);
-    }() };
-    std::mt19937_64 generator2_{ [this] {
+    static std::uint64_t MakeSeed() {
+        std::random_device random_device;
         std::uniform_int_distribution<std::mt19937_64::result_type> dist;
-        return dist(random_device_);
-    }() };
+        return dist(random_device);
+    }
+
+    std::mt19937_64 generator1_{ MakeSeed() };
+    std::mt19937_64 generator2_{ MakeSeed() };
 };
 
 static std::uint64_t id_counter = 0;
-static int loot_id_counter = 0;
+inline std::atomic<int> loot_id_counter = 0;
 
 using Dimension = int;
 using Coord = Dimension;
@@ -157,6 +189,19 @@ private:
     Offset offset_;
 };
 
+// Как выбирается сессия для нового игрока: самая заполненная из неполных или самая свободная
+enum class SessionPacking {
+    FILL_FIRST, BALANCE
+};
+
+struct SessionConfig {
+    size_t capacity = 100;
+    SessionPacking packing = SessionPacking::FILL_FIRST;
+    // Игроки сессии, в которой их осталось меньше порога, переселяются в другую сессию карты,
+    // если там хватает места. 0 - не переселять
+    size_t compact_below = 0;
+};
+
 class Map {
 public:
     struct PointHash {
@@ -176,6 +221,11 @@ public:
 
     const Id& GetId() const noexcept;
 
+    // Номер карты в порядке загрузки; внутри игры карта ищется по нему, а строковый id нужен только в API
+    size_t GetIndex() const noexcept;
+
+    void SetIndex(size_t index) noexcept;
+
     const std::string& GetName() const noexcept;
 
     const Buildings& GetBuildings() const noexcept;
@@ -193,7 +243,10 @@ public:
     void SetDogSpeed(double dog_speed);
 
     int GetCapacity() const noexcept;
-    
+
+    void SetSessionConfig(SessionConfig config) noexcept;
+
+    const SessionConfig& GetSessionConfig() const noexcept;
 
     std::optional<std::set<std::shared_ptr<Road>>> GetRoadsOnPoint(const Point& point) const;
 
@@ -205,6 +258,8 @@ private:
     Buildings buildings_;
     double dog_speed_;
     int bag_capacity_;
+    size_t index_ = 0;
+    SessionConfig session_config_;
 
     PositionToRoads coord_to_road;
 
@@ -218,6 +273,9 @@ public:
 
     explicit Dog(std::string dog_name, Position position, Velocity velocity, Direct direct, std::uint64_t id);
 
+    // Новые собаки получат id больше восстановленного
+    static void ReserveId(std::uint64_t id) noexcept;
+
     std::string GetName() const;
 
     Position GetPosition() const;
@@ -264,15 +322,115 @@ private:
     bool is_collected_ = false;
 };
 
+// Ссылка на предмет в пуле сессии. Поколение слота растёт при каждом освобождении,
+// поэтому ссылка на убранный предмет не указывает на предмет, позже занявший тот же слот
+struct LootHandle {
+    std::uint32_t index = 0;
+    std::uint32_t generation = 0;
+
+    bool operator==(const LootHandle& other) const = default;
+};
+
+// Предметы сессии лежат в слотах одного вектора; освобождённые слоты переиспользуются,
+// так что появление и сбор предметов не выделяют память и не трогают счётчики ссылок
+class LootPool {
+public:
+    LootHandle Add(Loot loot);
+
+    // nullptr, если предмет уже убран из пула
+    Loot* Find(LootHandle handle) noexcept;
+
+    const Loot* Find(LootHandle handle) const noexcept;
+
+    void Remove(LootHandle handle);
+
+    void Reserve(size_t count);
+
+    size_t GetSize() const noexcept;
+
+private:
+    struct Slot {
+        std::optional<Loot> loot;
+        std::uint32_t generation = 0;
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<std::uint32_t> free_slots_;
+};
+
+// Сессии одной карты, разложенные по числу игроков. Свободная сессия находится перебором
+// корзин, число которых ограничено вместимостью сессии, а не числом сессий карты.
+// Внутри корзины выбирается сессия с меньшим индексом: выбор зависит только от состояния игры,
+// поэтому после восстановления снимка журнал воспроизводится в те же сессии.
+// Корзина - битовая карта индексов сессий, так что вход и уход игрока не выделяют память
+class SessionSlots {
+public:
+    explicit SessionSlots(size_t capacity);
+
+    // Регистрирует новую пустую сессию с индексом session
+    void Add(size_t session);
+
+    void Update(size_t session, size_t old_count, size_t new_count);
+
+    // Сессия со свободным местом по правилу packing; nullopt, если все сессии заполнены
+    std::optional<size_t> FindFree(SessionPacking packing) const;
+
+    // Самая заполненная сессия, кроме exclude, в которой не меньше count игроков и есть место ещё для count
+    std::optional<size_t> FindTarget(size_t count, size_t exclude) const;
+
+    // Сессии ровно с count игроками по возрастанию индекса
+    std::vector<size_t> GetSessions(size_t count) const;
+
+    size_t GetCapacity() const noexcept;
+
+private:
+    // Множество индексов: слова по 64 бита и сводка, где бит i отмечает непустое слово i.
+    // Вставка и удаление - O(1); память растёт только с появлением новых сессий.
+    // Поиск наименьшего индекса просматривает одно слово сводки на 4096 сессий
+    class IndexBitmap {
+    public:
+        void Insert(size_t index);
+
+        void Erase(size_t index) noexcept;
+
+        bool IsEmpty() const noexcept;
+
+        // Наименьший индекс не меньше from
+        std::optional<size_t> FindFrom(size_t from) const noexcept;
+
+    private:
+        std::vector<std::uint64_t> words_;
+        std::vector<std::uint64_t> summary_;
+        size_t size_ = 0;
+    };
+
+    size_t capacity_;
+    // buckets_[n] - сессии с n игроками; заполненные сессии не хранятся
+    std::vector<IndexBitmap> buckets_;
+};
+
+class Player;
+
 class GameSession {
 public:
     explicit GameSession(const Map* map);
 
-    const Dog* AddDog(std::shared_ptr<Dog> dog_ptr);
+    // Сессия сообщает slots об изменении числа игроков
+    GameSession(const Map* map, SessionSlots* slots, size_t index);
+
+    // player - владелец собаки; если он ещё не на своём месте, связь задаётся позже через SetDogPlayer
+    const Dog* AddDog(std::shared_ptr<Dog> dog_ptr, Player* player = nullptr);
+
+    void SetDogPlayer(uint64_t dog_id, Player* player);
+
+    // Игрок idx-й собаки сессии, без поиска по индексам игроков
+    Player* GetDogPlayer(size_t idx) const;
 
     uint64_t GetNumberOfDogs() const;
 
-    Map::Id GetMapId() const;
+    const Map::Id& GetMapId() const;
+
+    size_t GetMapIndex() const;
 
     const Map* GetMapPtr() const;
 
@@ -284,28 +442,59 @@ public:
 
     void AddLoot(int loot_type);
 
-    void AddExistLoot(std::shared_ptr<Loot> loot_ptr);
+    void AddLoot(int loot_type, std::mt19937_64& gen);
+
+    // Кладёт предмет на карту
+    LootHandle AddExistLoot(Loot loot);
+
+    // Помещает предмет в пул сессии, не выкладывая на карту; используется для предметов в рюкзаках
+    LootHandle StoreLoot(Loot loot);
+
+    // Освобождает слот предмета, который уже не лежит на карте
+    void RemoveLoot(LootHandle handle);
+
+    void ReserveLoot(size_t count);
 
+    // Число предметов на карте
     size_t GetLootCount() const;
 
-    std::shared_ptr<Loot> GetLootPtr(size_t idx);
+    // idx-й предмет на карте
+    const Loot& GetLoot(size_t idx) const;
 
+    const Loot& GetLoot(LootHandle handle) const;
+
+    Loot& GetLoot(LootHandle handle);
+
+    LootHandle GetLootHandle(size_t idx) const;
+
+    // Убирает с карты подобранные предметы за O(n) на тик; сами предметы остаются в пуле у рюкзаков
     void EraseTookedLoot();
 
-    const std::vector<std::shared_ptr<Loot>>& GetLootVector() const;
+    const std::vector<LootHandle>& GetLootHandles() const;
 
     uint64_t GetDogId(size_t idx) const;
 
     void RemoveDog(uint64_t dog_id);
 
+    // Переносит лежащие на карте предметы в other и освобождает память пула.
+    // Вызывается, когда игроки сессии уже переселены
+    void MoveLootTo(GameSession& other);
+
 private:
     const Map* map_;
+    SessionSlots* slots_ = nullptr;
+    size_t slot_index_ = 0;
     std::deque<std::shared_ptr<Dog>> dogs_;
-    std::vector<std::shared_ptr<Loot>> loots_;
+    // Игроки собак в том же порядке, что и dogs_
+    std::vector<Player*> dog_players_;
+    LootPool loot_pool_;
+    // Предметы, лежащие на карте, в порядке появления
+    std::vector<LootHandle> loots_;
 };
 
 class Player {
 public:
+    using ListPosition = std::list<Player>::iterator;
 
     Player() = default;
 
@@ -335,16 +524,34 @@ public:
 
     std::uint64_t GetId() const;
 
+    // Токен хранится в игроке, чтобы при уходе не искать его в индексе токенов
+    const Token& GetToken() const noexcept;
+
+    void SetToken(const Token& token) noexcept;
+
+    // Позиция в списке Players; задаётся при добавлении, чтобы уход игрока удалял его за O(1)
+    ListPosition GetListPosition() const noexcept;
+
+    void SetListPosition(ListPosition position) noexcept;
+
     size_t GetLootCount() const noexcept;
 
-    void TakeLoot(std::shared_ptr<Loot> loot_ptr);
+    // Переносит предмет сессии в рюкзак
+    void TakeLoot(LootHandle handle);
 
-    const std::vector<std::shared_ptr<Loot>>& GetLootVector() const;
+    // Предметы рюкзака; сами предметы берутся из сессии игрока
+    const std::vector<LootHandle>& GetLootHandles() const;
 
     int GetScore() const noexcept;
 
     void ReturnLoot(const json::array& map_info);
 
+    // Освобождает предметы рюкзака в пуле сессии; вызывается при уходе игрока
+    void ReleaseLoot();
+
+    // Переселяет собаку и рюкзак в другую сессию той же карты
+    void MoveToSession(GameSession& session);
+
     void SetSession(GameSession* session);
 
     void SetScore(int score) noexcept;
@@ -363,8 +570,10 @@ private:
     Position GetAvailablePos(const std::set<std::shared_ptr<Road>>& roads);
 
     GameSession* session_;
+    Token token_;
+    ListPosition list_position_;
     std::shared_ptr<Dog> dog_;
-    std::vector<std::shared_ptr<Loot>> loots_;
+    std::vector<LootHandle> loots_;
     int score_ = 0;
     uint64_t play_time_ = 0;
     std::optional<uint64_t> inactivity_time_ = 0;
@@ -372,19 +581,61 @@ private:
 
 struct PairHasher {
 
-    size_t operator()(const std::pair<Map::Id, uint64_t>& hash) const;
+    size_t operator()(const std::pair<size_t, uint64_t>& hash) const;
 
 };
 
+// Токен -> игрок: открытая адресация с линейным пробированием в одном векторе.
+// Токены случайны, поэтому для хеша достаточно перемешать их биты
+class TokenIndex {
+public:
+    Player* Find(const Token& token) const noexcept;
+
+    // Заменяет игрока, если токен уже есть
+    void Insert(const Token& token, Player* player);
+
+    void Erase(const Token& token) noexcept;
+
+    void Reserve(size_t count);
+
+    size_t GetSize() const noexcept;
+
+    template <typename Fn>
+    void ForEach(Fn&& fn) const {
+        for (const Slot& slot : slots_) {
+            if (slot.player) {
+                fn(slot.token, slot.player);
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        Token token;
+        // nullptr - пустой слот
+        Player* player = nullptr;
+    };
+
+    size_t GetHome(const Token& token) const noexcept;
+
+    void Rehash(size_t capacity);
+
+    // Размер - степень двойки, заполнение не больше половины
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+};
+
 class Players {
 public:
-    using TokenToPlayer = std::unordered_map<Token, Player*, util::TaggedHasher<Token>>;
+    using TokenToPlayer = TokenIndex;
+    // Список, а не deque: адреса игроков не меняются при уходе других, на них ссылаются индексы и сессии
+    using PlayerList = std::list<Player>;
 
     std::pair<Token, Player&> Add(std::string dog_name, GameSession* session, bool random_spawn);
 
-    Player* FindByDogIdAndMapId(uint64_t dog_id, Map::Id map_id);
+    Player* FindByDogIdAndMapIndex(uint64_t dog_id, size_t map_index);
     
-    std::deque<Player>& GetPlayers();
+    PlayerList& GetPlayers();
 
     Player* FindPlayerByToken(Token token) const;
 
@@ -392,12 +643,18 @@ public:
 
     void AddExistPlayer(const Player& player, Token token);
 
+    // Резервирует индексы, чтобы массовое добавление игроков не перестраивало хеш-таблицы
+    void Reserve(size_t count);
+
+    // player должен быть из этого списка
     void RemovePlayer(const Player& player);
 
 private:
-    std::unordered_map<std::pair<Map::Id, uint64_t>, uint64_t, PairHasher> map_id_dog_id_to_index_;
-    std::deque<Player> players_;
-    std::unordered_map<Token, Player*, util::TaggedHasher<Token>> token_to_player_;
+    // Для поиска по внешним идентификаторам; внутри тика игрок берётся из сессии
+    std::unordered_map<std::pair<size_t, uint64_t>, Player*, PairHasher> map_index_dog_id_to_player_;
+    PlayerList players_;
+    TokenIndex token_to_player_;
+    PlayerTokens tokens_;
 
 };
 
@@ -406,20 +663,71 @@ protected:
     ~ApplicationListener() = default;
 public:
     virtual void OnTick(int64_t time_delta) = 0;
+
+    // Входные события, меняющие состояние игры между тиками
+    virtual void OnJoin([[maybe_unused]] const Token& token, [[maybe_unused]] const Player& player) {}
+
+    virtual void OnMove([[maybe_unused]] const Token& token, [[maybe_unused]] std::string_view move) {}
+
+    virtual void OnRetire([[maybe_unused]] const Token& token) {}
+};
+
+// Положение записи в таблице рекордов: порядок по убыванию очков, затем по времени игры, имени и id
+struct RecordKey {
+    int score = 0;
+    uint64_t play_time_ms = 0;
+    std::string name;
+    std::string id;
+    // Время ухода игрока, мс от начала эпохи UTC; в порядок записей не входит. 0 - неизвестно
+    int64_t retired_at = 0;
+};
+
+// Период таблицы рекордов: календарные сутки или неделя UTC (с понедельника) либо всё время
+enum class RecordsWindow {
+    ALL, DAY, WEEK
+};
+
+// Для каждого периода хранится только верх таблицы такого размера
+constexpr int WINDOW_TOP_SIZE = 100;
+
+// Текущее время в мс от начала эпохи UTC
+int64_t GetRecordTime();
+
+// Начало периода window, в который попадает time_ms; для ALL - 0
+int64_t GetWindowStart(RecordsWindow window, int64_t time_ms);
+
+struct RecordsPage {
+    json::array records;
+    // Ключ последней записи страницы; nullopt, если страница пуста
+    std::optional<RecordKey> last;
 };
 
 class Database {
 public:
     virtual void SaveRecord(std::string name, int score, uint64_t played_time) = 0;
+    // Сохраняет запись с заданным id; если запись с таким id уже есть, ничего не делает
+    virtual void InsertRecord(const RecordKey& record) = 0;
     virtual json::array GetRecords(int limit, int offset) = 0;
+    // Страница рекордов, следующих за after, без пропуска предыдущих строк
+    virtual RecordsPage GetRecordsPage(int limit, const std::optional<RecordKey>& after) = 0;
+    // Рекорды текущего периода; читается только верх из WINDOW_TOP_SIZE записей
+    virtual json::array GetWindowRecords(RecordsWindow window, int limit, int offset) = 0;
     virtual ~Database() = default;
 };
 
+// Входные данные тика, которые не выводятся из состояния игры; записываются в журнал для воспроизведения
+struct TickInputs {
+    uint64_t seed = 0;
+    // Генерация трофеев отключается при деградации
+    bool generate_loot = true;
+    // Время без трофеев у общего генератора перед тиком
+    std::chrono::milliseconds time_without_loot{ 0 };
+};
+
 class Game {
 public:
     using Maps = std::vector<Map>;
 
-    static constexpr size_t MAX_COUNT_PLAYERS_ON_SESSION = 100;
     static constexpr double PLAYER_WIDTH = 0.6;
     static constexpr double BASE_WIDTH = 0.5;
     static constexpr double LOOT_WIDTH = 0.;
@@ -427,7 +735,10 @@ public:
 
     using MapIdHasher = util::TaggedHasher<Map::Id>;
     using MapIdToIndex = std::unordered_map<Map::Id, size_t, MapIdHasher>;
-    using MapIdToSession = std::unordered_map<Map::Id, std::deque<GameSession>, MapIdHasher>;
+    // Сессии и индексы свободных мест по индексу карты. deque: добавление карты не перемещает
+    // сессии, на которые ссылаются игроки, и индексы мест, на которые ссылаются сессии
+    using MapSessions = std::deque<std::deque<GameSession>>;
+    using MapSlots = std::deque<SessionSlots>;
 
     void AddMap(Map map);
 
@@ -437,14 +748,47 @@ public:
 
     std::pair<Token, Player&> AddPlayer(std::string dog_name, GameSession* session);
 
+    // move - "L", "R", "U", "D" или пустая строка для остановки. Возвращает false для неизвестного направления
+    bool MovePlayer(const Token& token, Player& player, std::string_view move);
+
+    // Убирает игрока без сохранения рекорда; используется при воспроизведении журнала
+    void RetirePlayer(const Token& token);
+
     Player* FindPlayerByToken(Token token) const;
 
-    std::deque<Player>& GetPlayers();
+    Players::PlayerList& GetPlayers();
 
+    // Бросает std::invalid_argument для неизвестной карты
     GameSession& GetSession(const Map::Id& id);
 
+    GameSession& GetSession(size_t map_index);
+
+    // Новая сессия в конце списка сессий карты, без поиска свободных мест; используется при восстановлении
+    GameSession& AddSession(const Map::Id& id);
+
+    GameSession& AddSession(size_t map_index);
+
     void GameTick(int64_t time_delta);
 
+    // Входные данные, с которыми прошёл бы тик сейчас, с заданным зерном
+    TickInputs MakeTickInputs(uint64_t seed) const;
+
+    // Повторяет тик из журнала: входные данные берутся из записи, игроки по неактивности не уходят
+    void ReplayTick(int64_t time_delta, const TickInputs& inputs);
+
+    // Входные данные последнего тика
+    const TickInputs& GetTickInputs() const noexcept;
+
+    std::chrono::milliseconds GetTimeWithoutLoot() const noexcept;
+
+    void SetTimeWithoutLoot(std::chrono::milliseconds time_without_loot);
+
+    const tick_profiler::TickProfiler& GetTickProfiler() const noexcept;
+
+    degradation::Controller& GetDegradation() noexcept;
+
+    const degradation::Controller& GetDegradation() const noexcept;
+
     void SetInternalTicker();
 
     bool IsTickerInternal() const;
@@ -457,20 +801,28 @@ public:
 
     void SetLootGenerator(std::shared_ptr<loot_gen::LootGenerator> loot_generator);
 
-    int GetRandomLootType(Map::Id map_id) const;
+    int GetRandomLootType(const Map::Id& map_id);
+
+    int GetRandomLootType(size_t map_index);
 
-    json::array GetMapInfoJson(Map::Id id) const;
+    json::array GetMapInfoJson(const Map::Id& id) const;
 
-    Player* FindByDogIdAndMapId(uint64_t dog_id, Map::Id map_id);
+    // Типы трофеев карты без копирования; используется внутри тика
+    const json::array& GetLootTypes(size_t map_index) const;
+
+    Player* FindByDogIdAndMapId(uint64_t dog_id, const Map::Id& map_id);
 
     void SetApplicationListener(ApplicationListener* listener);
 
     const Players& GetPlayersClass() const;
 
-    const MapIdToSession& GetMapIdToSession() const;
+    // Сессии карты - элемент с индексом Map::GetIndex()
+    const MapSessions& GetMapSessions() const;
 
     void AddExistPlayer(const Player& player, Token token);
 
+    void ReservePlayers(size_t count);
+
     void SetDogRetirementTime(const double retirement_time) noexcept;
 
     void CheckInactivePlayers(int64_t time_delta);
@@ -479,12 +831,29 @@ public:
 
     json::array GetRecords(int limit, int offset);
 
+    RecordsPage GetRecordsPage(int limit, const std::optional<RecordKey>& after);
+
+    json::array GetWindowRecords(RecordsWindow window, int limit, int offset);
+
 
 private:
+    void Tick(int64_t time_delta, const TickInputs& inputs);
+
+    // Переселяет игроков из сессий, где их меньше порога карты, в более заполненные.
+    // Опустевшая сессия не удаляется, чтобы не сдвигать индексы остальных, и снова получает игроков
+    // через индекс свободных мест
+    void CompactSessions();
+
+    void MoveSessionPlayers(GameSession& from, GameSession& to);
+
+    // Бросает std::invalid_argument для неизвестной карты
+    size_t GetMapIndex(const Map::Id& id) const;
+
     std::vector<Map> maps_;
     MapIdToIndex map_id_to_index_;
 
-    MapIdToSession map_id_to_sessions_;
+    MapSessions map_sessions_;
+    MapSlots map_slots_;
 
     Players players_;
 
@@ -496,6 +865,17 @@ private:
     ApplicationListener* listener_ = nullptr;
     double dog_retirement_time_ = 60;
     std::shared_ptr<Database> db_ = nullptr;
+
+    tick_profiler::TickProfiler tick_profiler_;
+    degradation::Controller degradation_;
+
+    std::mt19937_64 seed_source_{ std::random_device{}() };
+    std::mt19937_64 random_generator_;
+    TickInputs tick_inputs_;
+    bool replaying_ = false;
+
+    metrics::Histogram tick_duration_ = metrics::Registry::Instance().AddHistogram(
+        "game_tick_duration_microseconds", "Duration of a game tick including state listeners");
 };
 
 bool PosIsAvailable(const std::set<std::shared_ptr<Road>>& roads, Position pos);
@@ -504,4 +884,6 @@ Position GetStartPos(const GameSession* session);
 
 Position GetRandomPos(const GameSession* session);
 
+Position GetRandomPos(const GameSession* session, std::mt19937_64& gen);
+
 }  // namespace model
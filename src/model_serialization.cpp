@@ -0,0 +1,863 @@
+#include "model_serialization.h"
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/crc.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include <zlib.h>
+
+#include "durable_file.h"
+
+namespace serialization {
+
+namespace {
+
+using durable_file::Crc32;
+using durable_file::GetLittleEndian;
+using durable_file::PutLittleEndian;
+
+constexpr size_t SNAPSHOT_HEADER_SIZE = sizeof(SNAPSHOT_MAGIC) + 4 + 4 + 8 + 4;
+
+struct SnapshotHeader {
+    std::uint32_t format_version = SNAPSHOT_FORMAT_VERSION;
+    std::uint32_t flags = 0;
+    std::uint64_t payload_size = 0;
+    std::uint32_t payload_crc = 0;
+};
+
+void WriteHeader(std::ostream& out, const SnapshotHeader& header) {
+    std::array<char, SNAPSHOT_HEADER_SIZE> buffer;
+    char* pos = std::copy(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC), buffer.data());
+    PutLittleEndian(pos, header.format_version);
+    PutLittleEndian(pos, header.flags);
+    PutLittleEndian(pos, header.payload_size);
+    PutLittleEndian(pos, header.payload_crc);
+    out.write(buffer.data(), buffer.size());
+}
+
+constexpr size_t ZLIB_CHUNK_SIZE = 64 * 1024;
+
+// Потоковое сжатие: данные подаются кусками по мере готовности, выход копится блоками фиксированного размера
+class Deflater {
+public:
+    explicit Deflater(int level) {
+        if (deflateInit(&stream_, level) != Z_OK) {
+            throw std::runtime_error("Failed to initialize snapshot compression");
+        }
+    }
+
+    Deflater(const Deflater&) = delete;
+    Deflater& operator=(const Deflater&) = delete;
+
+    ~Deflater() {
+        deflateEnd(&stream_);
+    }
+
+    void Write(std::string_view data) {
+        while (!data.empty()) {
+            const size_t size = std::min<size_t>(data.size(), std::numeric_limits<uInt>::max());
+            Run(data.substr(0, size), Z_NO_FLUSH);
+            data.remove_prefix(size);
+        }
+    }
+
+    std::string Finish() {
+        Run({}, Z_FINISH);
+        return std::move(result_);
+    }
+
+private:
+    void Run(std::string_view data, int flush) {
+        stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream_.avail_in = static_cast<uInt>(data.size());
+        std::array<char, ZLIB_CHUNK_SIZE> chunk;
+        // Вход забран целиком (а при Z_FINISH поток завершён), когда deflate перестаёт заполнять выходной блок
+        do {
+            stream_.next_out = reinterpret_cast<Bytef*>(chunk.data());
+            stream_.avail_out = static_cast<uInt>(chunk.size());
+            if (deflate(&stream_, flush) == Z_STREAM_ERROR) {
+                throw std::runtime_error("Failed to compress state snapshot");
+            }
+            result_.append(chunk.data(), chunk.size() - stream_.avail_out);
+        } while (stream_.avail_out == 0);
+    }
+
+    z_stream stream_{};
+    std::string result_;
+};
+
+std::string Inflate(std::string_view data) {
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK) {
+        throw std::runtime_error("Failed to initialize snapshot decompression");
+    }
+    std::string result;
+    std::array<char, ZLIB_CHUNK_SIZE> chunk;
+    int status = Z_OK;
+    while (status != Z_STREAM_END) {
+        if (stream.avail_in == 0 && !data.empty()) {
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+            stream.avail_in = static_cast<uInt>(std::min<size_t>(data.size(), std::numeric_limits<uInt>::max()));
+            data.remove_prefix(stream.avail_in);
+        }
+        stream.next_out = reinterpret_cast<Bytef*>(chunk.data());
+        stream.avail_out = static_cast<uInt>(chunk.size());
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (status == Z_BUF_ERROR && stream.avail_in == 0 && data.empty()) {
+            inflateEnd(&stream);
+            throw std::runtime_error("Compressed state snapshot is truncated");
+        }
+        if (status != Z_OK && status != Z_STREAM_END) {
+            inflateEnd(&stream);
+            throw std::runtime_error("Failed to decompress state snapshot");
+        }
+        result.append(chunk.data(), chunk.size() - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    return result;
+}
+
+SnapshotHeader ParseHeader(const char* data) {
+    const char* pos = data + sizeof(SNAPSHOT_MAGIC);
+    SnapshotHeader header;
+    header.format_version = GetLittleEndian<std::uint32_t>(pos);
+    header.flags = GetLittleEndian<std::uint32_t>(pos);
+    header.payload_size = GetLittleEndian<std::uint64_t>(pos);
+    header.payload_crc = GetLittleEndian<std::uint32_t>(pos);
+    return header;
+}
+
+// Плоский формат версии 2. Записи без выравнивающих пропусков хранятся в порядке байтов
+// little-endian и читаются из отображённого файла копированием целой записи
+static_assert(std::endian::native == std::endian::little, "Flat snapshot records are stored in host byte order");
+
+struct StringRef {
+    std::uint32_t offset;
+    std::uint32_t size;
+};
+
+struct FlatCounts {
+    std::uint64_t journal_seq;
+    std::uint32_t maps;
+    std::uint32_t sessions;
+    // Игроков столько же, сколько собак: игрок i управляет собакой i
+    std::uint32_t dogs;
+    std::uint32_t loots;
+    std::uint32_t bag_loots;
+    std::uint32_t strings_size;
+    std::int64_t time_without_loot;
+};
+
+// В версии 2 заголовок тела заканчивался размером блока строк
+constexpr size_t FLAT_COUNTS_V2_SIZE = offsetof(FlatCounts, time_without_loot);
+
+struct FlatMap {
+    StringRef id;
+    std::uint32_t first_session;
+    std::uint32_t session_count;
+};
+
+struct FlatSession {
+    std::uint32_t first_dog;
+    std::uint32_t dog_count;
+    std::uint32_t first_loot;
+    std::uint32_t loot_count;
+};
+
+struct FlatDog {
+    double x;
+    double y;
+    double velocity_x;
+    double velocity_y;
+    std::uint64_t id;
+    StringRef name;
+    std::uint32_t direct;
+    std::uint32_t reserved;
+};
+
+struct FlatLoot {
+    double x;
+    double y;
+    std::int32_t type;
+    std::uint32_t collected;
+};
+
+struct FlatPlayer {
+    std::uint64_t dog_id;
+    StringRef token;
+    std::int32_t score;
+    std::uint32_t first_bag_loot;
+    std::uint32_t bag_loot_count;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(FlatCounts) == 40 && sizeof(FlatMap) == 16 && sizeof(FlatSession) == 16);
+static_assert(sizeof(FlatDog) == 56 && sizeof(FlatLoot) == 24 && sizeof(FlatPlayer) == 32);
+
+template <typename T>
+std::string_view AsBytes(const std::vector<T>& records) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    return std::string_view(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+}
+
+// Тело плоского снимка по секциям. Секции отдаются по очереди, без сборки тела в одну строку
+struct FlatPayload {
+    FlatCounts counts{};
+    std::vector<FlatMap> maps;
+    std::vector<FlatSession> sessions;
+    std::vector<FlatDog> dogs;
+    std::vector<FlatLoot> loots;
+    std::vector<FlatPlayer> players;
+    std::vector<FlatLoot> bag_loots;
+    std::string strings;
+
+    template <typename Fn>
+    void ForEachSection(Fn&& fn) const {
+        fn(std::string_view(reinterpret_cast<const char*>(&counts), sizeof(counts)));
+        fn(AsBytes(maps));
+        fn(AsBytes(sessions));
+        fn(AsBytes(dogs));
+        fn(AsBytes(loots));
+        fn(AsBytes(players));
+        fn(AsBytes(bag_loots));
+        fn(std::string_view(strings));
+    }
+};
+
+template <typename T>
+std::uint32_t CheckedCount(const std::vector<T>& records) {
+    if (records.size() > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::length_error("State snapshot section is too large");
+    }
+    return static_cast<std::uint32_t>(records.size());
+}
+
+FlatLoot ToFlatLoot(const LootRepr& loot) {
+    const Position pos = loot.GetPosition();
+    return FlatLoot{ pos.x, pos.y, loot.GetLootType(), loot.IsCollected() ? 1u : 0u };
+}
+
+FlatPayload EncodeFlatPayload(const SerializedData& data) {
+    const PlayersRepr::DogIdIndex players_index = data.GetPlayers().MakeDogIdIndex();
+
+    FlatPayload payload;
+    std::vector<FlatMap>& maps = payload.maps;
+    std::vector<FlatSession>& sessions = payload.sessions;
+    std::vector<FlatDog>& dogs = payload.dogs;
+    std::vector<FlatLoot>& loots = payload.loots;
+    std::vector<FlatPlayer>& players = payload.players;
+    std::vector<FlatLoot>& bag_loots = payload.bag_loots;
+    std::string& strings = payload.strings;
+    auto add_string = [&strings](std::string_view value) {
+        const StringRef ref{ static_cast<std::uint32_t>(strings.size()), static_cast<std::uint32_t>(value.size()) };
+        strings += value;
+        return ref;
+    };
+
+    for (const auto& [map_id, sessions_repr] : data.GetMapToSessions()) {
+        maps.push_back(FlatMap{ add_string(map_id), CheckedCount(sessions), static_cast<std::uint32_t>(sessions_repr.size()) });
+        for (const GameSessionRepr& session_repr : sessions_repr) {
+            sessions.push_back(FlatSession{ CheckedCount(dogs), static_cast<std::uint32_t>(session_repr.GetDogs().size()),
+                CheckedCount(loots), static_cast<std::uint32_t>(session_repr.GetLoots().size()) });
+            for (const LootRepr& loot_repr : session_repr.GetLoots()) {
+                loots.push_back(ToFlatLoot(loot_repr));
+            }
+            for (const DogRepr& dog_repr : session_repr.GetDogs()) {
+                auto it = players_index.find(dog_repr.GetId());
+                if (it == players_index.end()) {
+                    throw std::runtime_error("Can't save player by dog_id");
+                }
+                const PlayerRepr& player_repr = *it->second;
+
+                const Position pos = dog_repr.GetPosition();
+                const Velocity velocity = dog_repr.GetVelocity();
+                dogs.push_back(FlatDog{ pos.x, pos.y, velocity.x, velocity.y, dog_repr.GetId(), add_string(dog_repr.GetName()),
+                    static_cast<std::uint32_t>(dog_repr.GetDirect()), 0 });
+                players.push_back(FlatPlayer{ dog_repr.GetId(), add_string(player_repr.GetPlayerToken()), player_repr.GetPlayerScore(),
+                    CheckedCount(bag_loots), static_cast<std::uint32_t>(player_repr.GetPlayerLootVector().size()), 0 });
+                for (const LootRepr& loot_repr : player_repr.GetPlayerLootVector()) {
+                    bag_loots.push_back(ToFlatLoot(loot_repr));
+                }
+            }
+        }
+    }
+    if (strings.size() > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::length_error("State snapshot strings are too large");
+    }
+
+    payload.counts = FlatCounts{ data.GetJournalSeq(), CheckedCount(maps), CheckedCount(sessions), CheckedCount(dogs),
+        CheckedCount(loots), CheckedCount(bag_loots), static_cast<std::uint32_t>(strings.size()), data.GetTimeWithoutLoot() };
+    return payload;
+}
+
+// Массив записей внутри отображённого файла; записи не обязаны быть выровнены
+template <typename T>
+class FlatArray {
+public:
+    FlatArray() = default;
+
+    FlatArray(const char* data, size_t count)
+        : data_(data), count_(count) {}
+
+    size_t size() const noexcept {
+        return count_;
+    }
+
+    T operator[](size_t index) const noexcept {
+        T value;
+        std::memcpy(&value, data_ + index * sizeof(T), sizeof(T));
+        return value;
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t count_ = 0;
+};
+
+void CheckRange(std::uint64_t first, std::uint64_t count, size_t size) {
+    if (first + count > size) {
+        throw std::runtime_error("State snapshot section reference is out of range");
+    }
+}
+
+// Разметка тела проверяется один раз целиком, после чего записи читаются без проверок
+class FlatSnapshot {
+public:
+    FlatSnapshot(std::string_view payload, std::uint32_t format_version) {
+        const size_t counts_size = format_version == 2 ? FLAT_COUNTS_V2_SIZE : sizeof(FlatCounts);
+        if (payload.size() < counts_size) {
+            throw std::runtime_error("State snapshot is truncated");
+        }
+        std::memcpy(&counts_, payload.data(), counts_size);
+        const char* pos = payload.data() + counts_size;
+        const size_t expected_size = counts_size + size_t{ counts_.maps } * sizeof(FlatMap) + size_t{ counts_.sessions } * sizeof(FlatSession)
+            + size_t{ counts_.dogs } * (sizeof(FlatDog) + sizeof(FlatPlayer)) + (size_t{ counts_.loots } + counts_.bag_loots) * sizeof(FlatLoot)
+            + counts_.strings_size;
+        if (expected_size != payload.size()) {
+            throw std::runtime_error("State snapshot sections do not match its size");
+        }
+        maps_ = Take<FlatMap>(pos, counts_.maps);
+        sessions_ = Take<FlatSession>(pos, counts_.sessions);
+        dogs_ = Take<FlatDog>(pos, counts_.dogs);
+        loots_ = Take<FlatLoot>(pos, counts_.loots);
+        players_ = Take<FlatPlayer>(pos, counts_.dogs);
+        bag_loots_ = Take<FlatLoot>(pos, counts_.bag_loots);
+        strings_ = std::string_view(pos, counts_.strings_size);
+
+        for (size_t i = 0; i < maps_.size(); ++i) {
+            CheckRange(maps_[i].first_session, maps_[i].session_count, sessions_.size());
+        }
+        for (size_t i = 0; i < sessions_.size(); ++i) {
+            const FlatSession session = sessions_[i];
+            CheckRange(session.first_dog, session.dog_count, dogs_.size());
+            CheckRange(session.first_loot, session.loot_count, loots_.size());
+        }
+        for (size_t i = 0; i < players_.size(); ++i) {
+            CheckRange(players_[i].first_bag_loot, players_[i].bag_loot_count, bag_loots_.size());
+        }
+    }
+
+    std::uint64_t GetJournalSeq() const noexcept {
+        return counts_.journal_seq;
+    }
+
+    std::int64_t GetTimeWithoutLoot() const noexcept {
+        return counts_.time_without_loot;
+    }
+
+    const FlatArray<FlatMap>& GetMaps() const noexcept {
+        return maps_;
+    }
+
+    const FlatArray<FlatSession>& GetSessions() const noexcept {
+        return sessions_;
+    }
+
+    const FlatArray<FlatDog>& GetDogs() const noexcept {
+        return dogs_;
+    }
+
+    const FlatArray<FlatLoot>& GetLoots() const noexcept {
+        return loots_;
+    }
+
+    const FlatArray<FlatPlayer>& GetPlayers() const noexcept {
+        return players_;
+    }
+
+    const FlatArray<FlatLoot>& GetBagLoots() const noexcept {
+        return bag_loots_;
+    }
+
+    std::string_view GetString(StringRef ref) const {
+        CheckRange(ref.offset, ref.size, strings_.size());
+        return strings_.substr(ref.offset, ref.size);
+    }
+
+private:
+    template <typename T>
+    static FlatArray<T> Take(const char*& pos, size_t count) {
+        FlatArray<T> result(pos, count);
+        pos += count * sizeof(T);
+        return result;
+    }
+
+    FlatCounts counts_{};
+    FlatArray<FlatMap> maps_;
+    FlatArray<FlatSession> sessions_;
+    FlatArray<FlatDog> dogs_;
+    FlatArray<FlatLoot> loots_;
+    FlatArray<FlatPlayer> players_;
+    FlatArray<FlatLoot> bag_loots_;
+    std::string_view strings_;
+};
+
+Loot RestoreFlatLoot(const FlatLoot& flat) {
+    Loot loot{ flat.type, Position{ flat.x, flat.y } };
+    if (flat.collected) {
+        loot.SetCollected();
+    }
+    return loot;
+}
+
+// Токены в снимке и журнале хранятся текстом, как их видит клиент
+Token ParseStoredToken(std::string_view text) {
+    std::optional<Token> token = Token::FromString(text);
+    if (!token) {
+        throw std::runtime_error("Saved state has an invalid player token");
+    }
+    return *token;
+}
+
+struct RestoredPlayer {
+    Token token;
+    Player player;
+};
+
+struct MapRestoreTask {
+    std::vector<GameSession*> sessions;
+    std::vector<RestoredPlayer> players;
+    uint64_t max_dog_id = 0;
+};
+
+// Трогает только сессии своей карты, поэтому задачи разных карт можно выполнять параллельно
+void RestoreMapSessions(MapRestoreTask& task, const std::deque<GameSessionRepr>& sessions_repr, const PlayersRepr::DogIdIndex& players_index) {
+    for (size_t i = 0; i < task.sessions.size(); ++i) {
+        const GameSessionRepr& session_repr = sessions_repr[i];
+        GameSession& session = *task.sessions[i];
+
+        for (const LootRepr& loot_repr : session_repr.GetLoots()) {
+            session.AddExistLoot(loot_repr.Restore());
+        }
+
+        for (const DogRepr& dog_repr : session_repr.GetDogs()) {
+            std::shared_ptr<Dog> dog_ptr = std::make_shared<Dog>(dog_repr.Restore());
+            task.max_dog_id = std::max(task.max_dog_id, dog_ptr->GetId());
+            session.AddDog(dog_ptr);
+
+            auto it = players_index.find(dog_ptr->GetId());
+            if (it == players_index.end()) {
+                throw std::runtime_error("Can't recover player by dog_id");
+            }
+            const PlayerRepr& player_repr = *it->second;
+
+            Player player{};
+            player.SetDog(dog_ptr);
+            player.SetSession(&session);
+            for (const LootRepr& loot_repr : player_repr.GetPlayerLootVector()) {
+                player.TakeLoot(session.StoreLoot(loot_repr.Restore()));
+            }
+            player.SetScore(player_repr.GetPlayerScore());
+
+            task.players.push_back(RestoredPlayer{ ParseStoredToken(player_repr.GetPlayerToken()), std::move(player) });
+        }
+    }
+}
+
+// То же для плоского снимка: собака и её игрок берутся по одному индексу, без поиска
+void RestoreFlatMapSessions(MapRestoreTask& task, const FlatSnapshot& snapshot, const FlatMap& map) {
+    for (size_t i = 0; i < task.sessions.size(); ++i) {
+        const FlatSession flat_session = snapshot.GetSessions()[map.first_session + i];
+        GameSession& session = *task.sessions[i];
+
+        session.ReserveLoot(flat_session.loot_count);
+        for (size_t loot = flat_session.first_loot; loot < flat_session.first_loot + flat_session.loot_count; ++loot) {
+            session.AddExistLoot(RestoreFlatLoot(snapshot.GetLoots()[loot]));
+        }
+
+        task.players.reserve(task.players.size() + flat_session.dog_count);
+        for (size_t dog = flat_session.first_dog; dog < flat_session.first_dog + flat_session.dog_count; ++dog) {
+            const FlatDog flat_dog = snapshot.GetDogs()[dog];
+            const FlatPlayer flat_player = snapshot.GetPlayers()[dog];
+            if (flat_player.dog_id != flat_dog.id) {
+                throw std::runtime_error("Can't recover player by dog_id");
+            }
+            if (flat_dog.direct > static_cast<std::uint32_t>(Direct::EAST)) {
+                throw std::runtime_error("State snapshot has an invalid dog direction");
+            }
+
+            std::shared_ptr<Dog> dog_ptr = std::make_shared<Dog>(std::string(snapshot.GetString(flat_dog.name)), Position{ flat_dog.x, flat_dog.y },
+                Velocity{ flat_dog.velocity_x, flat_dog.velocity_y }, static_cast<Direct>(flat_dog.direct), flat_dog.id);
+            task.max_dog_id = std::max(task.max_dog_id, flat_dog.id);
+            session.AddDog(dog_ptr);
+
+            Player player{};
+            player.SetDog(dog_ptr);
+            player.SetSession(&session);
+            for (size_t loot = flat_player.first_bag_loot; loot < flat_player.first_bag_loot + flat_player.bag_loot_count; ++loot) {
+                player.TakeLoot(session.StoreLoot(RestoreFlatLoot(snapshot.GetBagLoots()[loot])));
+            }
+            player.SetScore(flat_player.score);
+
+            task.players.push_back(RestoredPlayer{ ParseStoredToken(snapshot.GetString(flat_player.token)), std::move(player) });
+        }
+    }
+}
+
+// Выполняет fn(0) ... fn(count - 1) в threads потоках и пробрасывает первое исключение
+template <typename Fn>
+void ForEachParallel(size_t count, unsigned threads, Fn fn) {
+    threads = static_cast<unsigned>(std::min<size_t>(threads, count));
+    if (threads <= 1) {
+        for (size_t index = 0; index < count; ++index) {
+            fn(index);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next_index = 0;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back([&] {
+            for (size_t index = next_index++; index < count; index = next_index++) {
+                try {
+                    fn(index);
+                }
+                catch (...) {
+                    std::lock_guard lock(error_mutex);
+                    error = std::current_exception();
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// Контейнеры Game меняются только в вызывающем потоке: сессии создаются до запуска задач, игроки добавляются после
+MapRestoreTask MakeMapRestoreTask(Game& game, std::string_view map_id, size_t session_count) {
+    const Map* map = game.FindMap(Map::Id{ std::string(map_id) });
+    if (!map) {
+        throw std::invalid_argument("Unknown map id");
+    }
+    MapRestoreTask task;
+    task.sessions.reserve(session_count);
+    for (size_t i = 0; i < session_count; ++i) {
+        task.sessions.push_back(&game.AddSession(map->GetIndex()));
+    }
+    return task;
+}
+
+void AddRestoredPlayers(Game& game, const std::vector<MapRestoreTask>& tasks, size_t player_count) {
+    game.ReservePlayers(player_count);
+    for (const MapRestoreTask& task : tasks) {
+        if (!task.players.empty()) {
+            Dog::ReserveId(task.max_dog_id);
+        }
+        for (const RestoredPlayer& restored : task.players) {
+            game.AddExistPlayer(restored.player, restored.token);
+        }
+    }
+}
+
+std::uint64_t RestoreFlatSnapshot(const FlatSnapshot& snapshot, Game& game, unsigned threads) {
+    const FlatArray<FlatMap>& maps = snapshot.GetMaps();
+    std::vector<MapRestoreTask> tasks;
+    tasks.reserve(maps.size());
+    for (size_t i = 0; i < maps.size(); ++i) {
+        tasks.push_back(MakeMapRestoreTask(game, snapshot.GetString(maps[i].id), maps[i].session_count));
+    }
+
+    ForEachParallel(tasks.size(), threads, [&](size_t index) {
+        RestoreFlatMapSessions(tasks[index], snapshot, maps[index]);
+    });
+
+    AddRestoredPlayers(game, tasks, snapshot.GetDogs().size());
+    game.SetTimeWithoutLoot(std::chrono::milliseconds{ snapshot.GetTimeWithoutLoot() });
+    return snapshot.GetJournalSeq();
+}
+
+SerializedData ReadArchive(std::string_view payload, bool binary) {
+    std::istringstream input(std::string(payload), binary ? std::ios::in | std::ios::binary : std::ios::in);
+    SerializedData data;
+    if (binary) {
+        boost::archive::binary_iarchive ia(input);
+        ia >> data;
+    }
+    else {
+        boost::archive::text_iarchive ia(input);
+        ia >> data;
+    }
+    return data;
+}
+
+}  // namespace
+
+void SerializedData::Restore(Game& game, unsigned threads) const {
+    const PlayersRepr::DogIdIndex players_index = players_.MakeDogIdIndex();
+
+    std::vector<MapRestoreTask> tasks;
+    std::vector<const std::deque<GameSessionRepr>*> sources;
+    tasks.reserve(map_to_sessions_.size());
+    sources.reserve(map_to_sessions_.size());
+    for (const auto& [string_map_id, sessions_repr] : map_to_sessions_) {
+        tasks.push_back(MakeMapRestoreTask(game, string_map_id, sessions_repr.size()));
+        sources.push_back(&sessions_repr);
+    }
+
+    ForEachParallel(tasks.size(), threads, [&](size_t index) {
+        RestoreMapSessions(tasks[index], *sources[index], players_index);
+    });
+
+    AddRestoredPlayers(game, tasks, players_.GetCount());
+    game.SetTimeWithoutLoot(std::chrono::milliseconds{ time_without_loot_ });
+}
+
+void WriteSnapshot(std::ostream& out, const SerializedData& data, int compression_level) {
+    const FlatPayload payload = EncodeFlatPayload(data);
+
+    SnapshotHeader header;
+    if (compression_level != 0) {
+        // Секции сжимаются по одной: кроме самих записей в памяти держится только сжатое тело
+        Deflater deflater(compression_level);
+        payload.ForEachSection([&deflater](std::string_view section) {
+            deflater.Write(section);
+        });
+        const std::string compressed = deflater.Finish();
+        header.flags |= SNAPSHOT_FLAG_DEFLATE;
+        header.payload_size = compressed.size();
+        header.payload_crc = Crc32(compressed);
+        WriteHeader(out, header);
+        out.write(compressed.data(), static_cast<std::streamsize>(compressed.size()));
+    }
+    else {
+        // Заголовок с размером и контрольной суммой идёт первым, поэтому секции проходятся дважды
+        boost::crc_32_type crc;
+        payload.ForEachSection([&header, &crc](std::string_view section) {
+            header.payload_size += section.size();
+            crc.process_bytes(section.data(), section.size());
+        });
+        header.payload_crc = crc.checksum();
+        WriteHeader(out, header);
+        payload.ForEachSection([&out](std::string_view section) {
+            out.write(section.data(), static_cast<std::streamsize>(section.size()));
+        });
+    }
+    if (!out) {
+        throw std::runtime_error("Failed to write state snapshot");
+    }
+}
+
+std::uint64_t RestoreSnapshot(std::string_view content, Game& game, unsigned threads) {
+    if (content.size() < SNAPSHOT_HEADER_SIZE
+        || !std::equal(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC), content.begin())) {
+        // Снимок, сохранённый до появления двоичного формата
+        const SerializedData data = ReadArchive(content, false);
+        data.Restore(game, threads);
+        return data.GetJournalSeq();
+    }
+
+    const SnapshotHeader header = ParseHeader(content.data());
+    if (header.payload_size != content.size() - SNAPSHOT_HEADER_SIZE) {
+        throw std::runtime_error("State snapshot is truncated");
+    }
+    std::string_view payload = content.substr(SNAPSHOT_HEADER_SIZE);
+    if (Crc32(payload) != header.payload_crc) {
+        throw std::runtime_error("State snapshot checksum mismatch");
+    }
+    if (header.flags & ~SNAPSHOT_FLAG_DEFLATE) {
+        throw std::runtime_error("Unsupported state snapshot flags");
+    }
+    // Сжатое тело распаковывается в память, несжатое читается прямо из отображённого файла
+    std::string inflated;
+    if (header.flags & SNAPSHOT_FLAG_DEFLATE) {
+        inflated = Inflate(payload);
+        payload = inflated;
+    }
+
+    switch (header.format_version) {
+    case 1: {
+        const SerializedData data = ReadArchive(payload, true);
+        data.Restore(game, threads);
+        return data.GetJournalSeq();
+    }
+    case 2:
+    case SNAPSHOT_FORMAT_VERSION:
+        return RestoreFlatSnapshot(FlatSnapshot(payload, header.format_version), game, threads);
+    }
+    throw std::runtime_error("Unsupported state snapshot version");
+}
+
+std::uint64_t RestoreSnapshotFile(const std::filesystem::path& path, Game& game, unsigned threads) {
+    const durable_file::MappedFile file(path);
+    return RestoreSnapshot(file.GetData(), game, threads);
+}
+
+void WriteSnapshotFile(const std::filesystem::path& path, const SerializedData& data, int compression_level) {
+    std::ostringstream content(std::ios::binary);
+    WriteSnapshot(content, data, compression_level);
+
+    std::filesystem::path tmp_path = path;
+    tmp_path += ".tmp";
+    try {
+        durable_file::WriteAndSync(tmp_path, content.view());
+        std::filesystem::rename(tmp_path, path);
+    }
+    catch (...) {
+        std::error_code ec;
+        std::filesystem::remove(tmp_path, ec);
+        throw;
+    }
+    durable_file::SyncDirectory(path.parent_path());
+}
+
+std::uint64_t ReplayJournal(Game& game, const std::vector<journal::Entry>& entries, std::uint64_t after_seq) {
+    std::uint64_t last_seq = after_seq;
+    for (const journal::Entry& entry : entries) {
+        // За разрывом номеров записи применять нельзя: игра разошлась бы с той, что их записала
+        if (entry.seq != last_seq + 1) {
+            break;
+        }
+        std::visit([&game](const auto& record) {
+            using T = std::decay_t<decltype(record)>;
+            if constexpr (std::is_same_v<T, journal::JoinRecord>) {
+                // Позиция записана, поэтому случайный спавн не нужно повторять
+                GameSession& session = game.GetSession(Map::Id{ record.map_id });
+                std::shared_ptr<Dog> dog_ptr = std::make_shared<Dog>(record.dog_name, Position{ record.x, record.y }, Velocity{ 0., 0. }, Direct::NORTH, record.dog_id);
+                Dog::ReserveId(record.dog_id);
+                session.AddDog(dog_ptr);
+
+                Player player{};
+                player.SetDog(dog_ptr);
+                player.SetSession(&session);
+                game.AddExistPlayer(player, ParseStoredToken(record.token));
+            }
+            else if constexpr (std::is_same_v<T, journal::MoveRecord>) {
+                const Token token = ParseStoredToken(record.token);
+                if (Player* player = game.FindPlayerByToken(token); player) {
+                    game.MovePlayer(token, *player, record.move);
+                }
+            }
+            else if constexpr (std::is_same_v<T, journal::RetireRecord>) {
+                game.RetirePlayer(ParseStoredToken(record.token));
+            }
+            else {
+                // В записях старого формата нет состояния генератора трофеев: тогда берётся текущее
+                TickInputs inputs = game.MakeTickInputs(record.seed);
+                if (record.generate_loot && record.time_without_loot) {
+                    inputs.generate_loot = *record.generate_loot;
+                    inputs.time_without_loot = std::chrono::milliseconds{ *record.time_without_loot };
+                }
+                game.ReplayTick(record.time_delta, inputs);
+            }
+        }, entry.record);
+        last_seq = entry.seq;
+    }
+    return last_seq;
+}
+
+SnapshotWriter::SnapshotWriter(std::filesystem::path state_file_path, WrittenHandler on_written, int compression_level)
+    : state_file_path_(std::move(state_file_path))
+    , on_written_(std::move(on_written))
+    , compression_level_(compression_level) {}
+
+SnapshotWriter::~SnapshotWriter() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void SnapshotWriter::Submit(SerializedData data) {
+    {
+        std::lock_guard lock(mutex_);
+        pending_ = std::move(data);
+        if (!thread_.joinable()) {
+            thread_ = std::thread([this] { Run(); });
+        }
+    }
+    cv_.notify_all();
+}
+
+void SnapshotWriter::Flush() {
+    std::unique_lock lock(mutex_);
+    cv_.wait(lock, [this] { return !pending_ && !writing_; });
+    if (error_) {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+std::exception_ptr SnapshotWriter::TakeError() {
+    std::lock_guard lock(mutex_);
+    return std::exchange(error_, nullptr);
+}
+
+void SnapshotWriter::Run() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return pending_ || stop_; });
+        if (!pending_) {
+            return;
+        }
+        SerializedData data = std::move(*pending_);
+        pending_.reset();
+        writing_ = true;
+        lock.unlock();
+
+        std::exception_ptr error;
+        try {
+            WriteSnapshotFile(state_file_path_, data, compression_level_);
+            if (on_written_) {
+                on_written_(data);
+            }
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        writing_ = false;
+        if (error) {
+            error_ = error;
+        }
+        cv_.notify_all();
+    }
+}
+
+}  // namespace serialization
@@ -6,13 +6,29 @@
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 
+#include <boost/serialization/version.hpp>
+
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
 
 #include <iostream>
+#include <istream>
+#include <ostream>
 
 #include "model.h"
+#include "action_journal.h"
+#include "metrics.h"
 
 
 namespace serialization {
@@ -42,7 +58,25 @@ namespace serialization {
             return Dog{ dog_name_, position_, velocity_, direct_, id_ };
         }
 
+        const std::string& GetName() const noexcept {
+            return dog_name_;
+        }
+
+        Position GetPosition() const noexcept {
+            return position_;
+        }
+
+        Velocity GetVelocity() const noexcept {
+            return velocity_;
+        }
+
+        Direct GetDirect() const noexcept {
+            return direct_;
+        }
 
+        std::uint64_t GetId() const noexcept {
+            return id_;
+        }
 
         template <typename Archive>
         void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
@@ -77,6 +111,18 @@ namespace serialization {
             return loot;
         }
 
+        int GetLootType() const noexcept {
+            return loot_type_;
+        }
+
+        Position GetPosition() const noexcept {
+            return pos_;
+        }
+
+        bool IsCollected() const noexcept {
+            return is_collected_;
+        }
+
         template <typename Archive>
         void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
             ar& loot_type_;
@@ -96,9 +142,8 @@ namespace serialization {
         PlayerRepr() = default;
         explicit PlayerRepr(const Player& player, std::string token)
             : score_(player.GetScore()), token_(token), id_(player.GetId()) {
-            for (std::shared_ptr<Loot> loot : player.GetLootVector()) {
-                LootRepr loot_repr(*loot);
-                loots_.emplace_back(loot_repr);
+            for (LootHandle handle : player.GetLootHandles()) {
+                loots_.emplace_back(player.GetSessionPtr()->GetLoot(handle));
             }
         }
 
@@ -138,23 +183,25 @@ namespace serialization {
 
         PlayersRepr() = default;
         explicit PlayersRepr(const Players& players) {
-            for (const auto& [token, player_ptr] : players.GetTokenToPlayer()) {
-                PlayerRepr player_repr(*player_ptr, *token);
-                players_.emplace_back(player_repr);
-            }
+            players.GetTokenToPlayer().ForEach([this](const Token& token, const Player* player_ptr) {
+                players_.emplace_back(*player_ptr, token.ToString());
+            });
         }
 
-        const PlayerRepr& GetPlayerByDogId(uint64_t dog_id) const {
-            const std::vector<PlayerRepr>::const_iterator it = std::find_if(players_.begin(), players_.end(), [dog_id](const PlayerRepr& player) {
-                return player.GetPlayerId() == dog_id;
-            });
+        using DogIdIndex = std::unordered_map<uint64_t, const PlayerRepr*>;
 
-            if (it != players_.end()) {
-                return *it;
-            }
-            else {
-                throw std::runtime_error("Can't recover player by dog_id");
+        // Индекс строится один раз на восстановление, чтобы не искать игрока перебором для каждой собаки
+        DogIdIndex MakeDogIdIndex() const {
+            DogIdIndex index;
+            index.reserve(players_.size());
+            for (const PlayerRepr& player : players_) {
+                index.emplace(player.GetPlayerId(), &player);
             }
+            return index;
+        }
+
+        size_t GetCount() const noexcept {
+            return players_.size();
         }
 
         template <typename Archive>
@@ -175,9 +222,8 @@ namespace serialization {
                 DogRepr dog_repr{ *dog };
                 dogs_.emplace_back(dog_repr);
             }
-            for (std::shared_ptr loot : session.GetLootVector()) {
-                LootRepr loot_repr{ *loot };
-                loots_.emplace_back(loot_repr);
+            for (LootHandle handle : session.GetLootHandles()) {
+                loots_.emplace_back(session.GetLoot(handle));
             }
         }
 
@@ -206,119 +252,318 @@ namespace serialization {
         SerializedData() = default;
 
         explicit SerializedData(const Game& game)
-            :players_(game.GetPlayersClass()) {
-            for (const auto& [map_id, sessions] : game.GetMapIdToSession()) {
-                for (const GameSession& session : sessions) {
+            :players_(game.GetPlayersClass())
+            , time_without_loot_(game.GetTimeWithoutLoot().count()) {
+            for (const Map& map : game.GetMaps()) {
+                for (const GameSession& session : game.GetMapSessions()[map.GetIndex()]) {
                     GameSessionRepr session_repr(session);
-                    map_to_sessions_[*map_id].emplace_back(session_repr);
+                    map_to_sessions_[*map.GetId()].emplace_back(session_repr);
                 }
             }
         }
 
-        void Restore(Game& game) const {
-
-            for (const auto& [string_map_id, sessions_repr] : map_to_sessions_) {
-                for (const GameSessionRepr& session_repr : sessions_repr) {
-                    GameSession& session = game.GetSession(Map::Id{ string_map_id });
-
-                    for (const LootRepr& loot_repr : session_repr.GetLoots()) {
-                        std::shared_ptr<Loot> loot_ptr = std::make_shared<Loot>(loot_repr.Restore());
-                        session.AddExistLoot(loot_ptr);
-                    }
+        /*
+         * Сессии создаются заново в сохранённом порядке, без поиска свободных мест.
+         * При threads > 1 карты восстанавливаются параллельно, а игроки затем
+         * добавляются в Game одним потоком.
+         */
+        void Restore(Game& game, unsigned threads = 1) const;
 
-                    for (const DogRepr& dog_repr : session_repr.GetDogs()) {
-                        std::shared_ptr<Dog> dog_ptr = std::make_shared<Dog>(dog_repr.Restore());
-                        session.AddDog(dog_ptr);
-
-                        Player player{};
-                        player.SetDog(dog_ptr);
-                        player.SetSession(&session);
+        const std::unordered_map<std::string, std::deque<GameSessionRepr>>& GetMapToSessions() const noexcept {
+            return map_to_sessions_;
+        }
 
-                        const PlayerRepr& player_repr = players_.GetPlayerByDogId(dog_ptr->GetId());
+        const PlayersRepr& GetPlayers() const noexcept {
+            return players_;
+        }
 
-                        for (const LootRepr& loot_repr : player_repr.GetPlayerLootVector()) {
-                            player.TakeLoot(std::make_shared<Loot>(loot_repr.Restore()));
-                        }
-                        player.SetScore(player_repr.GetPlayerScore());
+        // Номер последней записи журнала действий, учтённой в снимке
+        std::uint64_t GetJournalSeq() const noexcept {
+            return journal_seq_;
+        }
 
-                        game.AddExistPlayer(player, Token{ player_repr.GetPlayerToken() });
+        void SetJournalSeq(std::uint64_t seq) noexcept {
+            journal_seq_ = seq;
+        }
 
-                    }
-                }
-            }
+        // Состояние общего генератора трофеев, мс
+        std::int64_t GetTimeWithoutLoot() const noexcept {
+            return time_without_loot_;
         }
 
         template <typename Archive>
         void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
             ar& map_to_sessions_;
             ar& players_;
+            if (version >= 1) {
+                ar& journal_seq_;
+            }
+            if (version >= 2) {
+                ar& time_without_loot_;
+            }
         }
 
     private:
         std::unordered_map<std::string, std::deque<GameSessionRepr>> map_to_sessions_;
         PlayersRepr players_;
+        std::uint64_t journal_seq_ = 0;
+        std::int64_t time_without_loot_ = 0;
     };
 
-    class SerializingListener : public ApplicationListener {
+    /*
+     * Двоичный снимок: заголовок фиксированного размера в little-endian
+     *   magic[8] | версия формата u32 | флаги u32 | размер тела u64 | CRC32 тела u32
+     * В версии 1 тело - binary_oarchive с SerializedData. В версии 2 тело состоит из
+     * плоских массивов записей фиксированного размера (карты, сессии, собаки, трофеи,
+     * игроки, трофеи в рюкзаках) и общего блока строк, которые читаются прямо из
+     * отображённого в память файла без разбора архива. Версия 3 добавляет в заголовок
+     * тела состояние генератора трофеев.
+     * С флагом SNAPSHOT_FLAG_DEFLATE тело сжато zlib; размер и CRC32 в заголовке относятся к сжатому телу.
+     */
+    inline constexpr char SNAPSHOT_MAGIC[8] = { 'D', 'O', 'G', 'S', 'N', 'A', 'P', '\0' };
+    inline constexpr std::uint32_t SNAPSHOT_FORMAT_VERSION = 3;
+    inline constexpr std::uint32_t SNAPSHOT_FLAG_DEFLATE = 1;
+
+    // compression_level - уровень zlib от 1 (быстрее) до 9 (меньше), 0 - без сжатия
+    void WriteSnapshot(std::ostream& out, const SerializedData& data, int compression_level = 0);
+
+    /*
+     * Восстанавливает игру из содержимого снимка любой версии; файл без заголовка
+     * разбирается как текстовый архив. Возвращает номер записи журнала, учтённой в снимке.
+     */
+    std::uint64_t RestoreSnapshot(std::string_view content, Game& game, unsigned threads = 1);
+
+    // То же для файла, отображённого в память
+    std::uint64_t RestoreSnapshotFile(const std::filesystem::path& path, Game& game, unsigned threads = 1);
+
+    /*
+     * Применяет записи журнала, следующие за записью after_seq, к восстановленной из снимка игре.
+     * Останавливается на первом разрыве номеров. Возвращает номер последней применённой записи
+     * или after_seq, если не применено ни одной.
+     */
+    std::uint64_t ReplayJournal(Game& game, const std::vector<journal::Entry>& entries, std::uint64_t after_seq);
+
+    // Записывает снимок во временный файл, делает fsync и атомарно переименовывает его в path
+    void WriteSnapshotFile(const std::filesystem::path& path, const SerializedData& data, int compression_level = 0);
+
+    /*
+     * Фоновый поток записи снимков. Тик только копирует состояние в SerializedData,
+     * а кодирование и запись на диск выполняются здесь.
+     * Пока идёт запись, новый снимок заменяет ожидающий, а не встаёт в очередь.
+     */
+    class SnapshotWriter {
     public:
-        SerializingListener() = default;
+        // on_written вызывается из фонового потока после того, как снимок надёжно записан
+        using WrittenHandler = std::function<void(const SerializedData& data)>;
+
+        explicit SnapshotWriter(std::filesystem::path state_file_path, WrittenHandler on_written = {}, int compression_level = 0);
+
+        SnapshotWriter(const SnapshotWriter&) = delete;
+        SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+        // Дописывает ожидающий снимок и останавливает поток
+        ~SnapshotWriter();
+
+        void Submit(SerializedData data);
 
-        SerializingListener(std::chrono::milliseconds save_period, Game& game, const std::filesystem::path& state_file_path)
-            :save_period_(save_period), game_(game), state_file_path_(state_file_path) {}
+        // Ошибка фоновой записи, если она ещё не была получена
+        std::exception_ptr TakeError();
+
+        // Ждёт, пока все переданные снимки будут записаны. Бросает ещё не полученную ошибку записи
+        void Flush();
+
+    private:
+        void Run();
+
+        const std::filesystem::path state_file_path_;
+        const WrittenHandler on_written_;
+        const int compression_level_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::optional<SerializedData> pending_;
+        bool writing_ = false;
+        bool stop_ = false;
+        std::exception_ptr error_;
+        // Поток запускается при первом снимке
+        std::thread thread_;
+    };
+
+    /*
+     * Сохраняет состояние игры снимками раз в save_period. С журналом действий
+     * каждый тик дописывает в журнал входные события, и после сбоя теряется не больше одного тика.
+     * Ошибки фоновой записи не прерывают тик: они передаются обработчику ошибок, а после ошибки
+     * журнала делается внеочередной снимок, с которого журнал продолжается в новом сегменте.
+     */
+    class SerializingListener : public ApplicationListener {
+    public:
+        // source - "journal" или "snapshot"; вызывается из strand игры
+        using ErrorHandler = std::function<void(std::string_view source, std::exception_ptr error)>;
+
+        // Повторный внеочередной снимок после ошибки журнала делается не чаще этого периода
+        static constexpr std::chrono::milliseconds JOURNAL_RECOVERY_PERIOD{ 1000 };
+
+        SerializingListener(std::chrono::milliseconds save_period, Game& game, const std::filesystem::path& state_file_path, bool use_journal = false,
+            int compression_level = 0)
+            : save_period_(save_period)
+            , game_(game)
+            , state_file_path_(state_file_path)
+            , journal_(MakeJournal(state_file_path, use_journal))
+            , writer_(state_file_path, [this](const SerializedData& data) {
+                if (journal_) {
+                    journal_->RemoveSegmentsUpTo(data.GetJournalSeq());
+                }
+            }, compression_level) {}
 
         virtual ~SerializingListener() = default;
 
+        void SetErrorHandler(ErrorHandler handler) {
+            error_handler_ = std::move(handler);
+        }
+
         void OnTick(int64_t time_delta) override {
-            if (save_period_ == std::chrono::milliseconds{ 0 }) {
+            if (restoring_) {
                 return;
             }
-            time_since_save_ += std::chrono::milliseconds{ time_delta };
-            if (time_since_save_ > save_period_) {
-                SaveStateGame();
+            // Ошибки прошлых записей забираются отдельно от передачи новых, чтобы не терять ни снимок, ни события тика
+            if (std::exception_ptr error = writer_.TakeError()) {
+                ReportError("snapshot", error);
+            }
+            bool save_now = false;
+            time_since_recovery_ += std::chrono::milliseconds{ time_delta };
+            if (journal_) {
+                if (std::exception_ptr error = journal_->TakeError()) {
+                    ReportError("journal", error);
+                    // Записи после ошибки потеряны: их покроет снимок, после которого журнал пойдёт в новый сегмент
+                    journal_recovery_due_ = true;
+                }
+                if (journal_recovery_due_ && time_since_recovery_ >= JOURNAL_RECOVERY_PERIOD) {
+                    save_now = true;
+                    journal_recovery_due_ = false;
+                    time_since_recovery_ = std::chrono::milliseconds{ 0 };
+                }
+                const TickInputs& inputs = game_.GetTickInputs();
+                journal_->Append(journal::TickRecord{ time_delta, inputs.seed, inputs.generate_loot, inputs.time_without_loot.count() });
+            }
+            if (save_period_ != std::chrono::milliseconds{ 0 }) {
+                time_since_save_ += std::chrono::milliseconds{ time_delta };
+                save_now = save_now || time_since_save_ > save_period_;
+            }
+            if (save_now) {
+                // В strand игры только копируем состояние, запись идёт в фоне
+                writer_.Submit(CaptureState());
                 time_since_save_ = std::chrono::milliseconds{ 0 };
             }
+            if (journal_) {
+                // Групповая фиксация всех событий тика
+                journal_->Commit();
+            }
+        }
+
+        void OnJoin(const Token& token, const Player& player) override {
+            if (journal_ && !restoring_) {
+                const Position pos = player.GetPetPosition();
+                journal_->Append(journal::JoinRecord{ token.ToString(), player.GetPetName(), *player.GetSessionPtr()->GetMapId(), player.GetId(), pos.x, pos.y });
+            }
         }
 
-        void SaveStateGame() const {
+        void OnMove(const Token& token, std::string_view move) override {
+            if (journal_ && !restoring_) {
+                journal_->Append(journal::MoveRecord{ token.ToString(), std::string(move) });
+            }
+        }
 
-            std::filesystem::path tmp_path = state_file_path_;
-            tmp_path += ".tmp";
-            std::ofstream ofs(tmp_path);
+        void OnRetire(const Token& token) override {
+            if (journal_ && !restoring_) {
+                journal_->Append(journal::RetireRecord{ token.ToString() });
+            }
+        }
 
-            if (!ofs.is_open()) {
-                throw std::runtime_error("Failed to open state file");
+        // Синхронное сохранение при остановке сервера
+        void SaveStateGame() {
+            writer_.Submit(CaptureState());
+            writer_.Flush();
+            if (journal_) {
+                journal_->Flush();
             }
-            boost::archive::text_oarchive oa(ofs);
+        }
 
-            SerializedData data(game_);
-            oa << data;
+        // Загружает последний снимок и воспроизводит хвост журнала после него; threads - потоки восстановления карт
+        void RestoreGame(Game& game, unsigned threads = 1) {
+            restoring_ = true;
+            std::uint64_t journal_seq = 0;
+            if (std::filesystem::exists(state_file_path_)) {
+                journal_seq = RestoreSnapshotFile(state_file_path_, game, threads);
+            }
+            if (journal_) {
+                const std::vector<journal::Entry> entries = journal_->ReadAfter(journal_seq);
+                journal_seq = ReplayJournal(game, entries, journal_seq);
+                if (!entries.empty() && entries.back().seq != journal_seq) {
+                    ReportError("journal", std::make_exception_ptr(std::runtime_error(
+                        "Action journal has a gap after record " + std::to_string(journal_seq) + ", later records are discarded")));
+                    // Хвост за разрывом не применить: состояние сохраняется снимком, и журнал начинается заново
+                    SerializedData data(game);
+                    data.SetJournalSeq(journal_seq);
+                    writer_.Submit(std::move(data));
+                    writer_.Flush();
+                    journal_->RemoveSegmentsAfter(journal_seq);
+                }
+                journal_->Open(journal_seq + 1);
+            }
+            restoring_ = false;
+        }
 
-            ofs.close();
-            try {
-                std::filesystem::rename(tmp_path, state_file_path_);
+    private:
+        static std::unique_ptr<journal::ActionJournal> MakeJournal(const std::filesystem::path& state_file_path, bool use_journal) {
+            if (!use_journal) {
+                return nullptr;
             }
-            catch (const std::filesystem::filesystem_error& e) {
-                std::filesystem::remove(tmp_path);
+            std::filesystem::path journal_path = state_file_path;
+            journal_path += ".journal";
+            return std::make_unique<journal::ActionJournal>(journal_path);
+        }
+
+        // Снимок покрывает журнал до текущей записи; дальнейшие записи пойдут в новый сегмент
+        SerializedData CaptureState() {
+            SerializedData data(game_);
+            if (journal_) {
+                data.SetJournalSeq(journal_->GetLastSeq());
+                journal_->Rotate();
             }
+            return data;
         }
 
-        void RestoreGame(Game& game) const {
-            std::ifstream ifs(state_file_path_);
-            
-            if (!ifs.is_open()) {
-                return;
+        void ReportError(std::string_view source, std::exception_ptr error) {
+            (source == "journal" ? journal_errors_ : snapshot_errors_).Add();
+            if (error_handler_) {
+                error_handler_(source, error);
             }
-            boost::archive::text_iarchive ia(ifs);
-            SerializedData data;
-            ia >> data;
-            data.Restore(game);
         }
 
-    private:
         std::chrono::milliseconds time_since_save_ = std::chrono::milliseconds{ 0 };
         std::chrono::milliseconds save_period_;
+        // Первый внеочередной снимок после ошибки журнала делается сразу
+        std::chrono::milliseconds time_since_recovery_ = JOURNAL_RECOVERY_PERIOD;
+        bool journal_recovery_due_ = false;
+        ErrorHandler error_handler_;
         Game& game_;
         const std::filesystem::path state_file_path_;
+        bool restoring_ = false;
+        // Объявлен до writer_, чтобы пережить его фоновый поток
+        std::unique_ptr<journal::ActionJournal> journal_;
+        SnapshotWriter writer_;
+
+        metrics::Counter journal_errors_ = metrics::Registry::Instance().AddCounter(
+            "state_journal_errors_total", "Failed action journal writes; the journal restarts from a new snapshot");
+        metrics::Counter snapshot_errors_ = metrics::Registry::Instance().AddCounter(
+            "state_snapshot_errors_total", "Failed background state snapshot writes");
     };
 
-}  
+}
+
+// Версии классов записываются в архив; при изменении полей версию нужно поднять и учесть в serialize
+BOOST_CLASS_VERSION(::serialization::DogRepr, 0)
+BOOST_CLASS_VERSION(::serialization::LootRepr, 0)
+BOOST_CLASS_VERSION(::serialization::PlayerRepr, 0)
+BOOST_CLASS_VERSION(::serialization::PlayersRepr, 0)
+BOOST_CLASS_VERSION(::serialization::GameSessionRepr, 0)
+BOOST_CLASS_VERSION(::serialization::SerializedData, 2)
@@ -1,80 +1,400 @@
 #include "postgresql.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <future>
+
 namespace postgre {
 
+    namespace {
+
+        //   ;        
+        constexpr auto SAVE_RECORD = "save_record"_zv;
+        constexpr auto GET_RECORDS = "get_records"_zv;
+        constexpr auto GET_FIRST_PAGE = "get_first_page"_zv;
+        constexpr auto GET_PAGE_AFTER = "get_page_after"_zv;
+        constexpr auto ADD_TO_SUMMARY = "add_to_summary"_zv;
+        constexpr auto TRIM_SUMMARY = "trim_summary"_zv;
+        constexpr auto GET_SUMMARY = "get_summary"_zv;
+
+        constexpr int64_t DAY_MS = 24 * 60 * 60 * 1000;
+
+        std::string_view WindowName(model::RecordsWindow window) {
+            return window == model::RecordsWindow::DAY ? "day"sv : "week"sv;
+        }
+
+        struct PartitionRange {
+            int64_t start = 0;
+            std::string name;
+            std::string from;
+            std::string to;
+        };
+
+        std::string FormatDate(std::chrono::year_month_day date) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%04d-%02u-%02u 00:00:00+00",
+                static_cast<int>(date.year()), static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()));
+            return buffer;
+        }
+
+        PartitionRange GetPartitionRange(Partitioning partitioning, int64_t time_ms) {
+            using namespace std::chrono;
+            const sys_days day{ days{ model::GetWindowStart(model::RecordsWindow::DAY, time_ms) / DAY_MS } };
+            year_month_day from{ day };
+            year_month_day to = year_month_day{ day + days{ 1 } };
+            if (partitioning == Partitioning::MONTH) {
+                from = from.year() / from.month() / 1;
+                to = from + months{ 1 };
+            }
+
+            PartitionRange range;
+            range.start = duration_cast<milliseconds>(sys_days{ from }.time_since_epoch()).count();
+            range.from = FormatDate(from);
+            range.to = FormatDate(to);
+            char name[48];
+            if (partitioning == Partitioning::MONTH) {
+                std::snprintf(name, sizeof(name), "retired_players_%04d%02u", static_cast<int>(from.year()), static_cast<unsigned>(from.month()));
+            }
+            else {
+                std::snprintf(name, sizeof(name), "retired_players_%04d%02u%02u",
+                    static_cast<int>(from.year()), static_cast<unsigned>(from.month()), static_cast<unsigned>(from.day()));
+            }
+            range.name = name;
+            return range;
+        }
+
+        //      ,       
+        std::string CreateSchema(const char* db_url, Partitioning partitioning) {
+            pqxx::connection conn(db_url);
+            pqxx::work w(conn);
+            if (partitioning == Partitioning::NONE) {
+                w.exec(
+                    "CREATE TABLE IF NOT EXISTS retired_players (id UUID CONSTRAINT player_id PRIMARY KEY, "
+                    "name varchar(100) NOT NULL, "
+                    "score integer, "
+                    "play_time_ms integer);"_zv);
+                w.exec(
+                    "ALTER TABLE retired_players ADD COLUMN IF NOT EXISTS retired_at timestamptz NOT NULL DEFAULT now();"_zv);
+            }
+            else {
+                const auto kind = w.query_value<std::string>(
+                    "SELECT COALESCE((SELECT relkind::text FROM pg_class WHERE oid = to_regclass('retired_players')), '');"_zv);
+                if (!kind.empty() && kind != "p"s) {
+                    throw std::runtime_error("Table retired_players exists and is not partitioned");
+                }
+                //          
+                w.exec(
+                    "CREATE TABLE IF NOT EXISTS retired_players (id UUID NOT NULL, "
+                    "name varchar(100) NOT NULL, "
+                    "score integer, "
+                    "play_time_ms integer, "
+                    "retired_at timestamptz NOT NULL DEFAULT now(), "
+                    "PRIMARY KEY (id, retired_at)) PARTITION BY RANGE (retired_at);"_zv);
+            }
+
+            w.exec(
+                "CREATE INDEX IF NOT EXISTS record_players ON retired_players (score DESC, play_time_ms, name);"_zv);
+
+            //   :   (-score, play_time_ms, name, id) > (...)   ,
+            //      ,   record_players,   
+            w.exec(
+                "CREATE INDEX IF NOT EXISTS record_players_seek ON retired_players ((-score), play_time_ms, name, id);"_zv);
+
+            //      ,    ;    
+            w.exec(
+                "CREATE TABLE IF NOT EXISTS record_summaries (time_window varchar(8) NOT NULL, "
+                "period_start timestamptz NOT NULL, "
+                "id UUID NOT NULL, "
+                "name varchar(100) NOT NULL, "
+                "score integer, "
+                "play_time_ms integer, "
+                "PRIMARY KEY (time_window, period_start, id));"_zv);
+            w.exec(
+                "DELETE FROM record_summaries WHERE period_start < now() - interval '14 days';"_zv);
+
+            w.commit();
+            return db_url;
+        }
+
+        void PrepareStatements(pqxx::connection& conn) {
+            conn.prepare(SAVE_RECORD,
+                "INSERT INTO retired_players (id, name, score, play_time_ms, retired_at) "
+                "VALUES ($1, $2, $3, $4, to_timestamp($5::bigint / 1000.0)) ON CONFLICT DO NOTHING;"_zv);
+            conn.prepare(GET_RECORDS,
+                "SELECT name, score, play_time_ms FROM retired_players ORDER BY score DESC, play_time_ms, name LIMIT $1 OFFSET $2;"_zv);
+            conn.prepare(GET_FIRST_PAGE,
+                "SELECT id, name, score, play_time_ms FROM retired_players "
+                "ORDER BY -score, play_time_ms, name, id LIMIT $1;"_zv);
+            conn.prepare(GET_PAGE_AFTER,
+                "SELECT id, name, score, play_time_ms FROM retired_players "
+                "WHERE (-score, play_time_ms, name, id) > (-$1::integer, $2, $3, $4::uuid) "
+                "ORDER BY -score, play_time_ms, name, id LIMIT $5;"_zv);
+            conn.prepare(ADD_TO_SUMMARY,
+                "INSERT INTO record_summaries (time_window, period_start, id, name, score, play_time_ms) "
+                "VALUES ($1, to_timestamp($2::bigint / 1000.0), $3, $4, $5, $6) ON CONFLICT DO NOTHING;"_zv);
+            conn.prepare(TRIM_SUMMARY,
+                "DELETE FROM record_summaries WHERE time_window = $1 AND period_start = to_timestamp($2::bigint / 1000.0) "
+                "AND id NOT IN (SELECT id FROM record_summaries WHERE time_window = $1 AND period_start = to_timestamp($2::bigint / 1000.0) "
+                "ORDER BY score DESC, play_time_ms, name, id LIMIT $3);"_zv);
+            conn.prepare(GET_SUMMARY,
+                "SELECT name, score, play_time_ms FROM record_summaries WHERE time_window = $1 AND period_start = to_timestamp($2::bigint / 1000.0) "
+                "ORDER BY score DESC, play_time_ms, name, id LIMIT $3 OFFSET $4;"_zv);
+        }
+
+        json::object RecordToJson(const pqxx::row& res_row) {
+            json::object json_row;
+            json_row.emplace("name", res_row.at("name"s).as<std::string>());
+            json_row.emplace("score", res_row.at("score"s).as<int>());
+            json_row.emplace("playTime", res_row["play_time_ms"].as<double>() / 1000.0);
+            return json_row;
+        }
+
+    }  // namespace
+
+    ConnectionPool::ConnectionPool(Config config, ConnectionFactory connection_factory)
+        : config_(config)
+        , connection_factory_(std::move(connection_factory)) {
+        if (config_.max_size == 0) {
+            throw std::invalid_argument("Connection pool size must be positive");
+        }
+        const size_t min_size = std::min(config_.min_size, config_.max_size);
+        open_connections_ = min_size;
+
+        //   :         
+        std::vector<std::future<ConnectionPtr>> pending;
+        pending.reserve(min_size);
+        for (size_t i = 0; i < min_size; ++i) {
+            pending.push_back(std::async(std::launch::async, [this] {
+                try {
+                    return OpenReserved();
+                }
+                catch (const std::exception&) {
+                    return ConnectionPtr{};
+                }
+            }));
+        }
+
+        std::vector<ConnectionPtr> opened;
+        for (std::future<ConnectionPtr>& conn : pending) {
+            opened.push_back(conn.get());
+        }
+        const auto now = std::chrono::steady_clock::now();
+        std::lock_guard lock{ mutex_ };
+        for (ConnectionPtr& conn : opened) {
+            if (conn) {
+                idle_.push_back({ std::move(conn), now });
+            }
+        }
+    }
+
+    ConnectionPool::ConnectionPtr ConnectionPool::OpenReserved() {
+        try {
+            ConnectionPtr conn = connection_factory_();
+            connections_.Add();
+            return conn;
+        }
+        catch (...) {
+            connect_failures_.Add();
+            {
+                std::lock_guard lock{ mutex_ };
+                --open_connections_;
+            }
+            cond_var_.notify_one();
+            throw;
+        }
+    }
+
+    ConnectionPool::ConnectionPtr ConnectionPool::Reconnect() {
+        replaced_.Add();
+        connections_.Sub();
+        try {
+            ConnectionPtr conn = connection_factory_();
+            connections_.Add();
+            return conn;
+        }
+        catch (...) {
+            connect_failures_.Add();
+            throw;
+        }
+    }
+
+    bool ConnectionPool::IsAlive(pqxx::connection& conn) const {
+        if (!conn.is_open()) {
+            return false;
+        }
+        try {
+            pqxx::nontransaction n(conn);
+            n.exec("SELECT 1;"_zv);
+            return true;
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+    }
+
     ConnectionPool::ConnectionWrapper ConnectionPool::GetConnection() {
+        metrics::ScopedTimer wait_timer(wait_time_);
+        queue_depth_.Add();
         std::unique_lock lock{ mutex_ };
-        //     ,  cond_var_      
-        //    
-        cond_var_.wait(lock, [this] {
-            return used_connections_ < pool_.size();
+        //     ,   
+        const bool ready = cond_var_.wait_for(lock, config_.acquire_timeout, [this] {
+            return !idle_.empty() || open_connections_ < config_.max_size;
             });
-        //        
+        queue_depth_.Sub();
+        if (!ready) {
+            acquire_timeouts_.Add();
+            throw std::runtime_error("Timed out waiting for a database connection");
+        }
+
+        if (idle_.empty()) {
+            ++open_connections_;
+            lock.unlock();
+            return { OpenReserved(), *this };
+        }
+
+        IdleConnection idle = std::move(idle_.back());
+        idle_.pop_back();
+        lock.unlock();
 
-        return { std::move(pool_[used_connections_++]), *this };
+        ConnectionWrapper conn{ std::move(idle.conn), *this };
+        //          
+        const bool stale = std::chrono::steady_clock::now() - idle.returned > config_.idle_check;
+        if (!conn->is_open() || (stale && !IsAlive(*conn))) {
+            conn.Reconnect();
+        }
+        return conn;
     }
 
     void ConnectionPool::ReturnConnection(ConnectionPtr&& conn) {
-        //     
         {
             std::lock_guard lock{ mutex_ };
-            assert(used_connections_ != 0);
-            pool_[--used_connections_] = std::move(conn);
+            assert(open_connections_ != 0);
+            if (conn && conn->is_open()) {
+                //     
+                idle_.push_back({ std::move(conn), std::chrono::steady_clock::now() });
+            }
+            else {
+                //     :  ,    
+                --open_connections_;
+                if (conn) {
+                    replaced_.Add();
+                    connections_.Sub();
+                }
+            }
         }
         //         
         cond_var_.notify_one();
     }
 
-    DatabaseImpl::DatabaseImpl(size_t num_threads, const char* db_url)
-        : conn_pool_(num_threads, [db_url] { return std::make_shared<pqxx::connection>(db_url); }) {
-        ConnectionPool::ConnectionWrapper conn = conn_pool_.GetConnection();
+    DatabaseImpl::DatabaseImpl(ConnectionPool::Config pool_config, const char* db_url, Partitioning partitioning)
+        : conn_pool_(pool_config, [db_url = CreateSchema(db_url, partitioning)] {
+            auto conn = std::make_shared<pqxx::connection>(db_url);
+            PrepareStatements(*conn);
+            return conn;
+        })
+        , partitioning_(partitioning) {
+    }
 
-        pqxx::work w(*conn);
-        w.exec(
-            "CREATE TABLE IF NOT EXISTS retired_players (id UUID CONSTRAINT player_id PRIMARY KEY, "
-            "name varchar(100) NOT NULL, "
-            "score integer, "
-            "play_time_ms integer);"_zv);
+    void DatabaseImpl::SaveRecord(std::string name, int score, uint64_t played_time) {
+        // id   :       
+        util::detail::UUIDType uuid_id = util::detail::NewUUID();
+        InsertRecord(model::RecordKey{ score, played_time, std::move(name), util::detail::UUIDToString(uuid_id), model::GetRecordTime() });
+    }
 
-        w.exec(
-            "CREATE INDEX IF NOT EXISTS record_players ON retired_players (score DESC, play_time_ms, name);"_zv);
+    void DatabaseImpl::InsertRecord(const model::RecordKey& record) {
+        //    :        (id, retired_at)
+        const int64_t retired_at = record.retired_at != 0 ? record.retired_at : model::GetRecordTime();
+        WithConnection([&](pqxx::connection& conn) {
+            EnsurePartition(conn, retired_at);
+            pqxx::work w(conn);
+            const pqxx::result inserted = w.exec_prepared(SAVE_RECORD, record.id, record.name, record.score, record.play_time_ms, retired_at);
+            if (inserted.affected_rows() > 0) {
+                for (model::RecordsWindow window : { model::RecordsWindow::DAY, model::RecordsWindow::WEEK }) {
+                    const int64_t period_start = model::GetWindowStart(window, retired_at);
+                    w.exec_prepared(ADD_TO_SUMMARY, WindowName(window), period_start, record.id, record.name, record.score, record.play_time_ms);
+                    w.exec_prepared(TRIM_SUMMARY, WindowName(window), period_start, model::WINDOW_TOP_SIZE);
+                }
+            }
+            w.commit();
+        });
+    }
 
-        w.commit();
+    void DatabaseImpl::EnsurePartition(pqxx::connection& conn, int64_t retired_at) {
+        if (partitioning_ == Partitioning::NONE) {
+            return;
+        }
+        const PartitionRange range = GetPartitionRange(partitioning_, retired_at);
+        {
+            std::lock_guard lock(partitions_mutex_);
+            if (partitions_.contains(range.start)) {
+                return;
+            }
+        }
+        try {
+            //        
+            pqxx::work w(conn);
+            w.exec("CREATE TABLE IF NOT EXISTS " + range.name + " PARTITION OF retired_players "
+                "FOR VALUES FROM ('" + range.from + "') TO ('" + range.to + "');");
+            w.commit();
+        }
+        catch (const pqxx::sql_error&) {
+            //     ;     ,      
+            return;
+        }
+        std::lock_guard lock(partitions_mutex_);
+        partitions_.insert(range.start);
     }
 
-    void DatabaseImpl::SaveRecord(std::string name, int score, uint64_t played_time) {
-        ConnectionPool::ConnectionWrapper conn = conn_pool_.GetConnection();
-        pqxx::work w(*conn);
+    json::array DatabaseImpl::GetWindowRecords(model::RecordsWindow window, int limit, int offset) {
+        if (window == model::RecordsWindow::ALL) {
+            return GetRecords(limit, offset);
+        }
+        const int64_t period_start = model::GetWindowStart(window, model::GetRecordTime());
+        pqxx::result query_result = WithConnection([&](pqxx::connection& conn) {
+            pqxx::read_transaction r(conn);
+            return r.exec_prepared(GET_SUMMARY, WindowName(window), period_start, limit, offset);
+        });
 
-        util::detail::UUIDType uuid_id = util::detail::NewUUID();
-        std::string id = util::detail::UUIDToString(uuid_id);
-
-        w.exec_params(R"(
-                INSERT INTO retired_players (id, name, score, play_time_ms) VALUES ($1, $2, $3, $4);)"_zv,
-            id,
-            name,
-            score,
-            played_time);
-        w.commit();
+        json::array result;
+        for (const pqxx::row& res_row : query_result) {
+            result.emplace_back(RecordToJson(res_row));
+        }
+        return result;
     }
 
     json::array DatabaseImpl::GetRecords(int limit, int offset) {
-        ConnectionPool::ConnectionWrapper conn = conn_pool_.GetConnection();
-        pqxx::read_transaction r(*conn);
-        pqxx::result query_result = r.exec_params(R"(
-            SELECT name, score, play_time_ms FROM retired_players ORDER BY score DESC, play_time_ms, name LIMIT $1 OFFSET $2; )"_zv,
-            limit, offset);
+        pqxx::result query_result = WithConnection([&](pqxx::connection& conn) {
+            pqxx::read_transaction r(conn);
+            return r.exec_prepared(GET_RECORDS, limit, offset);
+        });
 
         json::array result;
 
         for (const pqxx::row& res_row : query_result) {
-            json::object json_row;
-            json_row.emplace("name", res_row.at("name"s).as<std::string>());
-            json_row.emplace("score", res_row.at("score"s).as<int>());
-            json_row.emplace("playTime", res_row["play_time_ms"].as<double>() / 1000.0);
-            
-            result.emplace_back(json_row);
+            result.emplace_back(RecordToJson(res_row));
         }
         return result;
     }
+
+    model::RecordsPage DatabaseImpl::GetRecordsPage(int limit, const std::optional<model::RecordKey>& after) {
+        pqxx::result query_result = WithConnection([&](pqxx::connection& conn) {
+            pqxx::read_transaction r(conn);
+            if (!after) {
+                return r.exec_prepared(GET_FIRST_PAGE, limit);
+            }
+            return r.exec_prepared(GET_PAGE_AFTER, after->score, after->play_time_ms, after->name, after->id, limit);
+        });
+
+        model::RecordsPage page;
+        for (const pqxx::row& res_row : query_result) {
+            page.records.emplace_back(RecordToJson(res_row));
+        }
+        if (!query_result.empty()) {
+            const pqxx::row last = query_result[query_result.size() - 1];
+            page.last = model::RecordKey{ last.at("score"s).as<int>(), last.at("play_time_ms"s).as<uint64_t>(),
+                last.at("name"s).as<std::string>(), last.at("id"s).as<std::string>() };
+        }
+        return page;
+    }
 }
\ No newline at end of file
@@ -6,9 +6,15 @@
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
+#include <functional>
+#include <optional>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "model.h"
+#include "metrics.h"
 #include "tagged_uuid.h"
 
 using namespace std::literals;
@@ -19,11 +25,27 @@ namespace json = boost::json;
 
 namespace postgre {
 
+    /*
+     *    PostgreSQL.     min_size ,
+     *   max_size -  . ,     idle_check,
+     *    ;       
+     * ,      .
+     */
     class ConnectionPool {
         using PoolType = ConnectionPool;
         using ConnectionPtr = std::shared_ptr<pqxx::connection>;
 
     public:
+        struct Config {
+            size_t min_size = 1;
+            size_t max_size = 1;
+            //  GetConnection   ,    
+            std::chrono::milliseconds acquire_timeout{ 5000 };
+            std::chrono::milliseconds idle_check{ 30000 };
+        };
+
+        using ConnectionFactory = std::function<ConnectionPtr()>;
+
         class ConnectionWrapper {
         public:
             ConnectionWrapper(std::shared_ptr<pqxx::connection>&& conn, PoolType& pool) noexcept
@@ -34,8 +56,12 @@ namespace postgre {
             ConnectionWrapper(const ConnectionWrapper&) = delete;
             ConnectionWrapper& operator=(const ConnectionWrapper&) = delete;
 
-            ConnectionWrapper(ConnectionWrapper&&) = default;
-            ConnectionWrapper& operator=(ConnectionWrapper&&) = default;
+            //        
+            ConnectionWrapper(ConnectionWrapper&& other) noexcept
+                : conn_{ std::move(other.conn_) }
+                , pool_{ std::exchange(other.pool_, nullptr) } {
+            }
+            ConnectionWrapper& operator=(ConnectionWrapper&&) = delete;
 
             pqxx::connection& operator*() const& noexcept {
                 return *conn_;
@@ -46,8 +72,14 @@ namespace postgre {
                 return conn_.get();
             }
 
+            //       
+            void Reconnect() {
+                conn_.reset();
+                conn_ = pool_->Reconnect();
+            }
+
             ~ConnectionWrapper() {
-                if (conn_) {
+                if (pool_) {
                     pool_->ReturnConnection(std::move(conn_));
                 }
             }
@@ -57,41 +89,102 @@ namespace postgre {
             PoolType* pool_;
         };
 
-        // ConnectionFactory is a functional object returning std::shared_ptr<pqxx::connection>
-        template <typename ConnectionFactory>
-        ConnectionPool(size_t capacity, ConnectionFactory&& connection_factory) {
-            pool_.reserve(capacity);
-            for (size_t i = 0; i < capacity; ++i) {
-                pool_.emplace_back(connection_factory());
-            }
-        }
+        //     ,       .
+        // ,      ,    
+        ConnectionPool(Config config, ConnectionFactory connection_factory);
 
+        //  ,      acquire_timeout    
         ConnectionWrapper GetConnection();
 
     private:
+        struct IdleConnection {
+            ConnectionPtr conn;
+            std::chrono::steady_clock::time_point returned;
+        };
+
+        //    ,    open_connections_;    
+        ConnectionPtr OpenReserved();
+
+        //    ,      
+        ConnectionPtr Reconnect();
+
+        bool IsAlive(pqxx::connection& conn) const;
+
         void ReturnConnection(ConnectionPtr&& conn);
 
+        const Config config_;
+        const ConnectionFactory connection_factory_;
+
         std::mutex mutex_;
         std::condition_variable cond_var_;
-        std::vector<ConnectionPtr> pool_;
-        size_t used_connections_ = 0;
+        //  ;    ,      
+        std::vector<IdleConnection> idle_;
+        // ,     
+        size_t open_connections_ = 0;
+
+        metrics::Histogram wait_time_ = metrics::Registry::Instance().AddHistogram(
+            "db_pool_wait_duration_microseconds", "Time spent waiting for a free database connection");
+        metrics::Gauge queue_depth_ = metrics::Registry::Instance().AddGauge(
+            "db_pool_waiting_requests", "Number of threads waiting for a free database connection");
+        metrics::Gauge connections_ = metrics::Registry::Instance().AddGauge(
+            "db_pool_connections", "Number of open database connections");
+        metrics::Counter acquire_timeouts_ = metrics::Registry::Instance().AddCounter(
+            "db_pool_acquire_timeouts_total", "Number of requests that did not get a database connection in time");
+        metrics::Counter connect_failures_ = metrics::Registry::Instance().AddCounter(
+            "db_pool_connect_failures_total", "Number of failed attempts to open a database connection");
+        metrics::Counter replaced_ = metrics::Registry::Instance().AddCounter(
+            "db_pool_replaced_connections_total", "Number of broken database connections dropped from the pool");
     };
 
 
+    //  retired_players      
+    enum class Partitioning {
+        NONE, DAY, MONTH
+    };
+
     class DatabaseImpl : public model::Database {
     public:
-        DatabaseImpl(size_t num_threads, const char* db_url);
+        //  partitioning   ,      .
+        //         
+        DatabaseImpl(ConnectionPool::Config pool_config, const char* db_url, Partitioning partitioning = Partitioning::NONE);
 
         DatabaseImpl(const DatabaseImpl&) = delete;
         DatabaseImpl& operator=(const DatabaseImpl&) = delete;
 
         void SaveRecord(std::string name, int score, uint64_t played_time) override;
 
+        void InsertRecord(const model::RecordKey& record) override;
+
         json::array GetRecords(int limit, int offset) override;
 
+        model::RecordsPage GetRecordsPage(int limit, const std::optional<model::RecordKey>& after) override;
+
+        //      record_summaries,      
+        json::array GetWindowRecords(model::RecordsWindow window, int limit, int offset) override;
+
     private:
+        //       retired_at,    
+        void EnsurePartition(pqxx::connection& conn, int64_t retired_at);
+
+        //  fn(connection);   ,     
+        template <typename Fn>
+        auto WithConnection(Fn&& fn) {
+            ConnectionPool::ConnectionWrapper conn = conn_pool_.GetConnection();
+            try {
+                return fn(*conn);
+            }
+            catch (const pqxx::broken_connection&) {
+                conn.Reconnect();
+                return fn(*conn);
+            }
+        }
 
         ConnectionPool conn_pool_;
+
+        const Partitioning partitioning_;
+        std::mutex partitions_mutex_;
+        //  ,   
+        std::set<int64_t> partitions_;
     };
 
 
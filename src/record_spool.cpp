@@ -0,0 +1,172 @@
+#include "record_spool.h"
+
+#include <algorithm>
+
+#include "file_database.h"
+
+namespace record_spool {
+
+SpoolingDatabase::SpoolingDatabase(std::filesystem::path path, std::shared_ptr<model::Database> target, Config config)
+    : path_(std::move(path))
+    , target_(std::move(target))
+    , config_(config) {
+    // Записи, не доставленные до остановки или сбоя, доставляются заново
+    file_db::LoadRecordFile(path_, [this](model::RecordKey record) {
+        pending_.push_back(std::move(record));
+    });
+    pending_gauge_.Add(static_cast<std::int64_t>(pending_.size()));
+    file_ = durable_file::AppendFile(path_, false);
+    if (path_.has_parent_path()) {
+        durable_file::SyncDirectory(path_.parent_path());
+    }
+    thread_ = std::thread([this] { Run(); });
+}
+
+SpoolingDatabase::~SpoolingDatabase() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    try {
+        file_.Sync();
+    }
+    catch (const std::exception&) {
+    }
+}
+
+void SpoolingDatabase::SaveRecord(std::string name, int score, uint64_t played_time) {
+    // Время ухода фиксируется сразу: запись попадёт в свои сутки, даже если БД получит её позже
+    InsertRecord(model::RecordKey{ score, played_time, std::move(name), file_db::NewRecordId(), model::GetRecordTime() });
+}
+
+void SpoolingDatabase::InsertRecord(const model::RecordKey& record) {
+    {
+        std::lock_guard lock(mutex_);
+        try {
+            // Только write в кэш страниц: fdatasync делает фоновый поток, чтобы не задерживать тик
+            file_.Append(file_db::EncodeRecord(record));
+            ++appended_;
+        }
+        catch (const std::exception&) {
+            // Вызывается из strand игры, поэтому ошибка не пробрасывается: запись остаётся в памяти,
+            // а фоновый поток перепишет файл вместе с ней
+            failures_.Add();
+            file_incomplete_ = true;
+        }
+        pending_.push_back(record);
+    }
+    pending_gauge_.Add();
+    cv_.notify_all();
+}
+
+boost::json::array SpoolingDatabase::GetRecords(int limit, int offset) {
+    return target_->GetRecords(limit, offset);
+}
+
+model::RecordsPage SpoolingDatabase::GetRecordsPage(int limit, const std::optional<model::RecordKey>& after) {
+    return target_->GetRecordsPage(limit, after);
+}
+
+boost::json::array SpoolingDatabase::GetWindowRecords(model::RecordsWindow window, int limit, int offset) {
+    return target_->GetWindowRecords(window, limit, offset);
+}
+
+bool SpoolingDatabase::WaitDelivered(std::chrono::milliseconds timeout) {
+    std::unique_lock lock(mutex_);
+    return cv_.wait_for(lock, timeout, [this] { return pending_.empty(); });
+}
+
+size_t SpoolingDatabase::GetPendingCount() const {
+    std::lock_guard lock(mutex_);
+    return pending_.size();
+}
+
+void SpoolingDatabase::Run() {
+    std::unique_lock lock(mutex_);
+    std::chrono::milliseconds retry_delay = config_.retry_delay;
+    size_t synced = appended_;
+    while (true) {
+        cv_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+        if (stop_) {
+            return;
+        }
+        if (file_incomplete_) {
+            try {
+                Compact();
+            }
+            catch (const std::exception&) {
+                failures_.Add();
+            }
+        }
+        // Из очереди записи забирает только этот поток, поэтому первая не изменится без блокировки
+        const model::RecordKey record = pending_.front();
+        const size_t appended = appended_;
+        lock.unlock();
+
+        bool delivered = false;
+        try {
+            // Запись должна пережить сбой раньше, чем мы начнём ждать БД
+            if (synced != appended) {
+                file_.Sync();
+                synced = appended;
+            }
+            target_->InsertRecord(record);
+            delivered = true;
+        }
+        catch (const std::exception&) {
+            failures_.Add();
+        }
+
+        lock.lock();
+        if (!delivered) {
+            cv_.wait_for(lock, retry_delay, [this] { return stop_; });
+            retry_delay = std::min(retry_delay * 2, config_.max_retry_delay);
+            continue;
+        }
+        retry_delay = config_.retry_delay;
+        pending_.pop_front();
+        pending_gauge_.Sub();
+        delivered_.Add();
+        ++delivered_in_file_;
+        if (pending_.empty()) {
+            cv_.notify_all();
+        }
+        try {
+            if (pending_.empty()) {
+                // Всё доставлено: файл начинается заново. Если усечение не переживёт сбой, записи
+                // будут доставлены повторно и отброшены БД по id
+                file_ = durable_file::AppendFile(path_, true);
+                delivered_in_file_ = 0;
+                file_incomplete_ = false;
+            }
+            else if (delivered_in_file_ >= config_.compact_after) {
+                Compact();
+            }
+        }
+        catch (const std::exception&) {
+            // Файл остаётся прежним: лишние записи в нём безвредны
+            failures_.Add();
+        }
+    }
+}
+
+void SpoolingDatabase::Compact() {
+    std::string data;
+    for (const model::RecordKey& record : pending_) {
+        data += file_db::EncodeRecord(record);
+    }
+    std::filesystem::path tmp_path = path_;
+    tmp_path += ".tmp";
+    durable_file::WriteAndSync(tmp_path, data);
+    std::filesystem::rename(tmp_path, path_);
+    if (path_.has_parent_path()) {
+        durable_file::SyncDirectory(path_.parent_path());
+    }
+    file_ = durable_file::AppendFile(path_, false);
+    delivered_in_file_ = 0;
+    file_incomplete_ = false;
+}
+
+}  // namespace record_spool
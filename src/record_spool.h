@@ -0,0 +1,91 @@
+#pragma once
+#include <boost/json.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "durable_file.h"
+#include "metrics.h"
+#include "model.h"
+
+namespace record_spool {
+
+struct Config {
+    // Пауза перед повтором после ошибки БД; удваивается до max_retry_delay
+    std::chrono::milliseconds retry_delay{ 100 };
+    std::chrono::milliseconds max_retry_delay{ 10000 };
+    // Сколько доставленных записей допускается в файле, прежде чем он будет переписан
+    size_t compact_after = 1024;
+};
+
+/*
+ * Database для Game, которая не ждёт БД при уходе игрока. Рекорд получает UUID и дописывается
+ * в локальный файл, а фоновый поток сбрасывает файл на диск и переносит записи в целевую БД,
+ * повторяя попытки, пока БД недоступна. Повторная вставка с тем же UUID в БД игнорируется,
+ * поэтому записи, оставшиеся в файле после сбоя, просто доставляются заново при запуске.
+ * Чтение таблицы рекордов идёт напрямую в целевую БД.
+ */
+class SpoolingDatabase : public model::Database {
+public:
+    SpoolingDatabase(std::filesystem::path path, std::shared_ptr<model::Database> target, Config config = {});
+
+    SpoolingDatabase(const SpoolingDatabase&) = delete;
+    SpoolingDatabase& operator=(const SpoolingDatabase&) = delete;
+
+    // Недоставленные записи остаются в файле до следующего запуска
+    ~SpoolingDatabase();
+
+    void SaveRecord(std::string name, int score, uint64_t played_time) override;
+
+    void InsertRecord(const model::RecordKey& record) override;
+
+    boost::json::array GetRecords(int limit, int offset) override;
+
+    model::RecordsPage GetRecordsPage(int limit, const std::optional<model::RecordKey>& after) override;
+
+    boost::json::array GetWindowRecords(model::RecordsWindow window, int limit, int offset) override;
+
+    // Ждёт, пока все записи будут доставлены, не дольше timeout; true - очередь пуста
+    bool WaitDelivered(std::chrono::milliseconds timeout);
+
+    size_t GetPendingCount() const;
+
+private:
+    void Run();
+
+    // Переписывает файл, оставляя только недоставленные записи. Вызывается под mutex_ и только фоновым потоком
+    void Compact();
+
+    const std::filesystem::path path_;
+    const std::shared_ptr<model::Database> target_;
+    const Config config_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    durable_file::AppendFile file_;
+    std::deque<model::RecordKey> pending_;
+    // Число дописанных в файл записей; по нему фоновый поток понимает, нужен ли fdatasync
+    size_t appended_ = 0;
+    // Записи, которые уже доставлены, но ещё лежат в файле
+    size_t delivered_in_file_ = 0;
+    // Запись в файл не удалась, и часть недоставленных записей есть только в памяти
+    bool file_incomplete_ = false;
+    bool stop_ = false;
+    std::thread thread_;
+
+    metrics::Gauge pending_gauge_ = metrics::Registry::Instance().AddGauge(
+        "record_spool_pending", "Number of records waiting to be written to the database");
+    metrics::Counter delivered_ = metrics::Registry::Instance().AddCounter(
+        "record_spool_delivered_total", "Number of records written from the spool to the database");
+    metrics::Counter failures_ = metrics::Registry::Instance().AddCounter(
+        "record_spool_failures_total", "Number of failed attempts to write a record to the spool file or from the spool to the database");
+};
+
+}  // namespace record_spool
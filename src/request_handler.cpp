@@ -1,5 +1,8 @@
 #include "request_handler.h"
 
+#include <array>
+#include <cctype>
+
 namespace http_handler {
 
     StringResponse MakeStringResponse(http::status status, std::string_view body, size_t body_size, unsigned http_version, bool keep_alive, std::string_view content_type) {
@@ -12,6 +15,65 @@ namespace http_handler {
         return response;
     }
 
+    HandlerResponse ResponseServiceUnavailable(unsigned http_version, bool keep_alive, std::string_view code, std::string_view message) {
+        json::object response;
+        response.emplace("code", code);
+        response.emplace("message", message);
+
+        std::string str_response = json::serialize(response);
+        StringResponse result_response = MakeStringResponse(http::status::service_unavailable, str_response, str_response.size(), http_version, keep_alive, ContentType::JSON);
+        result_response.set(http::field::cache_control, "no-cache");
+        result_response.set(http::field::retry_after, "1");
+
+        return HandlerResponse(std::move(result_response));
+    }
+
+    const RouteMetrics& GetRouteMetrics(std::string_view target) {
+        static const auto make_route_metrics = [](std::string_view route) {
+            const std::string label = metrics::Label("route", route);
+            return RouteMetrics{
+                metrics::Registry::Instance().AddCounter("http_requests_total", "Number of handled HTTP requests", label),
+                metrics::Registry::Instance().AddHistogram("http_request_duration_microseconds", "HTTP request handling latency", label) };
+        };
+        //      RequestTarget
+        static const std::array<RouteMetrics, 9> api_metrics{
+            make_route_metrics("unknown"), make_route_metrics("players"), make_route_metrics("join"),
+            make_route_metrics("maps"), make_route_metrics("map"), make_route_metrics("state"),
+            make_route_metrics("action"), make_route_metrics("tick"), make_route_metrics("records") };
+        static const RouteMetrics static_metrics = make_route_metrics("static");
+
+        if (target.substr(0, 5) != "/api/"sv) {
+            return static_metrics;
+        }
+        return api_metrics.at(static_cast<size_t>(ApiHandler::GetRequestTarget(target)));
+    }
+
+    RequestPriority GetRequestPriority(RequestTarget target) {
+        switch (target) {
+        case RequestTarget::ACTION:
+        case RequestTarget::TICK:
+            return RequestPriority::ACTION;
+        case RequestTarget::STATE:
+            return RequestPriority::STATE;
+        default:
+            return RequestPriority::LOBBY;
+        }
+    }
+
+    bool RequestHandler::ShouldShed(std::string_view target) const {
+        if (shed_queue_delay_.count() == 0) {
+            return false;
+        }
+        return load_shedding::ShouldShed(GetRequestPriority(ApiHandler::GetRequestTarget(target)), queue_delay_.Get(), shed_queue_delay_);
+    }
+
+    std::optional<RecordsQuery> RequestHandler::GetExecutorRecordsQuery(std::string_view target) const {
+        if (ApiHandler::GetRequestTarget(target) != RequestTarget::RECORDS) {
+            return std::nullopt;
+        }
+        return ApiHandler::ParseRecordsQuery(std::string(target));
+    }
+
     RequestTarget ApiHandler::GetRequestTarget(std::string_view target) {
         if (target == "/api/v1/game/join"sv) {
             return RequestTarget::JOIN;
@@ -40,7 +102,133 @@ namespace http_handler {
         return RequestTarget::UNKNOWN;
     }
 
-    std::unordered_map<std::string, std::string> ApiHandler::ParseURI(const std::string& query) const {
+    std::optional<RecordsQuery> ApiHandler::ParseRecordsQuery(const std::string& target) {
+        try {
+            RecordsQuery query = ParseRecordsParams(target);
+            if (query.max_items > 100) {
+                return std::nullopt;
+            }
+            return query;
+        }
+        catch (const std::exception&) {
+            return std::nullopt;
+        }
+    }
+
+    RecordsQuery ApiHandler::ParseRecordsParams(const std::string& target) {
+        std::unordered_map<std::string, std::string> params = ParseURI(target);
+        RecordsQuery query;
+        if (params.count("start")) {
+            query.start = std::stoi(params.at("start"));
+        }
+        if (params.count("maxItems")) {
+            query.max_items = std::stoi(params.at("maxItems"));
+        }
+        if (params.count("window")) {
+            const std::string& window = params.at("window");
+            if (window == "day"sv) {
+                query.window = model::RecordsWindow::DAY;
+            }
+            else if (window == "week"sv) {
+                query.window = model::RecordsWindow::WEEK;
+            }
+            else if (window != "all"sv) {
+                throw std::invalid_argument("window must be day, week or all");
+            }
+        }
+        if (params.count("cursor")) {
+            if (query.window != model::RecordsWindow::ALL) {
+                throw std::invalid_argument("cursor can be used only with window=all");
+            }
+            if (params.count("start")) {
+                throw std::invalid_argument("start and cursor can not be used together");
+            }
+            query.paged = true;
+            if (!params.at("cursor").empty()) {
+                query.after = DecodeRecordsCursor(params.at("cursor"));
+            }
+        }
+        return query;
+    }
+
+    std::string SerializeRecordsPage(model::RecordsPage page, int limit) {
+        json::object response;
+        const bool has_next = page.last && page.records.size() >= static_cast<size_t>(limit);
+        if (has_next) {
+            response.emplace("next", EncodeRecordsCursor(*page.last));
+        }
+        response.emplace("records", std::move(page.records));
+        return json::serialize(response);
+    }
+
+    std::string EncodeRecordsCursor(const model::RecordKey& key) {
+        //    ,   
+        const std::string plain = std::to_string(key.score) + ':' + std::to_string(key.play_time_ms) + ':' + key.id + ':' + key.name;
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string cursor;
+        cursor.reserve(plain.size() * 2);
+        for (unsigned char c : plain) {
+            cursor += digits[c >> 4];
+            cursor += digits[c & 0xF];
+        }
+        return cursor;
+    }
+
+    model::RecordKey DecodeRecordsCursor(std::string_view cursor) {
+        const auto invalid = [] {
+            return std::invalid_argument("Invalid cursor");
+        };
+        const auto hex_value = [&invalid](char c) {
+            if (c >= '0' && c <= '9') {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'f') {
+                return c - 'a' + 10;
+            }
+            throw invalid();
+        };
+        if (cursor.size() % 2 != 0) {
+            throw invalid();
+        }
+        std::string plain;
+        plain.reserve(cursor.size() / 2);
+        for (size_t i = 0; i < cursor.size(); i += 2) {
+            plain += static_cast<char>(hex_value(cursor[i]) * 16 + hex_value(cursor[i + 1]));
+        }
+
+        const size_t score_end = plain.find(':');
+        const size_t time_end = score_end == std::string::npos ? score_end : plain.find(':', score_end + 1);
+        const size_t id_end = time_end == std::string::npos ? time_end : plain.find(':', time_end + 1);
+        if (id_end == std::string::npos) {
+            throw invalid();
+        }
+        model::RecordKey key;
+        try {
+            key.score = std::stoi(plain.substr(0, score_end));
+            key.play_time_ms = std::stoull(plain.substr(score_end + 1, time_end - score_end - 1));
+        }
+        catch (const std::exception&) {
+            throw invalid();
+        }
+        key.id = plain.substr(time_end + 1, id_end - time_end - 1);
+        key.name = plain.substr(id_end + 1);
+        // id - UUID    8-4-4-4-12;         503  400
+        if (key.id.size() != 36) {
+            throw invalid();
+        }
+        for (size_t i = 0; i < key.id.size(); ++i) {
+            const char c = key.id[i];
+            const bool valid = (i == 8 || i == 13 || i == 18 || i == 23)
+                ? c == '-'
+                : std::isxdigit(static_cast<unsigned char>(c)) != 0;
+            if (!valid) {
+                throw invalid();
+            }
+        }
+        return key;
+    }
+
+    std::unordered_map<std::string, std::string> ApiHandler::ParseURI(const std::string& query) {
         std::unordered_map<std::string, std::string> params;
         size_t start = query.find('?') + 1;
         while (start < query.size()) {
@@ -3,10 +3,15 @@
 #include <boost/asio/io_context.hpp>
 #include "http_server.h"
 #include "model.h"
+#include "db_executor.h"
+#include "load_shedding.h"
 #include "logger.h"
+#include "metrics.h"
 
+#include <chrono>
 #include <filesystem>
 #include <iostream>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <variant>
@@ -49,23 +54,69 @@ namespace http_handler {
         constexpr static std::string_view SVG = "image/svg+xml"sv;
         constexpr static std::string_view MP3 = "audio/mpeg"sv;
         constexpr static std::string_view OCTET_STREAM = "octet-stream"sv;
+        constexpr static std::string_view PROMETHEUS = "text/plain; version=0.0.4"sv;
     };
 
     StringResponse MakeStringResponse(http::status status, std::string_view body, size_t body_size,
         unsigned http_version, bool keep_alive, std::string_view content_type = ContentType::TEXT_HTML);
 
+    // 503 с JSON-ошибкой и просьбой повторить запрос через секунду
+    HandlerResponse ResponseServiceUnavailable(unsigned http_version, bool keep_alive, std::string_view code, std::string_view message);
+
     enum class RequestTarget {
         UNKNOWN, PLAYERS, JOIN, MAPS, MAP, STATE, ACTION, TICK, RECORDS
     };
 
+    // Счётчик и гистограмма задержек для одного маршрута
+    struct RouteMetrics {
+        metrics::Counter requests;
+        metrics::Histogram latency;
+    };
+
+    const RouteMetrics& GetRouteMetrics(std::string_view target);
+
+    // Последний собранный ответ /game/state сессии; используется только при деградации
+    struct CachedState {
+        std::chrono::steady_clock::time_point built;
+        std::string body;
+    };
+
+    using StateCache = std::unordered_map<const model::GameSession*, CachedState>;
+
+    // Параметры /api/v1/game/records
+    struct RecordsQuery {
+        int start = 0;
+        int max_items = 100;
+        // С параметром cursor ответ - объект со страницей и курсором следующей; пустой cursor - первая страница
+        bool paged = false;
+        std::optional<model::RecordKey> after;
+        // window=day|week: верх таблицы за текущие сутки или неделю UTC
+        model::RecordsWindow window = model::RecordsWindow::ALL;
+    };
+
+    // Ответ на запрос с cursor: {"records": [...], "next": "..."}; next нет, если страница неполная
+    std::string SerializeRecordsPage(model::RecordsPage page, int limit);
+
+    // Курсор непрозрачен для клиента: это ключ последней записи страницы в шестнадцатеричном виде
+    std::string EncodeRecordsCursor(const model::RecordKey& key);
+    model::RecordKey DecodeRecordsCursor(std::string_view cursor);
+
+    using load_shedding::RequestPriority;
+    using load_shedding::QueueDelayMonitor;
+
+    RequestPriority GetRequestPriority(RequestTarget target);
+
     class ApiHandler;
 
     class RequestHandler : public std::enable_shared_from_this<RequestHandler> {
     public:
         using Strand = net::strand<net::io_context::executor_type>;
 
-        explicit RequestHandler(model::Game& game, std::string static_path, Strand& api_strand)
-            : static_path_{ fs::path(static_path) }, game_(game), api_strand_(api_strand) {}
+        // shed_queue_delay - задержка очереди strand, после которой лобби получает 503; 0 отключает сброс
+        // db_executor - если задан, таблица рекордов запрашивается в потоках БД, минуя strand игры
+        RequestHandler(model::Game& game, std::string static_path, Strand& api_strand, std::chrono::milliseconds shed_queue_delay = {},
+            std::shared_ptr<db_executor::Executor> db_executor = nullptr)
+            : static_path_{ fs::path(static_path) }, game_(game), api_strand_(api_strand), shed_queue_delay_(shed_queue_delay), db_executor_(std::move(db_executor)) {}
 
         RequestHandler(const RequestHandler&) = delete;
         RequestHandler& operator=(const RequestHandler&) = delete;
@@ -73,8 +124,21 @@ namespace http_handler {
         template <typename Body, typename Allocator, typename Send>
         void operator()(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
             if (req.target().substr(0, 5) == "/api/"sv) {
-                auto handle = [self = shared_from_this(), send, req = std::forward<decltype(req)>(req)] {
+                // Рекорды не зависят от состояния игры и не ждут strand; ошибки в параметрах по-прежнему разбирает ApiHandler
+                if (db_executor_ && req.method() == http::verb::get) {
+                    if (auto query = GetExecutorRecordsQuery(req.target()); query) {
+                        return HandleRecordsRequest(std::move(req), *query, std::forward<Send>(send));
+                    }
+                }
+                if (ShouldShed(req.target())) {
+                    shed_requests_.Add();
+                    return send(ResponseServiceUnavailable(req.version(), req.keep_alive(), "serverOverloaded", "Server is overloaded, try again later"));
+                }
+                auto handle = [self = shared_from_this(), send, req = std::forward<decltype(req)>(req), enqueued = queue_delay_.OnEnqueued()] {
                     assert(self->api_strand_.running_in_this_thread());
+                    const auto delay = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - enqueued);
+                    self->queue_delay_.OnStarted(delay);
+                    self->queue_delay_histogram_.Observe(delay);
                     return send(self->HandleApiRequest(req));
                 };
                 return net::dispatch(api_strand_, handle);                    
@@ -91,10 +155,40 @@ namespace http_handler {
 
         template <typename Body, typename Allocator>
         HandlerResponse HandleApiRequest(http::request<Body, http::basic_fields<Allocator>> req) {
-            ApiHandler api(game_);
+            ApiHandler api(game_, state_cache_);
             return api(std::move(req));
         }
 
+        template <typename Body, typename Allocator, typename Send>
+        void HandleRecordsRequest(http::request<Body, http::basic_fields<Allocator>>&& req, RecordsQuery query, Send&& send) {
+            auto respond = [send = std::forward<Send>(send), version = req.version(), keep_alive = req.keep_alive()](db_executor::Error error, std::string body) {
+                if (error != db_executor::Error::NONE) {
+                    return send(ResponseServiceUnavailable(version, keep_alive, "databaseUnavailable", "Records are temporarily unavailable, try again later"));
+                }
+                StringResponse result_response = MakeStringResponse(http::status::ok, body, body.size(), version, keep_alive, ContentType::JSON);
+                result_response.set(http::field::cache_control, "no-cache");
+                return send(HandlerResponse(std::move(result_response)));
+            };
+            if (query.paged) {
+                db_executor_->GetRecordsPage(query.max_items, std::move(query.after), api_strand_.get_inner_executor(),
+                    [respond = std::move(respond), limit = query.max_items](db_executor::Error error, model::RecordsPage page) {
+                        respond(error, error == db_executor::Error::NONE ? SerializeRecordsPage(std::move(page), limit) : std::string{});
+                    });
+            }
+            else if (query.window != model::RecordsWindow::ALL) {
+                db_executor_->GetWindowRecords(query.window, query.max_items, query.start, api_strand_.get_inner_executor(),
+                    [respond = std::move(respond)](db_executor::Error error, json::array records) {
+                        respond(error, json::serialize(records));
+                    });
+            }
+            else {
+                db_executor_->GetRecords(query.max_items, query.start, api_strand_.get_inner_executor(),
+                    [respond = std::move(respond)](db_executor::Error error, json::array records) {
+                        respond(error, json::serialize(records));
+                    });
+            }
+        }
+
         template <typename Body, typename Allocator>
         HandlerResponse ResponseStaticFile(http::request<Body, http::basic_fields<Allocator>>&& req) const {
             std::string decoded_target(DecodeUrl(req.target()));
@@ -156,6 +250,12 @@ namespace http_handler {
 
         std::string DecodeUrl(beast::string_view target) const;
 
+        // Действиям допускается вчетверо большая задержка, опросу состояния - вдвое, лобби - базовая
+        bool ShouldShed(std::string_view target) const;
+
+        // Параметры запроса рекордов, который можно выполнить в Executor БД; nullopt - запрос не к рекордам или с ошибкой
+        std::optional<RecordsQuery> GetExecutorRecordsQuery(std::string_view target) const;
+
         // Возвращает true, если каталог p содержится внутри base_path.
         bool IsSubPath(fs::path path) const;
 
@@ -164,12 +264,21 @@ namespace http_handler {
         const fs::path static_path_;
         model::Game& game_;
         Strand api_strand_;
+        // Доступен только из api_strand_
+        StateCache state_cache_;
+        const std::chrono::milliseconds shed_queue_delay_;
+        QueueDelayMonitor queue_delay_;
+        metrics::Histogram queue_delay_histogram_ = metrics::Registry::Instance().AddHistogram(
+            "api_queue_delay_microseconds", "Time API requests wait for the game strand");
+        metrics::Counter shed_requests_ = metrics::Registry::Instance().AddCounter(
+            "http_shed_requests_total", "Number of API requests rejected with 503 by load shedding");
+        const std::shared_ptr<db_executor::Executor> db_executor_;
     };
 
     class ApiHandler {
     public:
-        explicit ApiHandler(model::Game& game)
-            : game_(game) {}
+        ApiHandler(model::Game& game, StateCache& state_cache)
+            : game_(game), state_cache_(state_cache) {}
 
         template <typename Body, typename Allocator>
         HandlerResponse operator()(http::request<Body, http::basic_fields<Allocator>>&& req) {
@@ -204,11 +313,16 @@ namespace http_handler {
             }
         }
 
-    private:
+        static RequestTarget GetRequestTarget(std::string_view target);
 
-        RequestTarget GetRequestTarget(std::string_view target);
+        // nullopt, если параметры некорректны; ответ с ошибкой тогда формирует обработчик рекордов
+        static std::optional<RecordsQuery> ParseRecordsQuery(const std::string& target);
+
+    private:
+        // Бросает исключение, если параметр не число
+        static RecordsQuery ParseRecordsParams(const std::string& target);
 
-        std::unordered_map<std::string, std::string> ParseURI(const std::string& query) const;
+        static std::unordered_map<std::string, std::string> ParseURI(const std::string& query);
 
         template <typename Body, typename Allocator>
         HandlerResponse ResponseRecordsTarget(http::request<Body, http::basic_fields<Allocator>>&& req) {
@@ -217,26 +331,20 @@ namespace http_handler {
                     return MakeStringResponse(status, text, body_size, req.version(), req.keep_alive(), ContentType::JSON);
                     };
 
-                std::unordered_map<std::string, std::string> params = ParseURI(std::string(req.target()));
-                int start;
-                int max_items;
+                RecordsQuery query;
                 try {
-                    if (params.count("start")) {
-                        start = std::stoi(params.at("start"));
-                    }
-
-                    if (params.count("maxItems")) {
-                        if (std::stoi(params.at("maxItems")) > 100) {
-                            return ResponseBadRequestApi(std::move(req), "invalidArgument", "maxItems mast be under 100");
-                        }
-                        max_items = std::stoi(params.at("maxItems"));
+                    query = ParseRecordsParams(std::string(req.target()));
+                    if (query.max_items > 100) {
+                        return ResponseBadRequestApi(std::move(req), "invalidArgument", "maxItems mast be under 100");
                     }
                 }
                 catch (const std::exception& e ) {
                     return ResponseBadRequestApi(std::move(req), "invalidArgument", e.what());
                 }
 
-                std::string str_response = std::move(json::serialize(game_.GetRecords(max_items, start)));
+                std::string str_response = query.paged
+                    ? SerializeRecordsPage(game_.GetRecordsPage(query.max_items, query.after), query.max_items)
+                    : json::serialize(game_.GetWindowRecords(query.window, query.max_items, query.start));
                 StringResponse result_response = json_response(http::status::ok, str_response, str_response.size());
                 result_response.set(http::field::cache_control, "no-cache");
 
@@ -285,9 +393,9 @@ namespace http_handler {
                 if (req.find(http::field::authorization) == req.end()) {
                     return ResponseUnauthorized(std::move(req), "invalidToken", "Authorization header is missing");
                 }
-                std::string token = std::string(req.at(http::field::authorization));
+                const std::string_view token = req.at(http::field::authorization);
 
-                if (std::string start = "Bearer "s; !token.starts_with(start) || token.size() != 39) {
+                if (!token.starts_with("Bearer "sv) || token.size() != 39) {
                     return ResponseUnauthorized(std::move(req), "invalidToken", "Authorization header not correct");
                 }
 
@@ -295,8 +403,9 @@ namespace http_handler {
                     return ResponseBadRequestApi(std::move(req), "invalidArgument", "Invalid content type");
                 }
                 
-                if (model::Player* player = game_.FindPlayerByToken(model::Token(token.substr(7))); player) {
-                    return ResponseAction(std::move(req), player);
+                std::optional<model::Token> player_token = model::Token::FromString(token.substr(7));
+                if (model::Player* player = player_token ? game_.FindPlayerByToken(*player_token) : nullptr; player) {
+                    return ResponseAction(std::move(req), player, *player_token);
 
                 }
                 else {
@@ -309,7 +418,7 @@ namespace http_handler {
         }
 
         template <typename Body, typename Allocator>
-        HandlerResponse ResponseAction(http::request<Body, http::basic_fields<Allocator>>&& req, model::Player* player) {
+        HandlerResponse ResponseAction(http::request<Body, http::basic_fields<Allocator>>&& req, model::Player* player, const model::Token& token) {
             if (req.method() == http::verb::post) {
                 json::value request;
                 std::string move;
@@ -325,24 +434,7 @@ namespace http_handler {
                     return ResponseBadRequestApi(std::move(req), "invalidArgument", "Failed to parse action");
                 }
 
-                if (move.empty()) {
-                    player->SetStopDir();
-                    return ResponseOkAction(std::move(req));
-                }
-                if (move[0] == 'L') {
-                    player->SetLeftDir();
-                    return ResponseOkAction(std::move(req));
-                }
-                if (move[0] == 'R') {
-                    player->SetRightDir();
-                    return ResponseOkAction(std::move(req));
-                }
-                if (move[0] == 'U') {
-                    player->SetUpDir();
-                    return ResponseOkAction(std::move(req));
-                }
-                if (move[0] == 'D') {
-                    player->SetDownDir();
+                if (game_.MovePlayer(token, *player, move)) {
                     return ResponseOkAction(std::move(req));
                 }
 
@@ -374,13 +466,14 @@ namespace http_handler {
                 if (req.find(http::field::authorization) == req.end()) {
                     return ResponseUnauthorized(std::move(req), "invalidToken", "Authorization header is missing");
                 }
-                std::string token = std::string(req.at(http::field::authorization));
+                const std::string_view token = req.at(http::field::authorization);
 
-                if (std::string start = "Bearer "s; !token.starts_with(start) || token.size() != 39) {
+                if (!token.starts_with("Bearer "sv) || token.size() != 39) {
                     return ResponseUnauthorized(std::move(req), "invalidToken", "Authorization header not correct");
                 }
 
-                if (const model::Player* player = game_.FindPlayerByToken(model::Token(token.substr(7))); player) {
+                std::optional<model::Token> player_token = model::Token::FromString(token.substr(7));
+                if (const model::Player* player = player_token ? game_.FindPlayerByToken(*player_token) : nullptr; player) {
                     return ResponseState(std::move(req), player->GetSessionPtr());
 
                 }
@@ -399,9 +492,22 @@ namespace http_handler {
                 return MakeStringResponse(status, text, body_size, req.version(), req.keep_alive(), ContentType::JSON);
             };
 
+            const degradation::Controller& degradation = game_.GetDegradation();
+            if (!degradation.IsActive(degradation::Action::THROTTLE_STATE)) {
+                state_cache_.clear();
+            }
+            else if (auto it = state_cache_.find(session_ptr); it != state_cache_.end()
+                && std::chrono::steady_clock::now() - it->second.built < degradation.GetConfig().state_throttle) {
+                StringResponse result_response = json_response(http::status::ok, it->second.body, it->second.body.size());
+                result_response.set(http::field::cache_control, "no-cache");
+                return HandlerResponse(result_response);
+            }
+
             json::object players;
 
-            for (const std::shared_ptr<model::Dog>& dog : session_ptr->GetDogs()) {
+            const std::deque<std::shared_ptr<model::Dog>>& dogs = session_ptr->GetDogs();
+            for (size_t dog_index = 0; dog_index < dogs.size(); ++dog_index) {
+                const std::shared_ptr<model::Dog>& dog = dogs[dog_index];
 
                 json::object obj_to_player;
 
@@ -436,11 +542,12 @@ namespace http_handler {
 
                 json::array bags;
 
-                model::Player* player_ptr = game_.FindByDogIdAndMapId(dog->GetId(), session_ptr->GetMapId());
-                for (std::shared_ptr<model::Loot> loot : player_ptr->GetLootVector()) {
+                const model::Player* player_ptr = session_ptr->GetDogPlayer(dog_index);
+                for (model::LootHandle handle : player_ptr->GetLootHandles()) {
+                    const model::Loot& loot = session_ptr->GetLoot(handle);
                     json::object item;
-                    item.emplace("id", loot->GetLootId());
-                    item.emplace("type", loot->GetLootType());
+                    item.emplace("id", loot.GetLootId());
+                    item.emplace("type", loot.GetLootType());
                     bags.emplace_back(item);
                 }
 
@@ -453,17 +560,19 @@ namespace http_handler {
 
             json::object lost_objects;
 
-            const std::vector<std::shared_ptr<model::Loot>>& loots = session_ptr->GetLootVector();
-            for (int i = 0; i < loots.size(); ++i) {
+            for (model::LootHandle handle : session_ptr->GetLootHandles()) {
+                const model::Loot& loot = session_ptr->GetLoot(handle);
                 json::object info;
-                info.emplace("type", loots.at(i)->GetLootType());
+                info.emplace("type", loot.GetLootType());
 
                 json::array pos;
-                pos.emplace_back(loots.at(i)->GetPosition().x);
-                pos.emplace_back(loots.at(i)->GetPosition().y);
+                pos.emplace_back(loot.GetPosition().x);
+                pos.emplace_back(loot.GetPosition().y);
                 info.emplace("pos", pos);
 
-                lost_objects.emplace(std::to_string(i), info);
+                // Ключ - id предмета: он не меняется, пока предмет лежит на карте, поэтому клиент
+                // может сопоставлять предметы между запросами
+                lost_objects.emplace(std::to_string(loot.GetLootId()), info);
             }
 
             json::object result;
@@ -474,14 +583,23 @@ namespace http_handler {
             StringResponse result_response = json_response(http::status::ok, str_response, str_response.size());
             result_response.set(http::field::cache_control, "no-cache");
 
+            if (degradation.IsActive(degradation::Action::THROTTLE_STATE)) {
+                state_cache_[session_ptr] = CachedState{ std::chrono::steady_clock::now(), std::move(str_response) };
+            }
+
             return HandlerResponse(result_response);
         }
 
         template <typename Body, typename Allocator>
         HandlerResponse ResponseJoinTarget(http::request<Body, http::basic_fields<Allocator>>&& req) {
             if (req.method() == http::verb::post) {
+                if (game_.GetDegradation().IsActive(degradation::Action::REJECT_JOINS)) {
+                    return ResponseServiceUnavailable(std::move(req), "serverOverloaded", "Server is overloaded, try again later");
+                }
                 json::value request;
                 std::string dog_name;
+                // Идентификатор карты переводится в индекс один раз, дальше карта ищется по индексу
+                size_t map_index = 0;
                 try {
                     request = json::parse(req.body());
                     if (request.as_object().find("userName") == request.as_object().end() || request.as_object().at("userName").as_string().empty()) {
@@ -491,17 +609,19 @@ namespace http_handler {
                         return ResponseBadRequestApi(std::move(req), "invalidArgument", "Invalid map");
                     }
                     model::Map::Id map_id(std::string(request.as_object().at("mapId").as_string()));
-                    if (!game_.FindMap(map_id)) {
+                    const model::Map* map = game_.FindMap(map_id);
+                    if (!map) {
                         return ResponseMapNotFound(std::move(req));
                     }
+                    map_index = map->GetIndex();
                     dog_name = std::string(request.as_object().at("userName").as_string());
                 }
                 catch (const std::exception& e) {
                     return ResponseBadRequestApi(std::move(req), "invalidArgument", "Join game request parse error");
                 }
-                model::GameSession& session = game_.GetSession(model::Map::Id(std::string(request.as_object().at("mapId").as_string())));
+                model::GameSession& session = game_.GetSession(map_index);
                 auto [token, player] = game_.AddPlayer(dog_name, &session);
-                return ResponseJoin(std::move(req), *token, player.GetId());
+                return ResponseJoin(std::move(req), token.ToString(), player.GetId());
             }
             else {
                 return ResponseMethodNotAllowed(std::move(req), "invalidMethod", "Only POST method is expected", "POST");
@@ -515,13 +635,14 @@ namespace http_handler {
                 if (req.find(http::field::authorization) == req.end()) {
                     return ResponseUnauthorized(std::move(req), "invalidToken", "Authorization header is missing");
                 }
-                std::string token = std::string(req.at(http::field::authorization));
+                const std::string_view token = req.at(http::field::authorization);
 
-                if (std::string start = "Bearer "s; !token.starts_with(start)) {
+                if (!token.starts_with("Bearer "sv)) {
                     return ResponseUnauthorized(std::move(req), "invalidToken", "Authorization header not correct");
                 }
 
-                if (const model::Player* player = game_.FindPlayerByToken(model::Token(token.substr(7))); player) {
+                std::optional<model::Token> player_token = model::Token::FromString(token.substr(7));
+                if (const model::Player* player = player_token ? game_.FindPlayerByToken(*player_token) : nullptr; player) {
                     return ResponsePlayers(std::move(req));
                 }
                 else {
@@ -589,6 +710,11 @@ namespace http_handler {
             return HandlerResponse(result_response);
         }
 
+        template <typename Body, typename Allocator>
+        HandlerResponse ResponseServiceUnavailable(http::request<Body, http::basic_fields<Allocator>>&& req, std::string_view code, std::string_view message) const {
+            return http_handler::ResponseServiceUnavailable(req.version(), req.keep_alive(), code, message);
+        }
+
         template <typename Body, typename Allocator>
         HandlerResponse ResponseMapNotFound(http::request<Body, http::basic_fields<Allocator>>&& req) const {
             const auto json_response = [&req](http::status status, std::string_view text, size_t body_size) {
@@ -701,6 +827,7 @@ namespace http_handler {
         }
 
         model::Game& game_;
+        StateCache& state_cache_;
     };
 
     template<class SomeRequestHandler>
@@ -727,7 +854,8 @@ namespace http_handler {
 
             LogRequest(ip, http::to_string(req.method()), req.target());
 
-            auto response_handle = [s = std::move(send), now](HandlerResponse response) {
+            const RouteMetrics& route_metrics = GetRouteMetrics(req.target());
+            auto response_handle = [s = std::move(send), now, &route_metrics, start = std::chrono::steady_clock::now()](HandlerResponse response) {
                 std::string content_type = "null"s;
                 int result_code;
 
@@ -747,6 +875,9 @@ namespace http_handler {
                     }
                     s(resp);
                 }
+                route_metrics.requests.Add();
+                route_metrics.latency.Observe(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+
                 boost::posix_time::time_duration duration = boost::posix_time::microsec_clock::local_time() - now;
                 json::value response_data{ {"response_time"s, duration.total_milliseconds()},
                     {"code"s, result_code},
@@ -0,0 +1,181 @@
+#include "tick_profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace tick_profiler {
+
+namespace {
+
+json::object PhasesToJson(const PhaseTimes& phases) {
+    json::object result;
+    for (size_t i = 0; i < PHASES_COUNT; ++i) {
+        result.emplace(PhaseName(static_cast<Phase>(i)), phases[i].count());
+    }
+    return result;
+}
+
+void AddPhases(PhaseTimes& to, const PhaseTimes& from) {
+    for (size_t i = 0; i < PHASES_COUNT; ++i) {
+        to[i] += from[i];
+    }
+}
+
+}  // namespace
+
+std::string_view PhaseName(Phase phase) {
+    using namespace std::literals;
+    switch (phase) {
+    case Phase::INACTIVE_PLAYERS:
+        return "inactivePlayers"sv;
+    case Phase::COMPACT_SESSIONS:
+        return "compactSessions"sv;
+    case Phase::MOVEMENT:
+        return "movement"sv;
+    case Phase::GATHER_EVENTS:
+        return "gatherEvents"sv;
+    case Phase::LOOT_EXCHANGE:
+        return "lootExchange"sv;
+    case Phase::ERASE_LOOT:
+        return "eraseLoot"sv;
+    case Phase::LOOT_GENERATION:
+        return "lootGeneration"sv;
+    case Phase::LISTENER:
+        return "listener"sv;
+    case Phase::COUNT:
+        break;
+    }
+    return "unknown"sv;
+}
+
+TickProfiler::TickProfiler(size_t capacity)
+    : ring_(capacity) {
+    if (capacity == 0) {
+        throw std::invalid_argument("Tick profiler capacity must be positive");
+    }
+}
+
+void TickProfiler::BeginTick(int64_t time_delta) {
+    current_ = &ring_[next_];
+    current_->tick_number = ++tick_counter_;
+    current_->time_delta = time_delta;
+    current_->total = Micros{};
+    current_->phases = PhaseTimes{};
+    current_->sessions.clear();
+    current_session_ = nullptr;
+    tick_start_ = Clock::now();
+}
+
+void TickProfiler::BeginSession(std::string_view map_id, size_t session_index, uint64_t dogs) {
+    if (!current_) {
+        return;
+    }
+    SessionProfile& session = current_->sessions.emplace_back();
+    session.map_id = map_id;
+    session.session_index = session_index;
+    session.dogs = dogs;
+    current_session_ = &session;
+}
+
+void TickProfiler::Record(Phase phase, Micros duration) noexcept {
+    if (!current_) {
+        return;
+    }
+    const size_t index = static_cast<size_t>(phase);
+    current_->phases[index] += duration;
+    if (current_session_) {
+        current_session_->phases[index] += duration;
+    }
+}
+
+void TickProfiler::EndSession() noexcept {
+    current_session_ = nullptr;
+}
+
+const TickProfile& TickProfiler::EndTick(bool completed) {
+    if (!current_) {
+        throw std::logic_error("EndTick without BeginTick");
+    }
+    current_->total = std::chrono::duration_cast<Micros>(Clock::now() - tick_start_);
+    current_->completed = completed;
+    const TickProfile& finished = *current_;
+    current_ = nullptr;
+    current_session_ = nullptr;
+    next_ = (next_ + 1) % ring_.size();
+    size_ = std::min(size_ + 1, ring_.size());
+    return finished;
+}
+
+const TickProfile& TickProfiler::GetLast() const {
+    static const TickProfile empty;
+    if (size_ == 0) {
+        return empty;
+    }
+    return ring_[(next_ + ring_.size() - 1) % ring_.size()];
+}
+
+std::vector<const TickProfile*> TickProfiler::GetRecent() const {
+    std::vector<const TickProfile*> result;
+    result.reserve(size_);
+    const size_t first = (next_ + ring_.size() - size_) % ring_.size();
+    for (size_t i = 0; i < size_; ++i) {
+        result.push_back(&ring_[(first + i) % ring_.size()]);
+    }
+    return result;
+}
+
+json::object TickProfileToJson(const TickProfile& profile, bool with_sessions) {
+    json::object result;
+    result.emplace("tick", profile.tick_number);
+    result.emplace("timeDelta", profile.time_delta);
+    result.emplace("totalUs", profile.total.count());
+    result.emplace("completed", profile.completed);
+    result.emplace("phasesUs", PhasesToJson(profile.phases));
+
+    struct MapTotals {
+        std::string_view map_id;
+        size_t sessions = 0;
+        uint64_t dogs = 0;
+        PhaseTimes phases{};
+    };
+    // Карт немного, линейный поиск дешевле хеширования
+    std::vector<MapTotals> maps;
+    for (const SessionProfile& session : profile.sessions) {
+        auto it = std::find_if(maps.begin(), maps.end(), [&session](const MapTotals& totals) {
+            return totals.map_id == session.map_id;
+        });
+        if (it == maps.end()) {
+            it = maps.insert(maps.end(), MapTotals{ session.map_id });
+        }
+        ++it->sessions;
+        it->dogs += session.dogs;
+        AddPhases(it->phases, session.phases);
+    }
+
+    json::object maps_json;
+    for (const MapTotals& totals : maps) {
+        json::object map_json;
+        map_json.emplace("sessions", totals.sessions);
+        map_json.emplace("dogs", totals.dogs);
+        map_json.emplace("phasesUs", PhasesToJson(totals.phases));
+        maps_json.emplace(totals.map_id, map_json);
+    }
+    result.emplace("maps", maps_json);
+
+    if (with_sessions) {
+        json::array sessions_json;
+        for (const SessionProfile& session : profile.sessions) {
+            json::object session_json;
+            session_json.emplace("map", session.map_id);
+            session_json.emplace("session", session.session_index);
+            session_json.emplace("dogs", session.dogs);
+            session_json.emplace("phasesUs", PhasesToJson(session.phases));
+            sessions_json.emplace_back(session_json);
+        }
+        result.emplace("sessions", sessions_json);
+    }
+    return result;
+}
+
+}  // namespace tick_profiler
@@ -0,0 +1,129 @@
+#pragma once
+#include <boost/json.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <string_view>
+#include <vector>
+
+namespace tick_profiler {
+
+namespace json = boost::json;
+
+using Clock = std::chrono::steady_clock;
+using Micros = std::chrono::microseconds;
+
+// Стадии Game::GameTick в порядке выполнения
+enum class Phase {
+    INACTIVE_PLAYERS, COMPACT_SESSIONS, MOVEMENT, GATHER_EVENTS, LOOT_EXCHANGE, ERASE_LOOT, LOOT_GENERATION, LISTENER, COUNT
+};
+
+constexpr size_t PHASES_COUNT = static_cast<size_t>(Phase::COUNT);
+
+using PhaseTimes = std::array<Micros, PHASES_COUNT>;
+
+std::string_view PhaseName(Phase phase);
+
+struct SessionProfile {
+    // Указывает на идентификатор карты внутри model::Game, который живёт дольше профиля
+    std::string_view map_id;
+    size_t session_index = 0;
+    uint64_t dogs = 0;
+    PhaseTimes phases{};
+};
+
+struct TickProfile {
+    uint64_t tick_number = 0;
+    int64_t time_delta = 0;
+    // false, если тик прерван исключением
+    bool completed = false;
+    Micros total{};
+    PhaseTimes phases{};
+    std::vector<SessionProfile> sessions;
+};
+
+/*
+ * Профилировщик стадий тика.
+ * Последние тики хранятся в кольцевом буфере, буферы сессий переиспользуются между тиками,
+ * поэтому в установившемся режиме замеры не выделяют память.
+ * Все методы вызываются из strand игры.
+ */
+class TickProfiler {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 128;
+
+    explicit TickProfiler(size_t capacity = DEFAULT_CAPACITY);
+
+    void BeginTick(int64_t time_delta);
+
+    void BeginSession(std::string_view map_id, size_t session_index, uint64_t dogs);
+
+    // Время стадии добавляется к текущей сессии (если она открыта) и к итогам тика
+    void Record(Phase phase, Micros duration) noexcept;
+
+    void EndSession() noexcept;
+
+    const TickProfile& EndTick(bool completed = true);
+
+    // Последний завершённый тик; до первого тика возвращает пустой профиль
+    const TickProfile& GetLast() const;
+
+    // Завершённые тики от самого старого к самому новому
+    std::vector<const TickProfile*> GetRecent() const;
+
+private:
+    std::vector<TickProfile> ring_;
+    size_t next_ = 0;
+    size_t size_ = 0;
+    uint64_t tick_counter_ = 0;
+    TickProfile* current_ = nullptr;
+    SessionProfile* current_session_ = nullptr;
+    Clock::time_point tick_start_;
+};
+
+// Открывает тик при создании и завершает при разрушении, в том числе при выходе по исключению,
+// чтобы прерванный тик не оставлял последним профиль предыдущего
+class TickScope {
+public:
+    TickScope(TickProfiler& profiler, int64_t time_delta)
+        : profiler_(profiler), uncaught_exceptions_(std::uncaught_exceptions()) {
+        profiler_.BeginTick(time_delta);
+    }
+
+    TickScope(const TickScope&) = delete;
+    TickScope& operator=(const TickScope&) = delete;
+
+    ~TickScope() {
+        profiler_.EndTick(std::uncaught_exceptions() == uncaught_exceptions_);
+    }
+
+private:
+    TickProfiler& profiler_;
+    int uncaught_exceptions_;
+};
+
+// Замеряет стадию тика от создания до разрушения
+class PhaseTimer {
+public:
+    PhaseTimer(TickProfiler& profiler, Phase phase) noexcept
+        : profiler_(profiler), phase_(phase), start_(Clock::now()) {}
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    ~PhaseTimer() {
+        profiler_.Record(phase_, std::chrono::duration_cast<Micros>(Clock::now() - start_));
+    }
+
+private:
+    TickProfiler& profiler_;
+    Phase phase_;
+    Clock::time_point start_;
+};
+
+// with_sessions = false оставляет только итоги тика и разбивку по картам (для журнала)
+json::object TickProfileToJson(const TickProfile& profile, bool with_sessions = true);
+
+}  // namespace tick_profiler
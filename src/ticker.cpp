@@ -5,16 +5,31 @@ Ticker::Ticker(Strand strand, std::chrono::milliseconds period, Handler handler)
     , period_{ period }
     , handler_{ std::move(handler) } {}
 
+void Ticker::SetFixedStep(unsigned max_catch_up_steps) {
+    fixed_step_.emplace(max_catch_up_steps);
+}
+
 void Ticker::Start() {
     net::dispatch(strand_, [self = shared_from_this()] {
         self->last_tick_ = Clock::now();
+        self->next_deadline_ = self->last_tick_ + self->period_;
         self->ScheduleTick();
         });
 }
 
+void Ticker::SetPeriod(std::chrono::milliseconds period) {
+    assert(strand_.running_in_this_thread());
+    period_ = period;
+}
+
 void Ticker::ScheduleTick() {
     assert(strand_.running_in_this_thread());
-    timer_.expires_after(period_);
+    if (fixed_step_) {
+        timer_.expires_at(next_deadline_);
+    }
+    else {
+        timer_.expires_after(period_);
+    }
     timer_.async_wait([self = shared_from_this()](sys::error_code ec) {
         self->OnTick(ec);
         });
@@ -26,13 +41,36 @@ void Ticker::OnTick(sys::error_code ec) {
 
     if (!ec) {
         auto this_tick = Clock::now();
-        auto delta = duration_cast<milliseconds>(this_tick - last_tick_);
+        auto elapsed = this_tick - last_tick_;
+        auto delta = duration_cast<milliseconds>(elapsed);
         last_tick_ = this_tick;
-        try {
-            handler_(delta);
+
+        if (!fixed_step_) {
+            try {
+                handler_(delta);
+            }
+            catch (...) {
+            }
+            return ScheduleTick();
+        }
+
+        // Шаги считаются по периоду на начало тика, даже если handler его поменяет
+        const milliseconds step = period_;
+        const fixed_step::Steps steps = fixed_step_->Advance(elapsed, step);
+        for (unsigned i = 0; i < steps.run; ++i) {
+            try {
+                handler_(step);
+            }
+            catch (...) {
+            }
+        }
+        if (steps.run > 1) {
+            catch_up_steps_.Add(steps.run - 1);
         }
-        catch (...) {
+        if (steps.dropped > 0) {
+            dropped_steps_.Add(steps.dropped);
         }
+        next_deadline_ = fixed_step_->GetNextDeadline(this_tick, period_);
         ScheduleTick();
     }
-}
\ No newline at end of file
+}
@@ -6,6 +6,10 @@
 #include <boost/asio/steady_timer.hpp>
 
 #include <memory>
+#include <optional>
+
+#include "fixed_step.h"
+#include "metrics.h"
 
 namespace net = boost::asio;
 namespace sys = boost::system;
@@ -18,8 +22,16 @@ public:
     //  handler    strand   period
     Ticker(Strand strand, std::chrono::milliseconds period, Handler handler);
 
+    //   : handler   period,   (expires_at),
+    //       max_catch_up_steps  ,  .
+    //   Start
+    void SetFixedStep(unsigned max_catch_up_steps);
+
     void Start();
 
+    //    ;   strand
+    void SetPeriod(std::chrono::milliseconds period);
+
 private:
     void ScheduleTick();
 
@@ -32,4 +44,13 @@ private:
     net::steady_timer timer_{ strand_ };
     Handler handler_;
     std::chrono::steady_clock::time_point last_tick_;
+
+    //     
+    std::optional<fixed_step::Accumulator> fixed_step_;
+    Clock::time_point next_deadline_;
+
+    metrics::Counter catch_up_steps_ = metrics::Registry::Instance().AddCounter(
+        "game_tick_catch_up_steps_total", "Extra fixed steps run to catch up with a late tick");
+    metrics::Counter dropped_steps_ = metrics::Registry::Instance().AddCounter(
+        "game_tick_dropped_steps_total", "Fixed steps dropped because the catch-up limit was exceeded");
 };
\ No newline at end of file
@@ -0,0 +1,354 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+#include "../src/action_journal.h"
+#include "../src/extra_data.h"
+#include "../src/loot_generator.h"
+#include "../src/model.h"
+#include "../src/model_serialization.h"
+
+using namespace std::literals;
+using namespace journal;
+
+SCENARIO("Action journal records") {
+    GIVEN("entries of every kind") {
+        std::string data;
+        data += EncodeEntry(Entry{ 1, JoinRecord{ "0123456789abcdef0123456789abcdef"s, "Pluto"s, "map1"s, 7, 1.5, -2.25 } });
+        data += EncodeEntry(Entry{ 2, MoveRecord{ "0123456789abcdef0123456789abcdef"s, "L"s } });
+        data += EncodeEntry(Entry{ 3, TickRecord{ 50, 0xDEADBEEFCAFEull, false, 250 } });
+        data += EncodeEntry(Entry{ 4, RetireRecord{ "0123456789abcdef0123456789abcdef"s } });
+
+        WHEN("they are decoded") {
+            const std::vector<Entry> entries = DecodeEntries(data);
+
+            THEN("all fields survive the round trip") {
+                REQUIRE(entries.size() == 4);
+                CHECK(entries[0].seq == 1);
+                const JoinRecord& join = std::get<JoinRecord>(entries[0].record);
+                CHECK(join.dog_name == "Pluto"s);
+                CHECK(join.map_id == "map1"s);
+                CHECK(join.dog_id == 7);
+                CHECK(join.x == 1.5);
+                CHECK(join.y == -2.25);
+                CHECK(std::get<MoveRecord>(entries[1].record).move == "L"s);
+                const TickRecord& tick = std::get<TickRecord>(entries[2].record);
+                CHECK(tick.seed == 0xDEADBEEFCAFEull);
+                CHECK(tick.generate_loot == false);
+                CHECK(tick.time_without_loot == 250);
+                CHECK(std::get<RetireRecord>(entries[3].record).token == join.token);
+            }
+        }
+
+        WHEN("a tick was recorded before the loot generator state was journaled") {
+            const std::vector<Entry> entries = DecodeEntries(EncodeEntry(Entry{ 5, TickRecord{ 50, 1 } }));
+
+            THEN("the record is read without it") {
+                REQUIRE(entries.size() == 1);
+                const TickRecord& tick = std::get<TickRecord>(entries[0].record);
+                CHECK(tick.time_delta == 50);
+                CHECK_FALSE(tick.generate_loot.has_value());
+                CHECK_FALSE(tick.time_without_loot.has_value());
+            }
+        }
+
+        WHEN("the last record was torn by a crash") {
+            data.resize(data.size() - 3);
+
+            THEN("only complete records are returned") {
+                CHECK(DecodeEntries(data).size() == 3);
+            }
+        }
+
+        WHEN("a record in the middle is corrupted") {
+            const size_t first_size = EncodeEntry(Entry{ 1, JoinRecord{ "0123456789abcdef0123456789abcdef"s, "Pluto"s, "map1"s, 7, 1.5, -2.25 } }).size();
+            data[first_size + 10] ^= 0x5A;
+
+            THEN("decoding stops before it") {
+                CHECK(DecodeEntries(data).size() == 1);
+            }
+        }
+    }
+}
+
+SCENARIO("Recovery from the action journal") {
+    GIVEN("a game logging actions to a journal") {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "action-journal-tests";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        const std::filesystem::path state_path = dir / "game.state";
+
+        auto make_game = [] {
+            model::Game game;
+            auto extra_data = std::make_shared<ExtraData>();
+            boost::json::array loot_types{ "key"s, "wallet"s };
+            extra_data->InsertMapInfo(loot_types);
+            game.SetExtraData(extra_data);
+            game.SetLootGenerator(std::make_shared<loot_gen::LootGenerator>(100ms, 1.0));
+            model::Map map(model::Map::Id("testmap"s), "Test map"s, 1, 3);
+            map.AddRoad(model::Road(model::Road::HORIZONTAL, { 0, 0 }, 40));
+            game.AddMap(std::move(map));
+            return game;
+        };
+
+        model::Game game = make_game();
+        model::Token token;
+        {
+            serialization::SerializingListener listener(0ms, game, state_path, true);
+            game.SetApplicationListener(&listener);
+            listener.RestoreGame(game);
+
+            model::GameSession& session = game.GetSession(model::Map::Id("testmap"s));
+            auto [player_token, player] = game.AddPlayer("Pluto"s, &session);
+            token = player_token;
+            game.MovePlayer(token, player, "R"sv);
+            for (int i = 0; i < 3; ++i) {
+                game.GameTick(200);
+            }
+            // Снимок покрывает начало журнала, дальше пишется только журнал
+            listener.SaveStateGame();
+            game.MovePlayer(token, *game.FindPlayerByToken(token), "D"sv);
+            game.MovePlayer(token, *game.FindPlayerByToken(token), "L"sv);
+            for (int i = 0; i < 2; ++i) {
+                game.GameTick(200);
+            }
+            game.SetApplicationListener(nullptr);
+        }
+
+        THEN("journal segments covered by the snapshot are removed") {
+            CHECK_FALSE(std::filesystem::exists(dir / "game.state.journal.1"));
+        }
+
+        WHEN("a new game restores the snapshot and replays the journal tail") {
+            model::Game restored = make_game();
+            serialization::SerializingListener listener(0ms, restored, state_path, true);
+            listener.RestoreGame(restored);
+
+            THEN("the player, its position and the generated loot match") {
+                model::Player* original = game.FindPlayerByToken(token);
+                model::Player* replayed = restored.FindPlayerByToken(token);
+                REQUIRE(original != nullptr);
+                REQUIRE(replayed != nullptr);
+                CHECK(replayed->GetPetName() == "Pluto"s);
+                CHECK(replayed->GetPetPosition().x == original->GetPetPosition().x);
+                CHECK(replayed->GetPetPosition().y == original->GetPetPosition().y);
+
+                model::GameSession* original_session = original->GetSessionPtr();
+                model::GameSession* replayed_session = replayed->GetSessionPtr();
+                REQUIRE(replayed_session->GetLootCount() == original_session->GetLootCount());
+                for (size_t i = 0; i < original_session->GetLootCount(); ++i) {
+                    CHECK(replayed_session->GetLoot(i).GetPosition().x == original_session->GetLoot(i).GetPosition().x);
+                }
+            }
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+}
+
+SCENARIO("Replay of ticks with loot generation") {
+    GIVEN("a game whose loot generator accumulates time between ticks") {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "action-journal-loot-tests";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        const std::filesystem::path state_path = dir / "game.state";
+
+        auto make_game = [] {
+            model::Game game;
+            auto extra_data = std::make_shared<ExtraData>();
+            boost::json::array loot_types{ "key"s, "wallet"s, "coin"s };
+            extra_data->InsertMapInfo(loot_types);
+            game.SetExtraData(extra_data);
+            // При тике 100 мс трофей появляется только после нескольких тиков без трофеев
+            game.SetLootGenerator(std::make_shared<loot_gen::LootGenerator>(1s, 0.5));
+            model::Map map(model::Map::Id("testmap"s), "Test map"s, 1, 3);
+            map.AddRoad(model::Road(model::Road::HORIZONTAL, { 0, 0 }, 40));
+            game.AddMap(std::move(map));
+            return game;
+        };
+
+        model::Game game = make_game();
+        std::vector<model::Token> tokens;
+        {
+            serialization::SerializingListener listener(0ms, game, state_path, true);
+            game.SetApplicationListener(&listener);
+            listener.RestoreGame(game);
+
+            for (const std::string name : { "Pluto"s, "Goofy"s }) {
+                model::GameSession& session = game.GetSession(model::Map::Id("testmap"s));
+                auto [token, player] = game.AddPlayer(name, &session);
+                game.MovePlayer(token, player, "R"sv);
+                tokens.push_back(token);
+            }
+            for (int i = 0; i < 7; ++i) {
+                game.GameTick(100);
+            }
+            listener.SaveStateGame();
+            REQUIRE(game.GetTimeWithoutLoot() != 0ms);
+
+            // Деградация пропускает генерацию трофеев; при восстановлении её уже нет
+            degradation::Config config;
+            config.ladder = { degradation::Action::SKIP_LOOT_GENERATION };
+            config.escalate_after_ticks = 1;
+            config.recover_after_ticks = 1;
+            game.GetDegradation().SetConfig(config);
+            game.GetDegradation().OnTickFinished(100ms, 100ms);
+            REQUIRE(game.GetDegradation().IsActive(degradation::Action::SKIP_LOOT_GENERATION));
+            for (int i = 0; i < 6; ++i) {
+                game.GameTick(100);
+            }
+            game.GetDegradation().OnTickFinished(0ms, 100ms);
+            REQUIRE_FALSE(game.GetDegradation().IsActive(degradation::Action::SKIP_LOOT_GENERATION));
+            game.MovePlayer(tokens[0], *game.FindPlayerByToken(tokens[0]), "L"sv);
+            for (int i = 0; i < 12; ++i) {
+                game.GameTick(100);
+            }
+            game.SetApplicationListener(nullptr);
+        }
+
+        WHEN("a new game restores the snapshot and replays the journal") {
+            model::Game restored = make_game();
+            serialization::SerializingListener listener(0ms, restored, state_path, true);
+            listener.RestoreGame(restored);
+
+            THEN("the whole game state matches the live game") {
+                CHECK(restored.GetTimeWithoutLoot() == game.GetTimeWithoutLoot());
+                for (const model::Token& token : tokens) {
+                    model::Player* original = game.FindPlayerByToken(token);
+                    model::Player* replayed = restored.FindPlayerByToken(token);
+                    REQUIRE(original != nullptr);
+                    REQUIRE(replayed != nullptr);
+                    CHECK(replayed->GetPetPosition().x == original->GetPetPosition().x);
+                    CHECK(replayed->GetPetPosition().y == original->GetPetPosition().y);
+                    CHECK(replayed->GetScore() == original->GetScore());
+                    CHECK(replayed->GetLootCount() == original->GetLootCount());
+                }
+
+                model::GameSession* original_session = game.FindPlayerByToken(tokens[0])->GetSessionPtr();
+                model::GameSession* replayed_session = restored.FindPlayerByToken(tokens[0])->GetSessionPtr();
+                REQUIRE(original_session->GetLootCount() > 0);
+                REQUIRE(replayed_session->GetLootCount() == original_session->GetLootCount());
+                for (size_t i = 0; i < original_session->GetLootCount(); ++i) {
+                    CHECK(replayed_session->GetLoot(i).GetLootType() == original_session->GetLoot(i).GetLootType());
+                    CHECK(replayed_session->GetLoot(i).GetPosition().x == original_session->GetLoot(i).GetPosition().x);
+                    CHECK(replayed_session->GetLoot(i).GetPosition().y == original_session->GetLoot(i).GetPosition().y);
+                }
+            }
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+}
+
+SCENARIO("Action journal write errors") {
+    GIVEN("a journal whose directory disappears") {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "action-journal-error-tests";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        const std::filesystem::path base_path = dir / "game.state.journal";
+
+        ActionJournal journal(base_path);
+        journal.Open(1);
+        REQUIRE(journal.Append(TickRecord{ 50, 1 }) == 1);
+        journal.Commit();
+        journal.Flush();
+
+        std::filesystem::remove_all(dir);
+        journal.Rotate();
+        REQUIRE(journal.Append(TickRecord{ 50, 2 }) == 2);
+        journal.Commit();
+
+        THEN("the error is reported once and later records are refused") {
+            CHECK_THROWS(journal.Flush());
+            CHECK_NOTHROW(journal.Flush());
+            CHECK(journal.Append(TickRecord{ 50, 3 }) == 0);
+        }
+
+        WHEN("a new segment is opened after the error") {
+            CHECK_THROWS(journal.Flush());
+            std::filesystem::create_directories(dir);
+            journal.Rotate();
+            const std::uint64_t seq = journal.Append(TickRecord{ 50, 4 });
+            journal.Commit();
+            journal.Flush();
+
+            THEN("records are accepted again and the lost ones leave a gap") {
+                CHECK(seq == 3);
+                const std::vector<Entry> entries = journal.ReadAfter(0);
+                REQUIRE(entries.size() == 1);
+                CHECK(entries[0].seq == 3);
+            }
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+}
+
+SCENARIO("Replay of a journal with a gap") {
+    GIVEN("a journal tail with a missing record") {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "action-journal-gap-tests";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        const std::filesystem::path state_path = dir / "game.state";
+
+        auto make_game = [] {
+            model::Game game;
+            auto extra_data = std::make_shared<ExtraData>();
+            boost::json::array loot_types{ "key"s };
+            extra_data->InsertMapInfo(loot_types);
+            game.SetExtraData(extra_data);
+            game.SetLootGenerator(std::make_shared<loot_gen::LootGenerator>(100ms, 0.0));
+            model::Map map(model::Map::Id("testmap"s), "Test map"s, 1, 3);
+            map.AddRoad(model::Road(model::Road::HORIZONTAL, { 0, 0 }, 40));
+            game.AddMap(std::move(map));
+            return game;
+        };
+
+        model::Game game = make_game();
+        model::Token token;
+        double x_before_gap = 0;
+        {
+            serialization::SerializingListener listener(0ms, game, state_path, true);
+            game.SetApplicationListener(&listener);
+            listener.RestoreGame(game);
+
+            model::GameSession& session = game.GetSession(model::Map::Id("testmap"s));
+            auto [player_token, player] = game.AddPlayer("Pluto"s, &session);
+            token = player_token;
+            game.MovePlayer(token, player, "R"sv);
+            game.GameTick(200);
+            x_before_gap = player.GetPetPosition().x;
+            game.SetApplicationListener(nullptr);
+        }
+        // Записи 4..9 потеряны, за разрывом остался ещё один тик
+        {
+            std::ofstream segment(dir / "game.state.journal.10", std::ios::binary);
+            segment << EncodeEntry(Entry{ 10, TickRecord{ 200, 1 } });
+        }
+
+        WHEN("a new game restores it") {
+            model::Game restored = make_game();
+            serialization::SerializingListener listener(0ms, restored, state_path, true);
+            std::vector<std::string> errors;
+            listener.SetErrorHandler([&errors](std::string_view source, std::exception_ptr) {
+                errors.emplace_back(source);
+            });
+            listener.RestoreGame(restored);
+
+            THEN("only the records before the gap are applied") {
+                model::Player* replayed = restored.FindPlayerByToken(token);
+                REQUIRE(replayed != nullptr);
+                CHECK(replayed->GetPetPosition().x == x_before_gap);
+                CHECK(errors == std::vector{ "journal"s });
+            }
+
+            THEN("the state is saved and the tail after the gap is removed") {
+                CHECK(std::filesystem::exists(state_path));
+                CHECK_FALSE(std::filesystem::exists(dir / "game.state.journal.10"));
+            }
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+}
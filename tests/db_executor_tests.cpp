@@ -0,0 +1,136 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <boost/asio/io_context.hpp>
+
+#include <future>
+#include <mutex>
+#include <optional>
+
+#include "../src/db_executor.h"
+
+using namespace std::literals;
+using namespace db_executor;
+
+namespace {
+
+// БД в памяти; пока open не выполнен, запросы ждут - так моделируется медленный сервер
+class FakeDatabase : public model::Database {
+public:
+    void SaveRecord(std::string name, int score, uint64_t played_time) override {
+        gate_.wait();
+        std::lock_guard lock(mutex_);
+        boost::json::object record;
+        record["name"] = name;
+        record["score"] = score;
+        record["playTime"] = static_cast<double>(played_time) / 1000.;
+        records_.push_back(std::move(record));
+    }
+
+    void InsertRecord(const model::RecordKey& record) override {
+        SaveRecord(record.name, record.score, record.play_time_ms);
+    }
+
+    boost::json::array GetRecords(int limit, int offset) override {
+        gate_.wait();
+        std::lock_guard lock(mutex_);
+        boost::json::array result;
+        for (size_t i = offset; i < records_.size() && result.size() < static_cast<size_t>(limit); ++i) {
+            result.push_back(records_[i]);
+        }
+        return result;
+    }
+
+    model::RecordsPage GetRecordsPage(int limit, const std::optional<model::RecordKey>& after) override {
+        model::RecordsPage page;
+        page.records = GetRecords(limit, 0);
+        return page;
+    }
+
+    boost::json::array GetWindowRecords(model::RecordsWindow window, int limit, int offset) override {
+        return GetRecords(limit, offset);
+    }
+
+    void Open() {
+        open_.set_value();
+    }
+
+    size_t GetCount() {
+        std::lock_guard lock(mutex_);
+        return records_.size();
+    }
+
+private:
+    std::promise<void> open_;
+    std::shared_future<void> gate_ = open_.get_future().share();
+    std::mutex mutex_;
+    boost::json::array records_;
+};
+
+}  // namespace
+
+SCENARIO("Database executor") {
+    GIVEN("an executor over a database") {
+        auto db = std::make_shared<FakeDatabase>();
+        boost::asio::io_context ioc;
+        Config config;
+        config.threads = 1;
+        config.max_queue = 2;
+        config.timeout = 100ms;
+        auto executor = std::make_shared<Executor>(db, config);
+
+        std::optional<Error> error;
+        boost::json::array records;
+        auto handler = [&](Error result_error, boost::json::array result) {
+            error = result_error;
+            records = std::move(result);
+        };
+
+        WHEN("records are requested") {
+            db->Open();
+            REQUIRE(executor->SaveRecord("Pluto"s, 10, 2000));
+            executor->GetRecords(100, 0, ioc.get_executor(), handler);
+            ioc.run();
+
+            THEN("the result is delivered to the completion executor") {
+                REQUIRE(error == Error::NONE);
+                REQUIRE(records.size() == 1);
+                CHECK(records[0].as_object().at("name").as_string() == "Pluto");
+            }
+        }
+
+        WHEN("the database does not answer in time") {
+            executor->GetRecords(100, 0, ioc.get_executor(), handler);
+            ioc.run();
+
+            THEN("the request fails with a timeout") {
+                CHECK(error == Error::TIMEOUT);
+            }
+            db->Open();
+        }
+
+        WHEN("the queue is full") {
+            // Первую задачу забирает поток, ещё две заполняют очередь
+            REQUIRE(executor->SaveRecord("Pluto"s, 10, 2000));
+            while (executor->SaveRecord("Goofy"s, 20, 3000)) {
+            }
+            executor->GetRecords(100, 0, ioc.get_executor(), handler);
+            ioc.run();
+
+            THEN("the request is rejected at once") {
+                CHECK(error == Error::QUEUE_FULL);
+            }
+            db->Open();
+        }
+
+        WHEN("the executor stops with saves in the queue") {
+            REQUIRE(executor->SaveRecord("Pluto"s, 10, 2000));
+            REQUIRE(executor->SaveRecord("Goofy"s, 20, 3000));
+            db->Open();
+            executor->Stop();
+
+            THEN("the accepted saves are written") {
+                CHECK(db->GetCount() == 2);
+            }
+        }
+    }
+}
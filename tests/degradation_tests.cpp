@@ -0,0 +1,77 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/degradation.h"
+
+using namespace std::literals;
+using namespace degradation;
+
+SCENARIO("Degradation controller") {
+    GIVEN("a controller with a short ladder") {
+        Config config;
+        config.escalate_after_ticks = 2;
+        config.recover_after_ticks = 3;
+        config.ladder = { Action::STRETCH_TICK_PERIOD, Action::REJECT_JOINS };
+        Controller controller(config);
+
+        THEN("nothing is degraded initially") {
+            CHECK(controller.GetLevel() == 0);
+            CHECK_FALSE(controller.IsActive(Action::STRETCH_TICK_PERIOD));
+            CHECK(controller.GetTickPeriod(50ms) == 50ms);
+        }
+
+        WHEN("ticks overrun the period") {
+            CHECK_FALSE(controller.OnTickFinished(95ms, 100ms));
+            CHECK(controller.OnTickFinished(95ms, 100ms));
+
+            THEN("the first step is enabled") {
+                CHECK(controller.GetLevel() == 1);
+                CHECK(controller.IsActive(Action::STRETCH_TICK_PERIOD));
+                CHECK_FALSE(controller.IsActive(Action::REJECT_JOINS));
+                CHECK(controller.GetTickPeriod(50ms) == 100ms);
+            }
+
+            AND_WHEN("overload continues past the end of the ladder") {
+                for (int i = 0; i < 10; ++i) {
+                    controller.OnTickFinished(200ms, 100ms);
+                }
+
+                THEN("the level stops at the ladder size") {
+                    CHECK(controller.GetLevel() == 2);
+                    CHECK(controller.IsActive(Action::REJECT_JOINS));
+                    CHECK_FALSE(controller.IsActive(Action::SKIP_LOOT_GENERATION));
+                }
+            }
+
+            AND_WHEN("ticks become healthy again") {
+                controller.OnTickFinished(10ms, 100ms);
+                controller.OnTickFinished(10ms, 100ms);
+                CHECK(controller.GetLevel() == 1);
+                CHECK(controller.OnTickFinished(10ms, 100ms));
+
+                THEN("the level goes back down") {
+                    CHECK(controller.GetLevel() == 0);
+                    CHECK(controller.GetTickPeriod(50ms) == 50ms);
+                }
+            }
+
+            AND_WHEN("a tick in the neutral zone interrupts the streak") {
+                controller.OnTickFinished(95ms, 100ms);
+                controller.OnTickFinished(70ms, 100ms);
+                controller.OnTickFinished(95ms, 100ms);
+
+                THEN("the level is unchanged") {
+                    CHECK(controller.GetLevel() == 1);
+                }
+            }
+        }
+    }
+
+    GIVEN("action names") {
+        THEN("they round-trip") {
+            for (Action action : { Action::STRETCH_TICK_PERIOD, Action::SKIP_LOOT_GENERATION, Action::THROTTLE_STATE, Action::REJECT_JOINS }) {
+                CHECK(ActionFromString(ActionToString(action)) == action);
+            }
+            CHECK_FALSE(ActionFromString("unknown"sv).has_value());
+        }
+    }
+}
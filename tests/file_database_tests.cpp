@@ -0,0 +1,127 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+#include "../src/file_database.h"
+
+using namespace std::literals;
+using namespace file_db;
+
+SCENARIO("File-backed records database") {
+    GIVEN("a database with several records") {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "file-database-tests";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        const std::filesystem::path path = dir / "records.log";
+
+        {
+            FileDatabase db(path);
+            db.SaveRecord("Pluto"s, 10, 5000);
+            db.SaveRecord("Goofy"s, 30, 7000);
+            db.SaveRecord("Rex"s, 10, 3000);
+            db.SaveRecord("Bobik"s, 20, 1000);
+
+            WHEN("records are read by offset") {
+                const boost::json::array records = db.GetRecords(2, 1);
+
+                THEN("they are sorted by score, then by play time") {
+                    REQUIRE(records.size() == 2);
+                    CHECK(records[0].as_object().at("name").as_string() == "Bobik");
+                    CHECK(records[1].as_object().at("name").as_string() == "Rex");
+                    CHECK(records[1].as_object().at("playTime").as_double() == 3.0);
+                }
+            }
+
+            WHEN("records are read page by page") {
+                const model::RecordsPage first = db.GetRecordsPage(3, std::nullopt);
+                const model::RecordsPage second = db.GetRecordsPage(3, first.last);
+
+                THEN("the next page starts after the last record of the previous one") {
+                    REQUIRE(first.records.size() == 3);
+                    REQUIRE(first.last.has_value());
+                    CHECK(first.last->name == "Rex"s);
+                    REQUIRE(second.records.size() == 1);
+                    CHECK(second.records[0].as_object().at("name").as_string() == "Pluto");
+                    CHECK(db.GetRecordsPage(3, second.last).records.empty());
+                }
+            }
+        }
+
+        WHEN("the database is reopened after a torn write") {
+            {
+                std::ofstream file(path, std::ios::binary | std::ios::app);
+                file.write("\x20\x00\x00", 3);
+            }
+            FileDatabase db(path);
+            db.SaveRecord("Sharik"s, 40, 2000);
+
+            THEN("saved records survive and new ones are appended after them") {
+                FileDatabase reopened(path);
+                CHECK(reopened.GetCount() == 5);
+                CHECK(reopened.GetRecords(1, 0)[0].as_object().at("name").as_string() == "Sharik");
+            }
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+}
+
+SCENARIO("Records by time window") {
+    GIVEN("records retired today and more than a week ago") {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "file-database-window-tests";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        FileDatabase db(dir / "records.log");
+
+        const int64_t now = model::GetRecordTime();
+        const int64_t old = now - 8 * 24 * 60 * 60 * 1000LL;
+        db.InsertRecord(model::RecordKey{ 50, 1000, "Old"s, file_db::NewRecordId(), old });
+        for (int i = 0; i <= model::WINDOW_TOP_SIZE; ++i) {
+            db.InsertRecord(model::RecordKey{ i, 1000, "Dog"s + std::to_string(i), file_db::NewRecordId(), now });
+        }
+
+        WHEN("the day and week leaderboards are read") {
+            const boost::json::array day = db.GetWindowRecords(model::RecordsWindow::DAY, 100, 0);
+            const boost::json::array week = db.GetWindowRecords(model::RecordsWindow::WEEK, 100, 0);
+
+            THEN("they hold only the top of the current period") {
+                REQUIRE(day.size() == 100);
+                CHECK(day[0].as_object().at("name").as_string() == "Dog100");
+                CHECK(day[99].as_object().at("name").as_string() == "Dog1");
+                CHECK(week.size() == 100);
+                CHECK(db.GetWindowRecords(model::RecordsWindow::DAY, 10, 100).empty());
+            }
+        }
+
+        WHEN("the all-time leaderboard is read") {
+            const boost::json::array all = db.GetWindowRecords(model::RecordsWindow::ALL, 100, 50);
+
+            THEN("it includes old records") {
+                CHECK(all.size() == 52);
+                CHECK(db.GetRecords(1, 0)[0].as_object().at("name").as_string() == "Dog100");
+                // При равных очках и времени порядок по имени: Dog50 раньше Old
+                CHECK(db.GetRecords(1, 51)[0].as_object().at("name").as_string() == "Old");
+            }
+        }
+
+        WHEN("the database is reopened") {
+            FileDatabase reopened(dir / "records.log");
+
+            THEN("the windows are rebuilt from the log") {
+                CHECK(reopened.GetWindowRecords(model::RecordsWindow::DAY, 100, 0).size() == 100);
+            }
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+}
+
+SCENARIO("Time window boundaries") {
+    // 2026-10-18 12:00 UTC, воскресенье
+    const int64_t time = 1792281600000LL + 12 * 60 * 60 * 1000LL;
+    CHECK(model::GetWindowStart(model::RecordsWindow::DAY, time) == 1792281600000LL);
+    // Понедельник, 2026-10-12
+    CHECK(model::GetWindowStart(model::RecordsWindow::WEEK, time) == 1791763200000LL);
+    CHECK(model::GetWindowStart(model::RecordsWindow::WEEK, 1791763200000LL) == 1791763200000LL);
+}
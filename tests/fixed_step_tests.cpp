@@ -0,0 +1,74 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/fixed_step.h"
+
+using namespace std::literals;
+using namespace fixed_step;
+
+SCENARIO("Fixed step accumulator") {
+    using Clock = Accumulator::Clock;
+
+    GIVEN("an accumulator allowing two catch-up steps") {
+        Accumulator accumulator(2);
+
+        WHEN("a tick comes early") {
+            const Steps steps = accumulator.Advance(30ms, 50ms);
+
+            THEN("no step is run and the time is kept") {
+                CHECK(steps.run == 0);
+                CHECK(steps.dropped == 0);
+                CHECK(accumulator.GetAccumulated() == 30ms);
+            }
+
+            AND_WHEN("the next tick completes the step") {
+                const Steps next = accumulator.Advance(25ms, 50ms);
+
+                THEN("one step is run and the remainder is kept") {
+                    CHECK(next.run == 1);
+                    CHECK(next.dropped == 0);
+                    CHECK(accumulator.GetAccumulated() == 5ms);
+                }
+            }
+        }
+
+        WHEN("a tick is late by less than the catch-up limit") {
+            const Steps steps = accumulator.Advance(160ms, 50ms);
+
+            THEN("the missed steps are caught up") {
+                CHECK(steps.run == 3);
+                CHECK(steps.dropped == 0);
+                CHECK(accumulator.GetAccumulated() == 10ms);
+            }
+        }
+
+        WHEN("a tick is late by more than the catch-up limit") {
+            const Steps steps = accumulator.Advance(420ms, 50ms);
+
+            THEN("the steps over the limit are dropped and the remainder is kept") {
+                CHECK(steps.run == 3);
+                CHECK(steps.dropped == 5);
+                CHECK(accumulator.GetAccumulated() == 20ms);
+            }
+        }
+
+        WHEN("the remainder is known") {
+            accumulator.Advance(70ms, 50ms);
+            const Clock::time_point now{ 1s };
+
+            THEN("the next deadline lies on the step grid") {
+                CHECK(accumulator.GetNextDeadline(now, 50ms) == now + 30ms);
+            }
+        }
+    }
+
+    GIVEN("an accumulator without catch-up steps") {
+        Accumulator accumulator;
+
+        THEN("a late tick runs a single step") {
+            const Steps steps = accumulator.Advance(120ms, 50ms);
+            CHECK(steps.run == 1);
+            CHECK(steps.dropped == 1);
+            CHECK(accumulator.GetAccumulated() == 20ms);
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+
+#include "../src/load_shedding.h"
+
+using namespace std::literals;
+using namespace load_shedding;
+
+SCENARIO("Connection limiter") {
+    const auto first = boost::asio::ip::make_address("10.0.0.1");
+    const auto second = boost::asio::ip::make_address("10.0.0.2");
+
+    GIVEN("a limiter of three connections with two per address") {
+        ConnectionLimiter limiter(3, 2);
+
+        THEN("an address cannot open more than its share") {
+            CHECK(limiter.TryAcquire(first));
+            CHECK(limiter.TryAcquire(first));
+            CHECK_FALSE(limiter.TryAcquire(first));
+            CHECK(limiter.TryAcquire(second));
+        }
+
+        WHEN("the global limit is reached") {
+            REQUIRE(limiter.TryAcquire(first));
+            REQUIRE(limiter.TryAcquire(second));
+            REQUIRE(limiter.TryAcquire(second));
+
+            THEN("no address can connect") {
+                CHECK_FALSE(limiter.TryAcquire(boost::asio::ip::make_address("10.0.0.3")));
+                CHECK_FALSE(limiter.TryAcquire(first));
+            }
+
+            AND_WHEN("a connection is closed") {
+                limiter.Release(second);
+
+                THEN("its slot is available again") {
+                    CHECK(limiter.TryAcquire(first));
+                    CHECK_FALSE(limiter.TryAcquire(second));
+                }
+            }
+        }
+
+        WHEN("an address that holds no connections is released") {
+            limiter.Release(first);
+
+            THEN("the limits are unchanged") {
+                CHECK(limiter.TryAcquire(first));
+                CHECK(limiter.TryAcquire(first));
+                CHECK_FALSE(limiter.TryAcquire(first));
+            }
+        }
+    }
+
+    GIVEN("a limiter without limits") {
+        ConnectionLimiter limiter(0, 0);
+
+        THEN("every connection is accepted") {
+            for (int i = 0; i < 100; ++i) {
+                CHECK(limiter.TryAcquire(first));
+            }
+        }
+    }
+}
+
+SCENARIO("Shedding by request priority") {
+    GIVEN("a shed threshold of 10 ms") {
+        const auto threshold = 10ms;
+
+        THEN("lobby requests are shed first, then state, then actions") {
+            CHECK_FALSE(ShouldShed(RequestPriority::LOBBY, 10ms, threshold));
+            CHECK(ShouldShed(RequestPriority::LOBBY, 11ms, threshold));
+            CHECK_FALSE(ShouldShed(RequestPriority::STATE, 20ms, threshold));
+            CHECK(ShouldShed(RequestPriority::STATE, 21ms, threshold));
+            CHECK_FALSE(ShouldShed(RequestPriority::ACTION, 40ms, threshold));
+            CHECK(ShouldShed(RequestPriority::ACTION, 41ms, threshold));
+        }
+    }
+
+    GIVEN("a zero threshold") {
+        THEN("nothing is shed") {
+            CHECK_FALSE(ShouldShed(RequestPriority::LOBBY, 1s, 0ms));
+        }
+    }
+}
+
+SCENARIO("Queue delay monitor") {
+    GIVEN("a monitor") {
+        QueueDelayMonitor monitor;
+
+        THEN("the delay is zero without requests") {
+            CHECK(monitor.Get() == 0us);
+        }
+
+        WHEN("a request waits in the queue") {
+            monitor.OnEnqueued();
+            std::this_thread::sleep_for(20ms);
+
+            THEN("the delay grows with its age") {
+                CHECK(monitor.Get() >= 20ms);
+            }
+
+            AND_WHEN("the request starts") {
+                monitor.OnStarted(20ms);
+
+                THEN("only the smoothed delay remains") {
+                    CHECK(monitor.Get() == 2500us);
+                }
+            }
+        }
+    }
+}
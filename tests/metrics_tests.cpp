@@ -0,0 +1,54 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+#include <vector>
+
+#include "../src/metrics.h"
+
+using namespace std::literals;
+
+SCENARIO("Per-thread metrics") {
+    metrics::Registry& registry = metrics::Registry::Instance();
+
+    GIVEN("a counter incremented from several threads") {
+        const metrics::Counter counter = registry.AddCounter("test_events_total", "Test counter", metrics::Label("case", "threads"));
+
+        {
+            std::vector<std::jthread> workers;
+            for (int i = 0; i < 4; ++i) {
+                workers.emplace_back([&counter] {
+                    for (int j = 0; j < 1000; ++j) {
+                        counter.Add();
+                    }
+                });
+            }
+        }
+
+        THEN("values of finished threads are aggregated on scrape") {
+            CHECK(registry.Serialize().find("test_events_total{case=\"threads\"} 4000\n"s) != std::string::npos);
+
+            AND_THEN("the same metric registered again shares the slots") {
+                const metrics::Counter same = registry.AddCounter("test_events_total", "Test counter", metrics::Label("case", "threads"));
+                same.Add(5);
+                CHECK(registry.Serialize().find("test_events_total{case=\"threads\"} 4005\n"s) != std::string::npos);
+            }
+        }
+    }
+
+    GIVEN("a latency histogram") {
+        const metrics::Histogram histogram = registry.AddHistogram("test_latency_microseconds", "Test histogram");
+        histogram.Observe(40us);
+        histogram.Observe(100us);
+        histogram.Observe(10s);
+
+        THEN("buckets are cumulative") {
+            const std::string text = registry.Serialize();
+            CHECK(text.find("# TYPE test_latency_microseconds histogram\n"s) != std::string::npos);
+            CHECK(text.find("test_latency_microseconds_bucket{le=\"50\"} 1\n"s) != std::string::npos);
+            CHECK(text.find("test_latency_microseconds_bucket{le=\"100\"} 2\n"s) != std::string::npos);
+            CHECK(text.find("test_latency_microseconds_bucket{le=\"+Inf\"} 3\n"s) != std::string::npos);
+            CHECK(text.find("test_latency_microseconds_sum 10000140\n"s) != std::string::npos);
+            CHECK(text.find("test_latency_microseconds_count 3\n"s) != std::string::npos);
+        }
+    }
+}
@@ -1,5 +1,6 @@
 #include <catch2/catch_test_macros.hpp>
 
+#include "../src/loot_generator.h"
 #include "../src/model.h"
 
 using namespace std::literals;
@@ -78,6 +79,210 @@ SCENARIO("Game model") {
 			THEN("session contain 1 loot")
 				CHECK(game_session.GetLootCount() == 1);
 		}
+
+		WHEN("collected loot is erased from the map") {
+			std::vector<model::LootHandle> handles;
+			for (int i = 0; i < 4; ++i) {
+				handles.push_back(game_session.AddExistLoot(model::Loot{ i, { static_cast<double>(i), 0. } }));
+			}
+			game_session.GetLoot(handles[1]).SetCollected();
+			game_session.GetLoot(handles[2]).SetCollected();
+			game_session.EraseTookedLoot();
+
+			THEN("the rest keep their order and ids") {
+				REQUIRE(game_session.GetLootCount() == 2);
+				CHECK(game_session.GetLootHandle(0) == handles[0]);
+				CHECK(game_session.GetLootHandle(1) == handles[3]);
+				CHECK(game_session.GetLoot(1).GetLootId() == game_session.GetLoot(handles[3]).GetLootId());
+			}
+		}
+
+		WHEN("loot is removed and a new one is added") {
+			model::LootHandle old_handle = game_session.StoreLoot(model::Loot{ 1, { 1., 0. } });
+			game_session.RemoveLoot(old_handle);
+			model::LootHandle new_handle = game_session.AddExistLoot(model::Loot{ 2, { 2., 0. } });
+
+			THEN("the slot is reused but the old handle does not reach the new loot") {
+				CHECK(new_handle.index == old_handle.index);
+				CHECK_FALSE(new_handle == old_handle);
+				CHECK(game_session.GetLoot(new_handle).GetLootType() == 2);
+				CHECK_THROWS_AS(game_session.GetLoot(old_handle), std::out_of_range);
+			}
+		}
 	}
 	
-}
\ No newline at end of file
+}
+
+SCENARIO("Session slots") {
+	GIVEN("more empty sessions than one summary word of the bucket covers") {
+		model::SessionSlots slots(3);
+		constexpr size_t SESSION_COUNT = 10000;
+		for (size_t i = 0; i < SESSION_COUNT; ++i) {
+			slots.Add(i);
+		}
+
+		WHEN("players join sessions far apart") {
+			slots.Update(9000, 0, 1);
+			slots.Update(70, 0, 1);
+			slots.Update(70, 1, 2);
+			slots.Update(5000, 0, 1);
+
+			THEN("ties go to the lowest session index") {
+				CHECK(slots.FindFree(model::SessionPacking::FILL_FIRST) == 70);
+				CHECK(slots.FindFree(model::SessionPacking::BALANCE) == 0);
+				CHECK(slots.GetSessions(1) == std::vector<size_t>{ 5000, 9000 });
+				CHECK(slots.FindTarget(1, 70) == 5000);
+				CHECK(slots.FindTarget(1, 5000) == 70);
+				CHECK(slots.FindTarget(2, 70) == std::nullopt);
+				CHECK(slots.GetSessions(0).size() == SESSION_COUNT - 3);
+			}
+
+			AND_WHEN("a session becomes full and another empties") {
+				slots.Update(70, 2, 3);
+				slots.Update(5000, 1, 0);
+
+				THEN("the full one leaves the buckets") {
+					CHECK(slots.FindFree(model::SessionPacking::FILL_FIRST) == 9000);
+					CHECK(slots.GetSessions(2).empty());
+					CHECK(slots.GetSessions(1) == std::vector<size_t>{ 9000 });
+					CHECK(slots.GetSessions(0).size() == SESSION_COUNT - 2);
+				}
+			}
+		}
+	}
+}
+
+SCENARIO("Session assignment") {
+	GIVEN("a map with two-player sessions that are compacted below two players") {
+		model::Game game;
+		auto extra_data = std::make_shared<ExtraData>();
+		boost::json::array loot_types{ "key"s };
+		extra_data->InsertMapInfo(loot_types);
+		game.SetExtraData(extra_data);
+		game.SetLootGenerator(std::make_shared<loot_gen::LootGenerator>(100ms, 1.0));
+		model::Map map(model::Map::Id("testmap"s), "Test map"s, 1, 3);
+		map.AddRoad(model::Road(model::Road::HORIZONTAL, { 0, 0 }, 10));
+		map.SetSessionConfig(model::SessionConfig{ 2, model::SessionPacking::FILL_FIRST, 2 });
+		game.AddMap(std::move(map));
+		const model::Map::Id map_id("testmap"s);
+		const size_t map_index = game.FindMap(map_id)->GetIndex();
+
+		auto join = [&game, &map_id](std::string name) {
+			return game.AddPlayer(std::move(name), &game.GetSession(map_id)).first;
+		};
+		const model::Token first = join("Pluto"s);
+		const model::Token second = join("Goofy"s);
+		const model::Token third = join("Rex"s);
+
+		THEN("a new session is opened only when the previous one is full") {
+			const std::deque<model::GameSession>& sessions = game.GetMapSessions().at(map_index);
+			REQUIRE(sessions.size() == 2);
+			CHECK(sessions[0].GetNumberOfDogs() == 2);
+			CHECK(sessions[1].GetNumberOfDogs() == 1);
+		}
+
+		WHEN("a session drops below the threshold") {
+			model::Player* player = game.FindPlayerByToken(second);
+			player->TakeLoot(player->GetSessionPtr()->StoreLoot(model::Loot{ 0, { 1., 0. } }));
+			game.RetirePlayer(first);
+			game.GameTick(10);
+
+			THEN("its players move to another session with their bags") {
+				const std::deque<model::GameSession>& sessions = game.GetMapSessions().at(map_index);
+				CHECK(sessions[0].GetNumberOfDogs() == 0);
+				CHECK(sessions[1].GetNumberOfDogs() == 2);
+				REQUIRE(player->GetSessionPtr() == &sessions[1]);
+				REQUIRE(player->GetLootCount() == 1);
+				CHECK(sessions[1].GetLoot(player->GetLootHandles()[0]).GetPosition() == model::Position{ 1., 0. });
+				CHECK(game.FindPlayerByToken(third)->GetSessionPtr() == &sessions[1]);
+			}
+
+			AND_WHEN("another player joins") {
+				join("Bobik"s);
+
+				THEN("the emptied session is reused") {
+					CHECK(game.GetMapSessions().at(map_index).size() == 2);
+					CHECK(game.GetMapSessions().at(map_index)[0].GetNumberOfDogs() == 1);
+				}
+			}
+		}
+	}
+}
+
+SCENARIO("Player tokens") {
+	GIVEN("a generated token") {
+		model::PlayerTokens tokens;
+		const model::Token token = tokens.GenerateToken();
+
+		THEN("it round-trips through its text form") {
+			const std::string text = token.ToString();
+			REQUIRE(text.size() == model::Token::TEXT_SIZE);
+			CHECK(model::Token::FromString(text) == token);
+			CHECK(model::Token::FromString("0123456789abcdef0000000000000001"sv) == model::Token{ 0x0123456789abcdefull, 1 });
+		}
+
+		THEN("malformed text is rejected") {
+			CHECK_FALSE(model::Token::FromString("0123456789abcdef000000000000000"sv));
+			CHECK_FALSE(model::Token::FromString("0123456789abcdef000000000000000g"sv));
+			CHECK_FALSE(model::Token::FromString("0123456789ABCDEF0000000000000000"sv));
+		}
+	}
+
+	GIVEN("a token index") {
+		model::TokenIndex index;
+		std::vector<model::Player> players(100);
+		std::vector<model::Token> tokens;
+		for (std::uint64_t i = 0; i < players.size(); ++i) {
+			tokens.emplace_back(i % 7, i);
+			index.Insert(tokens.back(), &players[i]);
+		}
+
+		WHEN("every other token is erased") {
+			for (size_t i = 0; i < tokens.size(); i += 2) {
+				index.Erase(tokens[i]);
+			}
+
+			THEN("the remaining tokens are still found") {
+				CHECK(index.GetSize() == 50);
+				for (size_t i = 0; i < tokens.size(); ++i) {
+					CHECK(index.Find(tokens[i]) == (i % 2 ? &players[i] : nullptr));
+				}
+			}
+		}
+	}
+}
+
+SCENARIO("Player removal") {
+	GIVEN("three players in one session") {
+		model::Game game;
+		model::Map map(model::Map::Id("testmap"s), "Test map"s, 1, 3);
+		map.AddRoad(model::Road(model::Road::HORIZONTAL, { 0, 0 }, 10));
+		game.AddMap(std::move(map));
+		const model::Map::Id map_id("testmap"s);
+		model::GameSession& session = game.GetSession(map_id);
+		const model::Token first = game.AddPlayer("Pluto"s, &session).first;
+		const model::Token second = game.AddPlayer("Goofy"s, &session).first;
+		const model::Token third = game.AddPlayer("Rex"s, &session).first;
+
+		WHEN("the middle player retires") {
+			game.RetirePlayer(second);
+
+			THEN("the others are still reached by token, by dog and from the session") {
+				REQUIRE(game.GetPlayers().size() == 2);
+				CHECK(game.FindPlayerByToken(second) == nullptr);
+				model::Player* pluto = game.FindPlayerByToken(first);
+				model::Player* rex = game.FindPlayerByToken(third);
+				REQUIRE(pluto != nullptr);
+				REQUIRE(rex != nullptr);
+				CHECK(pluto->GetPetName() == "Pluto"s);
+				CHECK(rex->GetPetName() == "Rex"s);
+				CHECK(pluto->GetToken() == first);
+				CHECK(rex->GetToken() == third);
+				CHECK(game.FindByDogIdAndMapId(rex->GetId(), map_id) == rex);
+				REQUIRE(session.GetNumberOfDogs() == 2);
+				CHECK(session.GetDogPlayer(0) == pluto);
+				CHECK(session.GetDogPlayer(1) == rex);
+			}
+		}
+	}
+}
@@ -0,0 +1,95 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <filesystem>
+
+#include "../src/file_database.h"
+#include "../src/record_spool.h"
+
+using namespace std::literals;
+using namespace record_spool;
+
+namespace {
+
+// Файловая БД, которую можно "уронить": пока available == false, вставка бросает исключение
+class FlakyDatabase : public file_db::FileDatabase {
+public:
+    using FileDatabase::FileDatabase;
+
+    void InsertRecord(const model::RecordKey& record) override {
+        if (!available) {
+            throw std::runtime_error("Database is down");
+        }
+        FileDatabase::InsertRecord(record);
+    }
+
+    std::atomic<bool> available = true;
+};
+
+}  // namespace
+
+SCENARIO("Record spool") {
+    GIVEN("a spool in front of a database") {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "record-spool-tests";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        const std::filesystem::path spool_path = dir / "records.spool";
+        auto db = std::make_shared<FlakyDatabase>(dir / "records.log");
+
+        Config config;
+        config.retry_delay = 1ms;
+        config.max_retry_delay = 5ms;
+
+        WHEN("the database is available") {
+            SpoolingDatabase spool(spool_path, db, config);
+            spool.SaveRecord("Pluto"s, 10, 2000);
+            spool.SaveRecord("Goofy"s, 20, 3000);
+
+            THEN("records are delivered and the spool is emptied") {
+                REQUIRE(spool.WaitDelivered(5s));
+                CHECK(db->GetCount() == 2);
+                CHECK(spool.GetRecords(10, 0).size() == 2);
+            }
+        }
+
+        WHEN("the database is down") {
+            db->available = false;
+            {
+                SpoolingDatabase spool(spool_path, db, config);
+                spool.SaveRecord("Pluto"s, 10, 2000);
+                spool.SaveRecord("Goofy"s, 20, 3000);
+
+                THEN("records wait in the spool") {
+                    CHECK_FALSE(spool.WaitDelivered(50ms));
+                    CHECK(spool.GetPendingCount() == 2);
+                    CHECK(db->GetCount() == 0);
+                }
+            }
+
+            AND_WHEN("the server restarts after the database is back") {
+                db->available = true;
+                SpoolingDatabase spool(spool_path, db, config);
+
+                THEN("the spooled records are delivered") {
+                    REQUIRE(spool.WaitDelivered(5s));
+                    CHECK(db->GetCount() == 2);
+                }
+            }
+        }
+
+        WHEN("a delivered record is delivered again") {
+            const model::RecordKey record{ 10, 2000, "Pluto"s, file_db::NewRecordId() };
+            db->InsertRecord(record);
+            SpoolingDatabase spool(spool_path, db, config);
+            spool.InsertRecord(record);
+
+            THEN("the database keeps one copy") {
+                REQUIRE(spool.WaitDelivered(5s));
+                CHECK(db->GetCount() == 1);
+            }
+        }
+
+        db.reset();
+        std::filesystem::remove_all(dir);
+    }
+}
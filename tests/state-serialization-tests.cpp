@@ -1,8 +1,11 @@
+#include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <sstream>
+#include <zlib.h>
 
+#include "../src/durable_file.h"
 #include "../src/model.h"
 #include "../src/model_serialization.h"
 
@@ -77,3 +80,162 @@ SCENARIO_METHOD(Fixture, "Loot Serialization") {
         }
     }
 }
+
+SCENARIO("Binary state snapshot") {
+    GIVEN("a game with a player holding loot") {
+        auto make_game = [] {
+            model::Game game;
+            model::Map map(model::Map::Id("testmap"s), "Test map"s, 1, 3);
+            map.AddRoad(model::Road(model::Road::HORIZONTAL, { 0, 0 }, 10));
+            game.AddMap(std::move(map));
+            return game;
+        };
+        model::Game game = make_game();
+        model::GameSession& session = game.GetSession(model::Map::Id("testmap"s));
+        auto [token, player] = game.AddPlayer("Pluto"s, &session);
+        player.TakeLoot(session.StoreLoot(Loot{ 1, Position{ 1., 0. } }));
+        player.SetScore(15);
+        session.AddExistLoot(Loot{ 2, Position{ 3., 0. } });
+
+        std::stringstream strm;
+        WriteSnapshot(strm, SerializedData(game));
+
+        WHEN("the snapshot is read back") {
+            model::Game restored = make_game();
+            RestoreSnapshot(strm.view(), restored);
+
+            THEN("players, loot and tokens are restored") {
+                REQUIRE(restored.GetPlayers().size() == 1);
+                const model::Player* restored_player = restored.FindPlayerByToken(token);
+                REQUIRE(restored_player != nullptr);
+                CHECK(restored_player->GetPetName() == "Pluto"s);
+                CHECK(restored_player->GetScore() == 15);
+                CHECK(restored_player->GetLootCount() == 1);
+                CHECK(restored_player->GetSessionPtr()->GetLootCount() == 1);
+                CHECK(restored_player->GetSessionPtr()->GetLoot(0).GetPosition() == Position{ 3., 0. });
+                CHECK(restored_player->GetPetPosition() == player.GetPetPosition());
+            }
+        }
+
+        WHEN("the snapshot is compressed") {
+            std::stringstream compressed;
+            WriteSnapshot(compressed, SerializedData(game), Z_BEST_SPEED);
+            model::Game restored = make_game();
+            RestoreSnapshot(compressed.view(), restored);
+
+            THEN("it is detected and restored") {
+                REQUIRE(restored.FindPlayerByToken(token) != nullptr);
+                CHECK(restored.FindPlayerByToken(token)->GetLootCount() == 1);
+            }
+        }
+
+        WHEN("the game was saved in the version 1 archive format") {
+            std::ostringstream payload_stream(std::ios::binary);
+            {
+                boost::archive::binary_oarchive oa(payload_stream);
+                oa << SerializedData(game);
+            }
+            const std::string payload = payload_stream.str();
+            std::string content(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC));
+            content.resize(content.size() + 20);
+            char* pos = content.data() + sizeof(SNAPSHOT_MAGIC);
+            durable_file::PutLittleEndian(pos, std::uint32_t{ 1 });
+            durable_file::PutLittleEndian(pos, std::uint32_t{ 0 });
+            durable_file::PutLittleEndian(pos, std::uint64_t{ payload.size() });
+            durable_file::PutLittleEndian(pos, durable_file::Crc32(payload));
+            content += payload;
+
+            model::Game restored = make_game();
+            RestoreSnapshot(content, restored);
+
+            THEN("it is still restored") {
+                REQUIRE(restored.FindPlayerByToken(token) != nullptr);
+                CHECK(restored.FindPlayerByToken(token)->GetScore() == 15);
+            }
+        }
+
+        WHEN("the snapshot is written by the background writer") {
+            const std::filesystem::path path = std::filesystem::temp_directory_path() / "state-serialization-tests.state";
+            {
+                SnapshotWriter writer(path);
+                writer.Submit(SerializedData(game));
+                writer.Flush();
+            }
+
+            THEN("the file is complete and no temporary file is left") {
+                CHECK_FALSE(std::filesystem::exists(path.string() + ".tmp"));
+                model::Game restored = make_game();
+                RestoreSnapshotFile(path, restored);
+                CHECK(restored.FindPlayerByToken(token) != nullptr);
+            }
+            std::filesystem::remove(path);
+        }
+
+        WHEN("a payload byte is corrupted") {
+            std::string content = strm.str();
+            content.back() ^= 0x5A;
+
+            THEN("reading fails on the checksum") {
+                model::Game restored = make_game();
+                CHECK_THROWS_AS(RestoreSnapshot(content, restored), std::runtime_error);
+            }
+        }
+
+        WHEN("the game was saved in the legacy text format") {
+            std::stringstream legacy;
+            {
+                boost::archive::text_oarchive oa(legacy);
+                oa << SerializedData(game);
+            }
+            model::Game restored = make_game();
+            RestoreSnapshot(legacy.view(), restored);
+
+            THEN("it is still restored") {
+                REQUIRE(restored.GetPlayers().size() == 1);
+                CHECK(restored.FindPlayerByToken(token) != nullptr);
+            }
+        }
+    }
+}
+
+SCENARIO("Parallel state restore") {
+    GIVEN("a game with players on several maps and sessions") {
+        auto make_game = [] {
+            model::Game game;
+            for (const std::string id : { "map1"s, "map2"s }) {
+                model::Map map(model::Map::Id(id), "Map "s + id, 1, 3);
+                map.AddRoad(model::Road(model::Road::HORIZONTAL, { 0, 0 }, 10));
+                game.AddMap(std::move(map));
+            }
+            return game;
+        };
+        model::Game game = make_game();
+        game.AddSession(model::Map::Id("map1"s));
+        model::GameSession& second_session = game.AddSession(model::Map::Id("map1"s));
+        auto [first_token, first_player] = game.AddPlayer("Pluto"s, &second_session);
+        first_player.SetScore(5);
+        auto [second_token, second_player] = game.AddPlayer("Goofy"s, &game.GetSession(model::Map::Id("map2"s)));
+        const SerializedData data(game);
+
+        WHEN("the snapshot is restored with several threads") {
+            model::Game restored = make_game();
+            data.Restore(restored, 4);
+
+            THEN("sessions keep their order and players are found by token and dog id") {
+                const std::deque<model::GameSession>& sessions = restored.GetMapSessions().at(restored.FindMap(model::Map::Id("map1"s))->GetIndex());
+                REQUIRE(sessions.size() == 2);
+                CHECK(sessions.front().GetNumberOfDogs() == 0);
+                CHECK(sessions.back().GetNumberOfDogs() == 1);
+
+                model::Player* pluto = restored.FindPlayerByToken(first_token);
+                REQUIRE(pluto != nullptr);
+                CHECK(pluto->GetScore() == 5);
+                CHECK(pluto->GetSessionPtr() == &sessions.back());
+                CHECK(restored.FindByDogIdAndMapId(pluto->GetId(), model::Map::Id("map1"s)) == pluto);
+                CHECK(restored.FindPlayerByToken(second_token) != nullptr);
+                CHECK(restored.FindPlayerByToken(second_token)->GetSessionPtr()->GetMapIndex() == 1);
+                CHECK(restored.FindByDogIdAndMapId(pluto->GetId(), model::Map::Id("map2"s)) == nullptr);
+            }
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <stdexcept>
+
+#include "../src/tick_profiler.h"
+
+using namespace std::literals;
+using namespace tick_profiler;
+
+SCENARIO("Tick profiler") {
+    GIVEN("a profiler with a small ring buffer") {
+        TickProfiler profiler(2);
+
+        THEN("there are no recent ticks") {
+            CHECK(profiler.GetRecent().empty());
+            CHECK(profiler.GetLast().tick_number == 0);
+        }
+
+        WHEN("a tick with two sessions is recorded") {
+            profiler.BeginTick(100);
+            profiler.Record(Phase::INACTIVE_PLAYERS, 5us);
+            profiler.Record(Phase::COMPACT_SESSIONS, 3us);
+            profiler.BeginSession("map1"sv, 0, 3);
+            profiler.Record(Phase::MOVEMENT, 10us);
+            profiler.EndSession();
+            profiler.BeginSession("map1"sv, 1, 2);
+            profiler.Record(Phase::MOVEMENT, 20us);
+            profiler.Record(Phase::LOOT_GENERATION, 7us);
+            profiler.EndSession();
+            const TickProfile& profile = profiler.EndTick();
+
+            THEN("phases are summed per session and per tick") {
+                REQUIRE(profile.sessions.size() == 2);
+                CHECK(profile.sessions[0].phases[static_cast<size_t>(Phase::MOVEMENT)] == 10us);
+                CHECK(profile.sessions[1].phases[static_cast<size_t>(Phase::MOVEMENT)] == 20us);
+                CHECK(profile.phases[static_cast<size_t>(Phase::MOVEMENT)] == 30us);
+                CHECK(profile.phases[static_cast<size_t>(Phase::INACTIVE_PLAYERS)] == 5us);
+                CHECK(profile.sessions[0].phases[static_cast<size_t>(Phase::INACTIVE_PLAYERS)] == 0us);
+                CHECK(profile.phases[static_cast<size_t>(Phase::COMPACT_SESSIONS)] == 3us);
+                CHECK(profile.time_delta == 100);
+            }
+
+            AND_WHEN("more ticks than capacity are recorded") {
+                profiler.BeginTick(200);
+                profiler.EndTick();
+                profiler.BeginTick(300);
+                profiler.EndTick();
+
+                THEN("only the latest ticks are kept in order") {
+                    const std::vector<const TickProfile*> recent = profiler.GetRecent();
+                    REQUIRE(recent.size() == 2);
+                    CHECK(recent[0]->time_delta == 200);
+                    CHECK(recent[1]->time_delta == 300);
+                    CHECK(recent[1]->sessions.empty());
+                    CHECK(profiler.GetLast().tick_number == 3);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Tick scope") {
+    GIVEN("a profiler") {
+        TickProfiler profiler;
+
+        WHEN("a tick finishes normally") {
+            {
+                TickScope scope(profiler, 50);
+            }
+
+            THEN("it is recorded as completed") {
+                CHECK(profiler.GetLast().tick_number == 1);
+                CHECK(profiler.GetLast().completed);
+            }
+        }
+
+        WHEN("a tick is interrupted by an exception") {
+            CHECK_THROWS(([&profiler] {
+                TickScope scope(profiler, 50);
+                profiler.Record(Phase::MOVEMENT, 10us);
+                throw std::runtime_error("tick failed");
+            }()));
+
+            THEN("it is still ended but marked as incomplete") {
+                CHECK(profiler.GetLast().tick_number == 1);
+                CHECK_FALSE(profiler.GetLast().completed);
+                CHECK(profiler.GetLast().phases[static_cast<size_t>(Phase::MOVEMENT)] == 10us);
+            }
+        }
+    }
+}